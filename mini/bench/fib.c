@@ -0,0 +1,18 @@
+//
+// recursive Fibonacci number N
+//
+
+#include <stdio.h>
+
+int fib(int n)
+{
+  if (n < 2)
+    return n;
+  return fib(n - 1) + fib(n - 2);
+}
+
+int main()
+{
+  printf("%d\n", fib(N));
+  return 0;
+}
@@ -0,0 +1,27 @@
+//
+// matrix multiply c := a * b, N x N integers
+//
+
+#include <stdio.h>
+
+static int a[N + 1][N + 1], b[N + 1][N + 1], c[N + 1][N + 1];
+
+int main()
+{
+  for (int i = 1; i <= N; ++i)
+    for (int j = 1; j <= N; ++j) {
+      a[i][j] = i - j;
+      b[i][j] = i + j;
+    }
+
+  for (int i = 1; i <= N; ++i)
+    for (int j = 1; j <= N; ++j) {
+      int s = 0;
+      for (int k = 1; k <= N; ++k)
+        s += a[i][k] * b[k][j];
+      c[i][j] = s;
+    }
+
+  printf("%d %d %d\n", c[1][N], c[N][1], c[N][N]);
+  return 0;
+}
@@ -0,0 +1,20 @@
+//
+// sum of the square roots of 1..N, 20 Newton steps each
+//
+
+#include <stdio.h>
+
+int main()
+{
+  double a = 0.0, sum = 0.0;
+
+  for (int i = 1; i <= N; ++i) {
+    a = a + 1.0;
+    double x = a;
+    for (int k = 1; k <= 20; ++k)
+      x = (x + a / x) / 2.0;
+    sum = sum + x;
+  }
+  printf("%d\n", (int)sum);
+  return 0;
+}
@@ -0,0 +1,21 @@
+//
+// number of primes up to N, sieve of Eratosthenes
+//
+
+#include <stdio.h>
+
+static int composite[N + 1];
+
+int main()
+{
+  int count = 0;
+
+  for (int i = 2; i <= N; ++i)
+    if (composite[i] == 0) {
+      count = count + 1;
+      for (int j = i + i; j <= N; j += i)
+        composite[j] = 1;
+    }
+  printf("%d\n", count);
+  return 0;
+}
@@ -0,0 +1,26 @@
+//
+// 100 Jacobi sweeps of a 3-point stencil over N reals
+//
+
+#include <stdio.h>
+
+static double u[N + 1], v[N + 1];
+
+int main()
+{
+  u[1] = 1000.0;
+  u[N] = 1000.0;
+
+  for (int t = 1; t <= 100; ++t) {
+    for (int i = 2; i <= N - 1; ++i)
+      v[i] = (u[i - 1] + u[i] + u[i + 1]) / 3.0;
+    for (int i = 2; i <= N - 1; ++i)
+      u[i] = v[i];
+  }
+
+  double sum = 0.0;
+  for (int i = 1; i <= N; ++i)
+    sum = sum + u[i];
+  printf("%d\n", (int)(sum * 1000.0));
+  return 0;
+}
@@ -5,13 +5,15 @@
 #include "TreeNode.h"
 #include "parser.h"
 
-TreeIdentNode::TreeIdentNode(const char *name)
-  : TreeNode(0, 0, IDENT), id(name)
+#include <cstdint>
+
+TreeIdentNode::TreeIdentNode(std::string_view name, unsigned sym)
+  : TreeNode(TREE_IDENT, 0, 0, IDENT), id(name), symbol(sym)
 {
 }
 
 TreeNumericalNode::TreeNumericalNode(int n)
-  : TreeNode(0, 0, NUMBER), num(n)
+  : TreeNode(TREE_NUMBER, 0, 0, NUMBER), num(n)
 {}
 
 std::string TreeNode::oper_to_string() const
@@ -19,6 +21,37 @@ std::string TreeNode::oper_to_string() const
     return token_to_string(oper);
 }
 
+static const size_t tree_chunk_size = 64 * 1024;
+
+void *TreeArena::allocate(size_t size, size_t align)
+{
+    char *p = (char *)(((uintptr_t)cur + align - 1) & ~(uintptr_t)(align - 1));
+    if (!cur || p + size > end) {
+        size_t chunk_size = size + align > tree_chunk_size ? size + align : tree_chunk_size;
+        chunks.push_back((char *)::operator new(chunk_size));
+        cur = chunks.back();
+        end = cur + chunk_size;
+        p = (char *)(((uintptr_t)cur + align - 1) & ~(uintptr_t)(align - 1));
+    }
+    cur = p + size;
+    allocated += size;
+    return p;
+}
+
+void TreeArena::release()
+{
+    for (auto d = dtors.rbegin(); d != dtors.rend(); ++d)
+        d->second(d->first);
+    dtors.clear();
+
+    for (auto c : chunks)
+        ::operator delete(c);
+    chunks.clear();
+    cur = end = 0;
+    allocated = 0;
+    objects = 0;
+}
+
 // Local Variables:
 // mode: c++
 // c-basic-offset: 4
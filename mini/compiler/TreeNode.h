@@ -1,19 +1,57 @@
 #ifndef __TREENODE_H
 #define __TREENODE_H
 
+#include <cstddef>
+#include <new>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+//
+// Node kind, for dispatch with a switch or llvm::isa<>/dyn_cast<> (each
+// class has a classof()) instead of RTTI.
+//
+enum tree_kind_t {
+    TREE_IDENT,
+    TREE_NUMBER,
+    TREE_DNUMBER,
+    TREE_TEXT,
+    TREE_BOOLEAN,
+    TREE_BINARY,
+    TREE_UNARY,
+};
+
+//
+// The type of the value of an expression node, given by the semantic pass
+// (sema.h) before code is generated for the expression.
+//
+enum value_type_t : unsigned char {
+    VALUE_NONE, // not analyzed yet
+    VALUE_INTEGER,
+    VALUE_REAL,
+    VALUE_BOOLEAN,
+    VALUE_STRING,
+    VALUE_ARRAY,
+    VALUE_STRUCTURE,
+    VALUE_ERROR, // reported already
+};
 
 class TreeNode {
 public:
     TreeNode * left;
     TreeNode * right;
     int oper;
+    const tree_kind_t kind;
+    value_type_t type;
 
-    TreeNode() : left{0}, right{0}, oper{0}
+    TreeNode(tree_kind_t k) : left{0}, right{0}, oper{0}, kind{k}, type{VALUE_NONE}
     {
     }
 
-    TreeNode(TreeNode *l, TreeNode *r, int o) : left{l}, right{r}, oper{o}
+    TreeNode(tree_kind_t k, TreeNode *l, TreeNode *r, int o)
+        : left{l}, right{r}, oper{o}, kind{k}, type{VALUE_NONE}
     {}
 
     virtual std::string show() const = 0;
@@ -22,12 +60,19 @@ public:
 };
 
 
+//
+// Identifiers and text literals are views of the source buffer the scanner
+// works on (see CompilationSession::compile()); the buffer outlives the
+// nodes, so a token is never copied.
+//
 class TreeIdentNode : public TreeNode {
 public:
-    std::string id;
+    std::string_view id;
+    unsigned symbol; // interned by the scanner, see symbol_table.h; 0 if not
 
-    TreeIdentNode(const char *name);
-    virtual std::string show() const { return id; }
+    TreeIdentNode(std::string_view name, unsigned sym = 0);
+    static bool classof(TreeNode const *n) { return n->kind == TREE_IDENT; }
+    virtual std::string show() const { return std::string(id); }
 };
 
 class TreeNumericalNode : public TreeNode {
@@ -35,6 +80,7 @@ public:
     int num; 
 
     TreeNumericalNode(int n);
+    static bool classof(TreeNode const *n) { return n->kind == TREE_NUMBER; }
     virtual std::string show() const { return std::to_string(num); }
 };
 
@@ -42,29 +88,33 @@ class TreeDNumericalNode : public TreeNode {
 public:
     double num; 
 
-    TreeDNumericalNode(double n) :TreeNode(), num(n) {}
+    TreeDNumericalNode(double n) :TreeNode(TREE_DNUMBER), num(n) {}
+    static bool classof(TreeNode const *n) { return n->kind == TREE_DNUMBER; }
     virtual std::string show() const { return std::to_string(num); }
 };
 
 class TreeTextNode : public TreeNode {
 public:
-    std::string text;
+    std::string_view text;
 
-    TreeTextNode(const char *t, size_t len) :TreeNode(), text(t, len) {}
-    virtual std::string show() const { return text; }
+    TreeTextNode(const char *t, size_t len) :TreeNode(TREE_TEXT), text(t, len) {}
+    static bool classof(TreeNode const *n) { return n->kind == TREE_TEXT; }
+    virtual std::string show() const { return std::string(text); }
 };
 
 class TreeBooleanNode : public TreeNode {
 public:
     bool num;
 
-    TreeBooleanNode(bool b) : TreeNode{}, num(b) {}
+    TreeBooleanNode(bool b) : TreeNode{TREE_BOOLEAN}, num(b) {}
+    static bool classof(TreeNode const *n) { return n->kind == TREE_BOOLEAN; }
     virtual std::string show() const { return std::to_string(num); }
 };
 
 class TreeBinaryNode : public TreeNode {
 public:
-    TreeBinaryNode(TreeNode *left, TreeNode *right, int op) : TreeNode(left, right, op) {}
+    TreeBinaryNode(TreeNode *left, TreeNode *right, int op) : TreeNode(TREE_BINARY, left, right, op) {}
+    static bool classof(TreeNode const *n) { return n->kind == TREE_BINARY; }
 
     virtual std::string show() const {
         return
@@ -80,7 +130,8 @@ public:
 
 class TreeUnaryNode : public TreeNode {
 public:
-    TreeUnaryNode(TreeNode *left, int op) : TreeNode(left, 0, op) {}
+    TreeUnaryNode(TreeNode *left, int op) : TreeNode(TREE_UNARY, left, 0, op) {}
+    static bool classof(TreeNode const *n) { return n->kind == TREE_UNARY; }
 
     virtual std::string show() const {
         return
@@ -92,6 +143,49 @@ public:
     }
 };
 
+//
+// Bump-pointer storage for the nodes of a compilation unit. Nodes are not
+// deleted one by one; release() destroys all of them at once.
+//
+class TreeArena {
+public:
+    TreeArena() = default;
+    TreeArena(TreeArena const &) = delete;
+    TreeArena &operator=(TreeArena const &) = delete;
+    ~TreeArena() { release(); }
+
+    template <class T, class... Args>
+    T *make(Args &&...args)
+    {
+        T *node = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        ++objects;
+        if (!std::is_trivially_destructible<T>::value)
+            dtors.push_back({node, [](void *p) { static_cast<T *>(p)->~T(); }});
+        return node;
+    }
+
+    void release();
+
+    size_t bytes_allocated() const { return allocated; }
+    size_t objects_allocated() const { return objects; }
+
+private:
+    void *allocate(size_t size, size_t align);
+
+    std::vector<char *> chunks;
+    char *cur = 0;
+    char *end = 0;
+    size_t allocated = 0;
+    size_t objects = 0;
+    std::vector<std::pair<void *, void (*)(void *)>> dtors;
+};
+
+// arena of the unit being compiled
+TreeArena &ast_arena();
+
+// the id of an identifier in the symbol table of the unit being compiled
+unsigned intern_symbol(std::string_view name);
+
 // Local Variables:
 // mode: c++
 // c-basic-offset: 4
@@ -0,0 +1,155 @@
+// batch.cpp - Compile many EASY sources to object files on a thread pool
+//
+// Every worker thread takes the next source from a shared counter and
+// compiles it in a CompilationSession of its own, so nothing but the
+// counter is shared between the workers: each has its own LLVMContext,
+// IR builder, symbol tables and target machine.
+
+#include "batch.h"
+#include "cache.h"
+#include "emitter.h"
+#include "optimizer.h"
+#include "source.h"
+
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <thread>
+
+using clock_type = std::chrono::steady_clock;
+
+static double elapsed_ms(clock_type::time_point since)
+{
+    return std::chrono::duration<double, std::milli>(clock_type::now() - since).count();
+}
+
+std::string default_object_name(const char *source, const char *suffix)
+{
+    if (!source)
+        return std::string("a") + suffix;
+    std::string name(source);
+    auto slash = name.find_last_of("/\\");
+    if (slash != std::string::npos)
+        name = name.substr(slash + 1);
+    auto dot = name.rfind('.');
+    if (dot != std::string::npos && dot != 0)
+        name = name.substr(0, dot);
+    return name + suffix;
+}
+
+static void compile_one(batch_result_t &result, compile_options_t const &options,
+                        const char *output_dir)
+{
+    auto start = clock_type::now();
+
+    std::string output = default_object_name(result.source.c_str());
+    if (output_dir)
+        output = std::string(output_dir) + "/" + output;
+
+    CompilationSession session;
+    session.options() = options;
+    session.options().emit_mode = EMIT_OBJECT;
+
+    SourceText source;
+    if (auto ec = source.load(result.source.c_str())) {
+        fprintf(stderr, "%s: %s\n", result.source.c_str(), ec.message().c_str());
+        return;
+    }
+
+    std::string key;
+    if (cache_applies(session.options())) {
+        key = cache_key(source.text(), source.name(), session.options());
+        std::string cached = cache_lookup(options.cache_dir, key, EMIT_OBJECT);
+        if (!cached.empty() && !llvm::sys::fs::copy_file(cached, output)) {
+            result.output = output;
+            result.rc = 0;
+            result.cached = true;
+            result.compile_ms = elapsed_ms(start);
+            return;
+        }
+    }
+
+    int rc = session.compile(source);
+    auto M = rc == 0 ? session.take_module() : nullptr;
+    result.compile_ms = elapsed_ms(start);
+    if (!M)
+        return;
+
+    start = clock_type::now();
+    if (emit_object_file(M.get(), output.c_str(), options.opt_level)) {
+        result.output = output;
+        result.rc = 0;
+    }
+    result.emit_ms = elapsed_ms(start);
+
+    if (result.rc == 0 && !key.empty())
+        if (auto object = llvm::MemoryBuffer::getFile(output))
+            cache_store(options.cache_dir, key, EMIT_OBJECT, (*object)->getBuffer());
+}
+
+std::vector<batch_result_t> compile_batch(std::vector<std::string> const &sources,
+                                          compile_options_t const &options, unsigned jobs,
+                                          const char *output_dir)
+{
+    std::vector<batch_result_t> results(sources.size());
+    for (size_t i = 0; i != sources.size(); ++i)
+        results[i].source = sources[i];
+
+    if (output_dir) {
+        std::error_code ec;
+        std::filesystem::create_directories(output_dir, ec);
+    }
+
+    // the target registry is not safe to initialize concurrently
+    init_native_target();
+
+    std::atomic<size_t> next {0};
+    auto worker = [&]() {
+        for (size_t i; (i = next++) < results.size();)
+            compile_one(results[i], options, output_dir);
+    };
+
+    jobs = std::max(1u, std::min<unsigned>(jobs, results.size()));
+    std::vector<std::thread> workers;
+    for (unsigned j = 1; j < jobs; ++j)
+        workers.emplace_back(worker);
+    worker();
+    for (auto &w : workers)
+        w.join();
+
+    return results;
+}
+
+void print_batch_summary(FILE *out, std::vector<batch_result_t> const &results, unsigned jobs,
+                         double wall_ms)
+{
+    double compile_ms = 0, emit_ms = 0;
+    size_t failed = 0, cached = 0;
+
+    fprintf(out, "%10s %10s %10s  %s\n", "compile", "emit", "total", "source");
+    for (auto const &r : results) {
+        fprintf(out, "%8.2fms %8.2fms %8.2fms  %s%s\n", r.compile_ms, r.emit_ms,
+                r.compile_ms + r.emit_ms, r.source.c_str(),
+                r.rc ? " FAILED" : r.cached ? " cached" : "");
+        compile_ms += r.compile_ms;
+        emit_ms += r.emit_ms;
+        failed += r.rc != 0;
+        cached += r.cached;
+    }
+    fprintf(out, "%8.2fms %8.2fms %8.2fms  %zu files, %zu failed, %zu cached, %u jobs, %.2fms wall\n",
+            compile_ms, emit_ms, compile_ms + emit_ms, results.size(), failed, cached, jobs,
+            wall_ms);
+}
+
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// tab-width: 4
+// indent-tabs-mode: nil
+// End:
@@ -0,0 +1,45 @@
+//
+// batch.h
+//
+
+#ifndef __BATCH_H
+#define __BATCH_H
+
+#include "session.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+struct batch_result_t {
+    std::string source;
+    std::string output;  // object file written, empty if compilation failed
+    int rc = -1;         // 0 if the object file was written
+    bool cached = false; // ... copied from the cache, see cache.h
+    double compile_ms = 0; // parse, code generation and -O<n> passes
+    double emit_ms = 0;    // object code generation
+};
+
+//
+// Compile every source to an object file in output_dir (the current
+// directory if 0), on jobs worker threads with a CompilationSession each.
+// Results come back in the order of the sources.
+//
+std::vector<batch_result_t> compile_batch(std::vector<std::string> const &sources,
+                                          compile_options_t const &options, unsigned jobs,
+                                          const char *output_dir);
+
+// per-file timing table and totals
+void print_batch_summary(FILE *out, std::vector<batch_result_t> const &results, unsigned jobs,
+                         double wall_ms);
+
+// foo/bar.mini -> bar.o (or bar<suffix>)
+std::string default_object_name(const char *source, const char *suffix = ".o");
+
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// tab-width: 4
+// indent-tabs-mode: nil
+// End:
+#endif
@@ -0,0 +1,122 @@
+// cache.cpp - Content-addressed cache of IR and object files (compiler -cache-dir)
+//
+// A repeated build of an unchanged source copies the output from the cache
+// and skips parsing, code generation and the optimizer and code generator
+// passes. The key is the SHA-256 of the source bytes and file name, which
+// the modules record as their source_filename, of what identifies the
+// compiler build (size and modification time of the executable, as ccache
+// does, and the LLVM version and target) and of the options that change the
+// output.
+
+#include "cache.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/SHA256.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/TargetParser/Host.h"
+
+#include <system_error>
+
+using namespace llvm;
+
+// bump when the layout of the key or of the entries changes
+static const char cache_format[] = "mini-cache-2";
+
+static std::string compiler_identity()
+{
+    static int anchor;
+    std::string exe = sys::fs::getMainExecutable(0, &anchor);
+
+    std::string identity;
+    raw_string_ostream out(identity);
+    out << cache_format << ' ' << LLVM_VERSION_STRING << ' ' << sys::getDefaultTargetTriple();
+
+    sys::fs::file_status status;
+    if (!exe.empty() && !sys::fs::status(exe, status))
+        out << ' ' << status.getSize() << ' '
+            << status.getLastModificationTime().time_since_epoch().count();
+    return out.str();
+}
+
+bool cache_applies(compile_options_t const &options)
+{
+    // the diagnostics of a compilation are not cached, nor is a module kept in memory
+    bool file = options.emit_mode == EMIT_IR || options.emit_mode == EMIT_OBJECT ||
+                options.emit_mode == EMIT_BITCODE;
+    return !options.cache_dir.empty() && file && !options.verbose && !options.time_report &&
+           !options.stats && !options.inline_report;
+}
+
+std::string cache_key(StringRef source, StringRef name, compile_options_t const &options)
+{
+    static const std::string identity = compiler_identity();
+
+    std::string flags;
+    raw_string_ostream out(flags);
+    out << "O" << options.opt_level << " emit" << options.emit_mode
+        << " check_bounds" << options.check_bounds << " inline" << options.inline_functions;
+
+    SHA256 hash;
+    hash.update(identity);
+    hash.update(StringRef("", 1));
+    hash.update(out.str());
+    hash.update(StringRef("", 1));
+    hash.update(source);
+    hash.update(StringRef("", 1));
+    hash.update(name);
+    return toHex(hash.final(), true);
+}
+
+// dir/ab/cdef...{.ll,.o,.bc}
+static std::string entry_path(std::string const &dir, std::string const &key, emit_mode_t mode)
+{
+    const char *suffix = mode == EMIT_OBJECT ? ".o" : mode == EMIT_BITCODE ? ".bc" : ".ll";
+    SmallString<256> path(dir);
+    sys::path::append(path, key.substr(0, 2), key.substr(2) + suffix);
+    return path.str().str();
+}
+
+std::string cache_lookup(std::string const &dir, std::string const &key, emit_mode_t mode)
+{
+    std::string path = entry_path(dir, key, mode);
+    return sys::fs::exists(path) ? path : "";
+}
+
+bool cache_store(std::string const &dir, std::string const &key, emit_mode_t mode,
+                 StringRef contents)
+{
+    std::string path = entry_path(dir, key, mode);
+    if (sys::fs::create_directories(sys::path::parent_path(path)))
+        return false;
+
+    int fd;
+    SmallString<256> tmp;
+    if (sys::fs::createUniqueFile(path + ".tmp-%%%%%%%%", fd, tmp))
+        return false;
+    {
+        raw_fd_ostream out(fd, true);
+        out << contents;
+        out.close();
+        if (out.has_error()) {
+            out.clear_error();
+            sys::fs::remove(tmp);
+            return false;
+        }
+    }
+    if (sys::fs::rename(tmp, path)) {
+        sys::fs::remove(tmp);
+        return false;
+    }
+    return true;
+}
+
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// tab-width: 4
+// indent-tabs-mode: nil
+// End:
@@ -0,0 +1,42 @@
+//
+// cache.h
+//
+
+#ifndef __CACHE_H
+#define __CACHE_H
+
+#include "session.h"
+
+#include "llvm/ADT/StringRef.h"
+
+#include <string>
+
+//
+// Content-addressed cache of compiler output (compiler -cache-dir): the
+// textual IR, bitcode or object file of a source, keyed by the bytes of the
+// source and its file name, the build of the compiler and the options that
+// change the output.
+// An entry is written to a temporary file and renamed into place, so
+// compilers running at the same time may share a directory.
+//
+
+// whether the output of a compilation with options may come from the cache
+bool cache_applies(compile_options_t const &options);
+
+// name is SourceText::name(), "" for a source that is not a file
+std::string cache_key(llvm::StringRef source, llvm::StringRef name, compile_options_t const &options);
+
+// the file cached for key, or "" if there is none
+std::string cache_lookup(std::string const &dir, std::string const &key, emit_mode_t mode);
+
+// store contents as the output for key
+bool cache_store(std::string const &dir, std::string const &key, emit_mode_t mode,
+                 llvm::StringRef contents);
+
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// tab-width: 4
+// indent-tabs-mode: nil
+// End:
+#endif
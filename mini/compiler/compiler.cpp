@@ -2,24 +2,173 @@
 //
 //
 
-#if __has_include(<unistd.h>)
-#   include <unistd.h>
+#if __has_include(<getopt.h>)
+#   include <getopt.h>
 #else
-static int optind;
+#   include <cstdio>
+#   include <cstring>
 
-static int 
-getopt(int argc, char **argv, const char *options)
+//
+// The part of getopt_long_only() main() uses, for systems without it. A
+// long option is given with one or two dashes and its whole name, an
+// argument after '=' or, if it is required, as the next word. Any other
+// word with a dash is one short option of options, an argument attached
+// or the next word. Options end at the first other word or at "--".
+//
+static int optind = 1;
+static char *optarg;
+
+struct option {
+    const char *name;
+    int has_arg;
+    int *flag;
+    int val;
+};
+#define no_argument 0
+#define required_argument 1
+#define optional_argument 2
+
+static int
+getopt_long_only(int argc, char **argv, const char *options, const struct option *longopts, int *idx)
 {
-    optind = 1;
-    return -1;
+    optarg = 0;
+    if (optind >= argc || argv[optind][0] != '-' || !argv[optind][1])
+        return -1;
+    char *word = argv[optind++];
+    if (!strcmp(word, "--"))
+        return -1;
+
+    char *name = word + (word[1] == '-' ? 2 : 1);
+    bool one_letter = name == word + 1 && !name[1] && strchr(options, name[0]);
+    for (int i = 0; longopts[i].name && !one_letter; ++i) {
+        size_t n = strlen(longopts[i].name);
+        if (strncmp(name, longopts[i].name, n) || (name[n] && name[n] != '='))
+            continue;
+        if (idx)
+            *idx = i;
+        if (name[n] == '=') {
+            if (longopts[i].has_arg == no_argument) {
+                fprintf(stderr, "%s: option %s takes no argument\n", argv[0], word);
+                return '?';
+            }
+            optarg = name + n + 1;
+        } else if (longopts[i].has_arg == required_argument) {
+            if (optind == argc) {
+                fprintf(stderr, "%s: option %s requires an argument\n", argv[0], word);
+                return '?';
+            }
+            optarg = argv[optind++];
+        }
+        if (longopts[i].flag) {
+            *longopts[i].flag = longopts[i].val;
+            return 0;
+        }
+        return longopts[i].val;
+    }
+
+    const char *spec = name == word + 1 && name[0] != ':' ? strchr(options, name[0]) : 0;
+    if (!spec) {
+        fprintf(stderr, "%s: unknown option %s\n", argv[0], word);
+        return '?';
+    }
+    if (spec[1] != ':') {
+        if (name[1]) {
+            fprintf(stderr, "%s: unknown option %s\n", argv[0], word);
+            return '?';
+        }
+    } else if (name[1]) {
+        optarg = name + 1;
+    } else if (optind < argc) {
+        optarg = argv[optind++];
+    } else {
+        fprintf(stderr, "%s: option %s requires an argument\n", argv[0], word);
+        return '?';
+    }
+    return name[0];
 }
 #endif
 
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
 #include "parser.h"
-#include "parser_bits.h"
+#include "session.h"
+#include "batch.h"
+#include "cache.h"
+#include "jit.h"
+#include "emitter.h"
+#include "source.h"
+
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+//
+// compiler --batch: compile the files named on the command line, or one per
+// line on stdin if there are none, to object files in the directory given
+// with -o (default: the current one).
+//
+static int run_batch(int argc, char **argv, compile_options_t const &options, unsigned jobs,
+                     const char *output_dir)
+{
+    std::vector<std::string> sources(argv, argv + argc);
+    if (sources.empty()) {
+        char line[4096];
+        while (fgets(line, sizeof line, stdin)) {
+            std::string name(line);
+            while (!name.empty() && isspace((unsigned char)name.back()))
+                name.pop_back();
+            if (!name.empty())
+                sources.push_back(name);
+        }
+    }
+
+    if (jobs == 0)
+        jobs = std::max(1u, std::thread::hardware_concurrency());
+
+    auto start = std::chrono::steady_clock::now();
+    auto results = compile_batch(sources, options, jobs, output_dir);
+    double wall_ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+
+    print_batch_summary(stderr, results, jobs, wall_ms);
+
+    for (auto const &r : results)
+        if (r.rc)
+            return 1;
+    return 0;
+}
+
+//
+// A cache hit: the object file is copied to object_file, the IR to stdout.
+//
+static int copy_cached(std::string const &cached, std::string const &object_file)
+{
+    if (!object_file.empty()) {
+        if (std::error_code ec = llvm::sys::fs::copy_file(cached, object_file)) {
+            fprintf(stderr, "compiler: %s: %s\n", object_file.c_str(), ec.message().c_str());
+            return 1;
+        }
+        return 0;
+    }
 
-extern int yyparse();
-extern int yylineno;
+    auto text = llvm::MemoryBuffer::getFile(cached);
+    if (!text) {
+        fprintf(stderr, "compiler: %s: %s\n", cached.c_str(), text.getError().message().c_str());
+        return 1;
+    }
+    llvm::outs() << (*text)->getBuffer();
+    return 0;
+}
 
 int main(int argc, char **argv)
 {
@@ -27,8 +176,29 @@ int main(int argc, char **argv)
     extern int yydebug;
 #endif
 
+    static const struct option long_options[] = {
+        {"run", no_argument, 0, 'r'},
+        {"batch", no_argument, 0, 'b'},
+        {"time", optional_argument, 0, 't'},
+        {"stats", optional_argument, 0, 's'},
+        {"fcheck-bounds", no_argument, 0, 'B'},
+        {"finline", no_argument, 0, 'I'},
+        {"finline-report", no_argument, 0, 'R'},
+        {"cache-dir", required_argument, 0, 'C'},
+        {"emit-bc", no_argument, 0, 'E'},
+        {0, 0, 0, 0},
+    };
+
+    CompilationSession session;
+    compile_options_t &options = session.options();
+    const char *output_file = 0;
+    bool batch = false;
+    unsigned jobs = 0;
+    bool json = false;
+
     int opt;
-    while ((opt = getopt(argc, argv, "dv")) != -1) {
+    // long options take one dash as well: -time[=json], -stats[=json]
+    while ((opt = getopt_long_only(argc, argv, "dvO:rco:j:", long_options, 0)) != -1) {
         switch (opt) {
         case 'd':
 #ifdef YYDEBUG
@@ -36,20 +206,143 @@ int main(int argc, char **argv)
 #endif
             break;
         case 'v':
-            flag_verbose = true;
+            options.verbose = true;
+            break;
+        case 'O':
+            options.opt_level = atoi(optarg);
+            if (options.opt_level < 0 || options.opt_level > 3) {
+                fprintf(stderr, "compiler: invalid optimization level -O%s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'r':
+            options.emit_mode = EMIT_JIT;
+            break;
+        case 'c':
+            options.emit_mode = EMIT_OBJECT;
+            break;
+        case 'E':
+            options.emit_mode = EMIT_BITCODE;
+            break;
+        case 'o':
+            output_file = optarg;
             break;
+        case 'b':
+            batch = true;
+            break;
+        case 'j':
+            jobs = atoi(optarg);
+            break;
+        case 'B':
+            options.check_bounds = true;
+            break;
+        case 'I':
+            options.inline_functions = true;
+            break;
+        case 'R':
+            options.inline_report = true;
+            break;
+        case 'C':
+            options.cache_dir = optarg;
+            break;
+        case 't':
+        case 's':
+            if (optarg && strcmp(optarg, "json") && strcmp(optarg, "text")) {
+                fprintf(stderr, "compiler: report format is text or json, not %s\n", optarg);
+                return 1;
+            }
+            (opt == 't' ? options.time_report : options.stats) = true;
+            json = json || (optarg && !strcmp(optarg, "json"));
+            break;
+        default:
+            fprintf(stderr,
+                    "usage: compiler [-d] [-v] [-O<0-3>] [-fcheck-bounds] [-finline] [-finline-report]\n"
+                    "                [--run | -c | -emit-bc] [-o output] [-cache-dir dir]\n"
+                    "                [-time[=json]] [-stats[=json]] [file.mini]\n"
+                    "       compiler --batch [-j jobs] [-O<0-3>] [-o directory] [file.mini...]\n");
+            return 1;
         }
     }
 
     argc -= optind;
     argv += optind;
 
-    if (argc == 1)
-        (void)freopen(argv[0], "r", stdin);
+    if (options.cache_dir.empty())
+        if (const char *dir = getenv("MINI_CACHE_DIR"))
+            options.cache_dir = dir;
+
+    if (batch) {
+        if (options.emit_mode == EMIT_JIT) {
+            fprintf(stderr, "compiler: --batch writes object files, --run does not apply\n");
+            return 1;
+        }
+        return run_batch(argc, argv, options, jobs, output_file);
+    }
+
+    // a named file is mapped and scanned in place, stdin is read
+    SourceText source;
+    if (auto ec = argc == 1 ? source.load(argv[0]) : source.read(stdin)) {
+        fprintf(stderr, "%s: %s\n", argc == 1 ? argv[0] : "stdin", ec.message().c_str());
+        return 1;
+    }
+
+    // textual IR goes to stdout, redirect it
+    if (options.emit_mode == EMIT_IR && output_file && !freopen(output_file, "w", stdout)) {
+        perror(output_file);
+        return 1;
+    }
+
+    bool binary = options.emit_mode == EMIT_OBJECT || options.emit_mode == EMIT_BITCODE;
+    std::string object_file =
+        output_file ? output_file
+                    : default_object_name(argc == 1 ? argv[0] : 0,
+                                          options.emit_mode == EMIT_BITCODE ? ".bc" : ".o");
+
+    std::string key;
+    if (cache_applies(options)) {
+        key = cache_key(source.text(), source.name(), options);
+        std::string cached = cache_lookup(options.cache_dir, key, options.emit_mode);
+        if (!cached.empty())
+            return copy_cached(cached, binary ? object_file : "");
+    }
+
+    int rc = session.compile(source);
+
+    if (rc == 0 && binary) {
+        auto M = session.take_module();
+        if (!M)
+            return 1;
+        phase_timer timer(options.time_report ? &session.stats().phases[PHASE_EMIT] : 0);
+        bool written = options.emit_mode == EMIT_BITCODE
+                           ? emit_bitcode_file(M.get(), object_file.c_str())
+                           : emit_object_file(M.get(), object_file.c_str(), options.opt_level);
+        rc = written ? 0 : 1;
+        if (rc == 0 && !key.empty())
+            if (auto object = llvm::MemoryBuffer::getFile(object_file))
+                cache_store(options.cache_dir, key, options.emit_mode, (*object)->getBuffer());
+    }
 
-    init_compiler();
+    if (rc == 0 && options.emit_mode == EMIT_IR && !key.empty()) {
+        // the IR printed is that of every program of the source, cache one only
+        auto M = session.take_module();
+        if (M && !session.take_module()) {
+            std::string text;
+            llvm::raw_string_ostream out(text);
+            M->print(out, nullptr);
+            cache_store(options.cache_dir, key, EMIT_IR, out.str());
+        }
+    }
 
-    int rc = yyparse();
+    // before --run, the report is about the compiler and not the program
+    if (options.time_report || options.stats)
+        print_stats(stderr, session.stats(), options.time_report, options.stats, json);
+
+    if (rc == 0 && options.emit_mode == EMIT_JIT) {
+        auto M = session.take_module();
+        if (!M)
+            return 1;
+        rc = run_module(std::move(M), session.take_context());
+    }
 
     return rc;
 }
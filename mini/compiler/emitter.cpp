@@ -0,0 +1,88 @@
+// emitter.cpp - Object file and bitcode emission straight from the in-memory module
+//
+// Replaces the "print .ll, re-parse with llc, assemble .s" round trip of the
+// mini driver (compiler -c -o foo.o).
+
+#include "emitter.h"
+#include "optimizer.h"
+
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CodeGen.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+
+#include <system_error>
+
+using namespace llvm;
+
+static CodeGenOptLevel to_codegen_level(int level)
+{
+    switch (level) {
+    case 0:
+        return CodeGenOptLevel::None;
+    case 1:
+        return CodeGenOptLevel::Less;
+    case 2:
+        return CodeGenOptLevel::Default;
+    default:
+        return CodeGenOptLevel::Aggressive;
+    }
+}
+
+//
+// Write the module as a native object file. The level has the meaning of
+// llc -O=<n>. Returns false (and reports) on failure.
+//
+bool emit_object_file(Module *M, const char *filename, int level)
+{
+    TargetMachine *TM = get_target_machine();
+    if (!TM) {
+        errs() << "emit_object_file: no target machine\n";
+        return false;
+    }
+    TM->setOptLevel(to_codegen_level(level));
+    set_module_target(M);
+
+    std::error_code EC;
+    raw_fd_ostream dest(filename, EC, sys::fs::OF_None);
+    if (EC) {
+        errs() << "Could not open file: " << filename << ": " << EC.message() << "\n";
+        return false;
+    }
+
+    legacy::PassManager pass;
+    if (TM->addPassesToEmitFile(pass, dest, nullptr, CodeGenFileType::ObjectFile)) {
+        errs() << "TheTargetMachine can't emit a file of this type\n";
+        return false;
+    }
+
+    pass.run(*M);
+    dest.flush();
+    return !dest.has_error();
+}
+
+bool emit_bitcode_file(Module *M, const char *filename)
+{
+    set_module_target(M);
+
+    std::error_code EC;
+    raw_fd_ostream dest(filename, EC, sys::fs::OF_None);
+    if (EC) {
+        errs() << "Could not open file: " << filename << ": " << EC.message() << "\n";
+        return false;
+    }
+
+    WriteBitcodeToFile(*M, dest);
+    dest.flush();
+    return !dest.has_error();
+}
+
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// tab-width: 4
+// indent-tabs-mode: nil
+// End:
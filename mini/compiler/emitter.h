@@ -0,0 +1,23 @@
+//
+// emitter.h
+//
+
+#ifndef __EMITTER_H
+#define __EMITTER_H
+
+namespace llvm {
+    class Module;
+}
+
+bool emit_object_file(llvm::Module *M, const char *filename, int level);
+
+// the module as LLVM bitcode, for llc, clang or a JIT of the caller's
+bool emit_bitcode_file(llvm::Module *M, const char *filename);
+
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// tab-width: 4
+// indent-tabs-mode: nil
+// End:
+#endif
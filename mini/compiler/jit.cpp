@@ -0,0 +1,119 @@
+// jit.cpp - In-process execution of a compiled EASY program (compiler --run)
+//
+// The module built by program_header()/program_end() goes straight to an
+// ORC LLJIT instance; the rtl_* entry points resolve to the run-time library
+// linked into the compiler itself.
+
+#include "jit.h"
+#include "optimizer.h"
+#include "session.h"
+#include "mini_system.h"
+
+#include "llvm/ExecutionEngine/Orc/Core.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+using namespace llvm::orc;
+
+struct rtl_entry_t {
+    const char *name;
+    void *address;
+};
+
+static const rtl_entry_t rtl_entries[] = {
+    {"rtl_output", (void *)&rtl_output},
+    {"rtl_output_real", (void *)&rtl_output_real},
+    {"rtl_output_str", (void *)&rtl_output_str},
+    {"rtl_output_bool", (void *)&rtl_output_bool},
+    {"rtl_output_nl", (void *)&rtl_output_nl},
+    {"rtl_output_list", (void *)&rtl_output_list},
+    {"rtl_output_flush", (void *)&rtl_output_flush},
+    {"rtl_fix", (void *)&rtl_fix},
+    {"rtl_allocate_array", (void *)&rtl_allocate_array},
+    {"rtl_arena_mark", (void *)&rtl_arena_mark},
+    {"rtl_arena_release", (void *)&rtl_arena_release},
+    {"rtl_arena_release_keep", (void *)&rtl_arena_release_keep},
+    {"rtl_arena_keep_value", (void *)&rtl_arena_keep_value},
+    {"rtl_bounds_error", (void *)&rtl_bounds_error},
+    {"rtl_string_concat", (void *)&rtl_string_concat},
+    {"rtl_string_substr", (void *)&rtl_string_substr},
+    {"rtl_string_character", (void *)&rtl_string_character},
+    {"rtl_string_keep", (void *)&rtl_string_keep},
+    {"rtl_input_list", (void *)&rtl_input_list},
+};
+
+Error define_rtl_symbols(LLJIT &J)
+{
+    SymbolMap symbols;
+    for (auto &e : rtl_entries)
+        symbols[J.mangleAndIntern(e.name)] = {ExecutorAddr::fromPtr(e.address),
+                                              JITSymbolFlags::Exported};
+    return J.getMainJITDylib().define(absoluteSymbols(std::move(symbols)));
+}
+
+static int report(Error Err)
+{
+    errs() << "run_module: " << toString(std::move(Err)) << "\n";
+    return 1;
+}
+
+//
+// Compile the module in memory and call its main(). Returns the exit code of
+// the program, or 1 if the JIT could not be set up.
+//
+int run_module(std::unique_ptr<Module> M, std::unique_ptr<LLVMContext> C)
+{
+    return run_module(ThreadSafeModule(std::move(M), ThreadSafeContext(std::move(C))));
+}
+
+int run_module(ThreadSafeModule TSM)
+{
+    init_native_target();
+
+    auto J = LLJITBuilder().create();
+    if (!J)
+        return report(J.takeError());
+
+    auto &JD = (*J)->getMainJITDylib();
+    // anything else (libc, libm) comes from the compiler process itself
+    auto G = DynamicLibrarySearchGenerator::GetForCurrentProcess(
+        (*J)->getDataLayout().getGlobalPrefix());
+    if (!G)
+        return report(G.takeError());
+    JD.addGenerator(std::move(*G));
+
+    if (auto Err = define_rtl_symbols(**J))
+        return report(std::move(Err));
+
+    TSM.withModuleDo([&](Module &M) { M.setDataLayout((*J)->getDataLayout()); });
+    if (auto Err = (*J)->addIRModule(std::move(TSM)))
+        return report(std::move(Err));
+
+    auto Main = (*J)->lookup("main");
+    if (!Main)
+        return report(Main.takeError());
+
+    auto main_fn = Main->toPtr<int (*)()>();
+    return main_fn();
+}
+
+ThreadSafeModule take_thread_safe_module(CompilationSession &session)
+{
+    auto M = session.take_module();
+    auto C = session.take_context();
+    if (!M || !C)
+        return ThreadSafeModule();
+    return ThreadSafeModule(std::move(M), ThreadSafeContext(std::move(C)));
+}
+
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// tab-width: 4
+// indent-tabs-mode: nil
+// End:
@@ -0,0 +1,41 @@
+//
+// jit.h
+//
+
+#ifndef __JIT_H
+#define __JIT_H
+
+#include <memory>
+
+class CompilationSession;
+
+namespace llvm {
+    class Error;
+    class Module;
+    class LLVMContext;
+    namespace orc {
+        class LLJIT;
+        class ThreadSafeModule;
+    }
+}
+
+// the rtl_* entry points of the linked-in run-time library, for a program run by J
+llvm::Error define_rtl_symbols(llvm::orc::LLJIT &J);
+
+int run_module(std::unique_ptr<llvm::Module> M, std::unique_ptr<llvm::LLVMContext> C);
+int run_module(llvm::orc::ThreadSafeModule TSM);
+
+//
+// The last program compiled by the session (with emit mode EMIT_MODULE or
+// EMIT_JIT) together with its context, for a JIT of the caller's. Empty if
+// there is none; the session cannot be used after that.
+//
+llvm::orc::ThreadSafeModule take_thread_safe_module(CompilationSession &session);
+
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// tab-width: 4
+// indent-tabs-mode: nil
+// End:
+#endif
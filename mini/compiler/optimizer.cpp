@@ -0,0 +1,191 @@
+// optimizer.cpp - Target setup and the new pass manager pipeline for -O<n>
+//
+
+#include "optimizer.h"
+
+#include "llvm/Analysis/InlineCost.h"
+#include "llvm/IR/DiagnosticHandler.h"
+#include "llvm/IR/DiagnosticInfo.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Transforms/IPO/ArgumentPromotion.h"
+#include "llvm/Transforms/IPO/GlobalDCE.h"
+#include "llvm/Transforms/IPO/Inliner.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Target/TargetOptions.h"
+#include "llvm/TargetParser/Host.h"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+
+using namespace llvm;
+
+void init_native_target()
+{
+    // function-local static: initialized exactly once even if several
+    // compiler threads get here at the same time
+    static bool once = (InitializeNativeTarget(), InitializeNativeTargetAsmPrinter(), true);
+    (void)once;
+}
+
+//
+// Host target machine, created on first use. Each thread has its own, since
+// the code generator changes its optimization level. Returns 0 if the native
+// target is not available; the passes still run, with generic cost models.
+//
+TargetMachine *get_target_machine()
+{
+    static thread_local std::unique_ptr<TargetMachine> TM;
+    static thread_local bool once = false;
+
+    if (!once) {
+        once = true;
+
+        init_native_target();
+
+        auto TargetTriple = sys::getDefaultTargetTriple();
+        std::string Error;
+        auto Target = TargetRegistry::lookupTarget(TargetTriple, Error);
+        if (!Target) {
+            errs() << "get_target_machine: " << Error << "\n";
+            return 0;
+        }
+
+        TargetOptions opt;
+        TM.reset(Target->createTargetMachine(TargetTriple, "generic", "", opt, Reloc::Static));
+    }
+    return TM.get();
+}
+
+void set_module_target(Module *M)
+{
+    if (auto TM = get_target_machine()) {
+        M->setTargetTriple(TM->getTargetTriple().str());
+        M->setDataLayout(TM->createDataLayout());
+    }
+}
+
+static OptimizationLevel to_optimization_level(int level)
+{
+    switch (level) {
+    case 1:
+        return OptimizationLevel::O1;
+    case 2:
+        return OptimizationLevel::O2;
+    default:
+        return OptimizationLevel::O3;
+    }
+}
+
+//
+// Inline threshold for EASY functions called in a loop, which the code
+// generator marks inlinehint, at -O0 with -finline (the LLVM default is 325,
+// which the default pipeline uses). Such calls are mostly small accessors of
+// arrays passed by reference; inlined, the loop around them can be vectorized.
+//
+static const int inline_hint_threshold = 600;
+
+//
+// Counts the inliner's remarks, and prints them if asked to.
+//
+class inline_remarks : public DiagnosticHandler {
+public:
+    explicit inline_remarks(ipo_options_t const &ipo) : ipo(ipo) {}
+
+    bool isPassedOptRemarkEnabled(StringRef pass) const override { return pass == "inline"; }
+    bool isMissedOptRemarkEnabled(StringRef pass) const override { return false; }
+    bool isAnalysisRemarkEnabled(StringRef pass) const override { return false; }
+    bool isAnyRemarkEnabled() const override { return true; }
+
+    bool handleDiagnostics(DiagnosticInfo const &DI) override
+    {
+        auto remark = dyn_cast<DiagnosticInfoOptimizationBase>(&DI);
+        if (!remark || !remark->isPassed() || remark->getPassName() != "inline")
+            return false;
+        if (ipo.inlined)
+            ++*ipo.inlined;
+        if (ipo.report)
+            *ipo.report << "inline: " << remark->getMsg() << "\n";
+        return true;
+    }
+
+private:
+    ipo_options_t const &ipo;
+};
+
+//
+// The interprocedural stage at -O0: the inliner, with the hint threshold
+// raised, then deletion of the functions no longer called and promotion of
+// readonly reference parameters to values. The EASY functions are private
+// already, there is nothing to internalize.
+//
+static ModulePassManager build_ipo_pipeline()
+{
+    InlineParams params = getInlineParams(0, 0);
+    params.HintThreshold = std::max(params.HintThreshold.value_or(0), inline_hint_threshold);
+
+    ModulePassManager MPM;
+    MPM.addPass(ModuleInlinerWrapperPass(params));
+    MPM.addPass(GlobalDCEPass());
+    MPM.addPass(createModuleToPostOrderCGSCCPassAdaptor(ArgumentPromotionPass()));
+    return MPM;
+}
+
+//
+// Run the standard per-module pipeline (mem2reg/SROA, the inliner,
+// InstCombine, GVN, LICM, loop unrolling, loop and SLP vectorizers, ...) on
+// the module. Its inliner is the interprocedural stage at -O1..3: it inlines
+// with the thresholds of the level, the functions no longer called are
+// deleted, and ArgumentPromotion is added after it where the level does not
+// run it. Level 0 leaves the module untouched unless ipo.inline_functions,
+// which runs build_ipo_pipeline(); so does a module that does not verify.
+//
+void optimize_module(Module *M, int level, ipo_options_t const &ipo)
+{
+    if (level <= 0 && !ipo.inline_functions)
+        return;
+
+    if (verifyModule(*M, &errs())) {
+        errs() << "optimize_module: module is broken, optimization skipped\n";
+        return;
+    }
+
+    LoopAnalysisManager LAM;
+    FunctionAnalysisManager FAM;
+    CGSCCAnalysisManager CGAM;
+    ModuleAnalysisManager MAM;
+
+    PassBuilder PB(get_target_machine());
+    PB.registerCGSCCOptimizerLateEPCallback([](CGSCCPassManager &CGPM, OptimizationLevel level) {
+        if (level != OptimizationLevel::O3) // runs it already
+            CGPM.addPass(ArgumentPromotionPass());
+    });
+    PB.registerModuleAnalyses(MAM);
+    PB.registerCGSCCAnalyses(CGAM);
+    PB.registerFunctionAnalyses(FAM);
+    PB.registerLoopAnalyses(LAM);
+    PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+    LLVMContext &context = M->getContext();
+    auto handler = context.getDiagnosticHandler();
+    context.setDiagnosticHandler(std::make_unique<inline_remarks>(ipo));
+
+    ModulePassManager MPM = level > 0 ? PB.buildPerModuleDefaultPipeline(to_optimization_level(level))
+                                      : build_ipo_pipeline();
+    MPM.run(*M, MAM);
+
+    context.setDiagnosticHandler(std::move(handler));
+}
+
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// tab-width: 4
+// indent-tabs-mode: nil
+// End:
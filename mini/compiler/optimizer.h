@@ -0,0 +1,34 @@
+//
+// optimizer.h
+//
+
+#ifndef __OPTIMIZER_H
+#define __OPTIMIZER_H
+
+#include <cstdint>
+
+namespace llvm {
+    class Module;
+    class TargetMachine;
+    class raw_ostream;
+}
+
+// the interprocedural stage of optimize_module()
+struct ipo_options_t {
+    bool inline_functions = false; // run it at -O0 as well
+    llvm::raw_ostream *report = 0; // one line per call inlined
+    uint64_t *inlined = 0;         // incremented per call inlined
+};
+
+void init_native_target();
+llvm::TargetMachine *get_target_machine();
+void set_module_target(llvm::Module *M);
+void optimize_module(llvm::Module *M, int level, ipo_options_t const &ipo = ipo_options_t());
+
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// tab-width: 4
+// indent-tabs-mode: nil
+// End:
+#endif
@@ -8,14 +8,21 @@
 %code requires {
 // That goes to parser.h
 
+#include <cstdio>
 #include <string>
 #include <iostream>
 
 #include "TreeNode.h"
 #include "parser_bits.h"
 
-void yyerror(const char *s);
-int yylex();
+// reentrant scanner (lexer.l)
+typedef void *yyscan_t;
+int yylex_init(yyscan_t *scanner);
+int yylex_destroy(yyscan_t scanner);
+struct yy_buffer_state *yy_scan_buffer(char *base, size_t size, yyscan_t scanner);
+int yyget_lineno(yyscan_t scanner);
+
+void yyerror(yyscan_t scanner, const char *s);
 
 TreeNode *make_ident(TreeNode *p1);
 
@@ -23,6 +30,14 @@ std::string token_to_string(int token);
 
 }
 
+%code provides {
+int yylex(YYSTYPE *yylval, yyscan_t scanner);
+int scan_token(YYSTYPE *yylval, yyscan_t scanner); // the flex scanner
+}
+
+%define api.pure full
+%param {yyscan_t scanner}
+
 
 %union {
   int num;
@@ -159,9 +174,10 @@ program_body    : segment_body
 program_end     : ENDSYM PROGRAMSYM IDENT SEMICOLON { program_end($3); }
 
 /* segments */
-segment_body    : type_declarations
+segment_body    : { segment_begin(); }
+                type_declarations
                 variable_declarations
-                proc_declarations executable_statements
+                proc_declarations executable_statements { segment_end(); }
 
 type_declarations : {} 
                   | type_declarations type_declaration
@@ -319,22 +335,22 @@ cond_statement_body     : segment_body
 select_statement        : simple_select_statement
                         | label { set_label($1); } simple_select_statement { clear_label(); }
 simple_select_statement : select_header select_body select_footer
-select_header           : SELECT expr OF { $$ = $2; }
+select_header           : SELECT expr OF { $$ = $2; select_header($2); }
 select_body             : case_list
                         | case_list other_cases
-select_footer           : ENDSYM SELECT SEMICOLON {}
-                        | ENDSYM SELECT IDENT SEMICOLON { $$ = make_ident($3); }
+select_footer           : ENDSYM SELECT SEMICOLON { select_footer(); }
+                        | ENDSYM SELECT IDENT SEMICOLON { $$ = make_ident($3); select_footer(); }
 case_list               : case
                         | case case_list
-case                    : case_head case_body
+case                    : case_head { select_case($1); } case_body { select_case_end(); }
                          
 case_head               : CASE selector COLON { $$ = $2; }
 selector                : selector_head
-                        | selector_head selector
+                        | selector_head selector { $$ = make_binary($1, $2, COMMA); }
 
 selector_head           : expr { $$ = $1; }
 
-other_cases             : other_header case_body
+other_cases             : other_header { select_otherwise(); } case_body { select_case_end(); }
 
 other_header            : OTHERWISE COLON {}
 
@@ -380,9 +396,9 @@ step                    : BY expr { $$ = $2; }
 limit                   : TO expr { $$ = $2; }
 cond_control            : WHILE expr { $$ = $2; }
 
-input_statement         : INPUT input_list {}
+input_statement         : INPUT input_list { $$ = make_input($2); }
 input_list              : variable { $$ = $1; }
-                        | variable COMMA input_list { $$ = $1; }
+                        | variable COMMA input_list { $$ = make_binary($1, $3, COMMA); }
 
 output_statement        : OUTPUT output_list { $$ = make_output($2, true); }
 
@@ -422,7 +438,7 @@ expr6   : expr7  {$$ =  $1;}
 expr7   : expr8 {$$ =  $1;}
         | FLOOR LPAREN expr RPAREN { $$ = make_unary($3, FLOOR); }
         | LENGTH LPAREN expr RPAREN { $$ = make_unary($3, LENGTH); }
-        | SUBSTR LPAREN expr COMMA expr COMMA expr RPAREN { $$ = make_binary($3, $5, $1); }
+        | SUBSTR LPAREN expr COMMA expr COMMA expr RPAREN { $$ = make_binary($3, make_binary($5, $7, COMMA), SUBSTR); }
         | CHARACTER LPAREN expr RPAREN { $$ = make_unary($3, CHARACTER); }
         | NUMBERSYM LPAREN expr RPAREN { $$ = make_unary($3, NUMBERSYM); }
         | FIX LPAREN expr RPAREN { $$ = make_unary($3, FIX); }
@@ -467,12 +483,8 @@ variable    : IDENT { $$ = make_ident($1); }
 /* -------------- body section -------------- */
 // feel free to add your own C/C++ code here
 
-// extern 
-extern int yylineno;
-extern int err_cnt;
-void yyerror(const char *s) {
-    ++err_cnt;
-    fprintf(stderr, " line %d: %s\n", yylineno + 1, s);
+void yyerror(yyscan_t scanner, const char *s) {
+    syntax_error(" line " + std::to_string(yyget_lineno(scanner) + 1) + ": " + s);
 }
 
 TreeNode *make_ident(TreeNode *p1)
@@ -4,11 +4,18 @@
 
 #include "parser.h"
 #include "parser_bits.h"
+#include "session.h"
+#include "source.h"
 #include "TreeNode.h"
 
 #include "llvm/ADT/APFloat.h"
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Analysis/InstructionSimplify.h"
+#include "llvm/Analysis/ValueTracking.h"
 #include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/CFG.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/Function.h"
@@ -16,32 +23,44 @@
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
+#include "llvm/IR/Operator.h"
 #include "llvm/IR/Verifier.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
 
 #include <algorithm>
 #include <cstdlib>
 #include <stack>
 #include <deque>
+#include <map>
 #include <memory>
 #include <string>
 #include <vector>
 #include <unordered_map>
-#include <typeinfo>
 
 #include "llvm_helper.h"
-#include "symbol_type_table.h"
+#include "mini_system.h"
+#include "optimizer.h"
+#include "sema.h"
+#include "symbol_table.h"
+#include "symbol_type.h"
 
 using namespace llvm;
 
 typedef SmallVector<BasicBlock *, 16> BBList;
 typedef SmallVector<Value *, 16> ValList;
 
-LLVMContext TheContext;
+// state of the current session, see CompilationSession::Scope
+struct session_state_t;
+static thread_local session_state_t *current_state = 0;
+
+static session_state_t &S();
+static LLVMContext &TheContext();
+static IRBuilder<> &Builder();
 
 class IfStatement {
     BasicBlock *createBB(Function *f, std::string const &name)
     {
-        return BasicBlock::Create(TheContext, name, f);
+        return BasicBlock::Create(TheContext(), name, f);
     }
 
 public:
@@ -56,12 +75,51 @@ public:
         , MergeBB(createBB(f, "ifcont")) {}
 };
 
+//
+// Descriptor fields of a declared array as SSA values, so that element
+// access does not reload them from the descriptor on every use. The
+// descriptor is written only by initialize_array_type(); a store of a whole
+// array drops the entry and access falls back to loading the fields. A loop
+// whose body stores the array whole, or passes it by reference, has to
+// reload them on every iteration, see loop_descriptor().
+//
+struct array_descriptor_t {
+    std::vector<Value *> low;    // low bound, per dimension
+    std::vector<Value *> up;     // one past the high bound, per dimension
+    std::vector<Value *> stride; // stride, per dimension
+    Value *data = 0;             // address of the first element
+    size_t loops = 0;            // open loops where the array was declared
+};
+
 class LoopStatement {
 public:
     TreeNode *Target;
     TreeNode *By;
     TreeNode *To;
 
+    BasicBlock *HeaderBB = 0; // exit tests
+    BasicBlock *LatchBB = 0;  // index += by, the only back edge
+    BasicBlock *ExitBB = 0;
+    BasicBlock *EntryBB = 0;  // where each iteration begins
+    Value *by = 0;            // step, as evaluated before the loop
+    PHINode *to_phi = 0;      // limit in the header, unless a constant
+
+    // what the body did so far, see loop_invariant()
+    SmallPtrSet<Value *, 8> assigned; // variables stored to
+    bool calls = false;               // a function was called
+
+    // value range of an integer loop variable, see counted_loop_of()
+    Value *iv = 0;            // alloca of the loop variable
+    Value *from = 0;          // initial value
+    Value *to = 0;            // limit, as compared in the header
+    int64_t step = 0;         // constant positive step, or 0
+    // the branches around bounds checks that the range implies, taken
+    // unless the body assigns the variable, see loop_footer()
+    std::vector<BranchInst *> range_guards;
+    // the cached descriptors the body used, as before the loop and as
+    // reloaded in EntryBB; see loop_descriptor()
+    std::unordered_map<Value *, std::pair<array_descriptor_t, array_descriptor_t>> descriptors;
+
     LoopStatement() : Target(0), By(0), To(0) {};
     LoopStatement(TreeNode *target, TreeNode *by, TreeNode *to)
         : Target(target)
@@ -71,17 +129,28 @@ public:
     }
 };
 
+class SelectStatement {
+public:
+    Value *value = 0;             // of the select expression
+    value_type_t type = VALUE_NONE; // of the select expression
+    BasicBlock *DispatchBB = 0;   // ends with the switch, see select_footer()
+    BasicBlock *OtherwiseBB = 0;
+    BasicBlock *EndBB = 0;
+    std::vector<std::pair<TreeNode *, BasicBlock *>> cases; // selector, body
+};
+
 class LabelStatement {
     BasicBlock *createBB(Function *f, std::string const &name)
     {
-        return BasicBlock::Create(TheContext, name, f);
+        return BasicBlock::Create(TheContext(), name, f);
     }
 
     Function *f;
 public:
     BasicBlock *RepeatBB;
     BasicBlock *RepentBB;
-    std::string label; 
+    symbol_id_t label;
+    size_t segments = 0; // open segments of its function, not left by repeat/repent
     
     LabelStatement()
         : f{}
@@ -90,7 +159,7 @@ public:
         , label{}
     {}
 
-    LabelStatement(Function *f, std::string const &l)
+    LabelStatement(Function *f, symbol_id_t l)
         : f(f)
         , RepeatBB {createBB(f, "bb")}
         , RepentBB {}
@@ -100,7 +169,7 @@ public:
 
     // Label does not have branches. The branches will be set from the
     // labeled block (e.g. for-loop) later
-    LabelStatement(std::string const &l) 
+    LabelStatement(symbol_id_t l) 
         : f {}
         , RepeatBB {}
         , RepentBB {}
@@ -121,11 +190,47 @@ public:
 };
 
 
+//
+// An open segment (program, function, compound, branch or loop body). mark
+// is the run-time arena mark of a nested segment, 0 while it needs none. It
+// is taken where the segment begins, so that it dominates all of it.
+//
+struct segment_t {
+    Value *mark = 0;
+    BasicBlock *BeginBB = 0;
+    Instruction *begin = 0; // the last instruction before it, 0 at BeginBB's start
+    int arena_stores = 0;   // FunctionContext::arena_stores at segment begin
+    bool allocates = false; // it or a nested segment allocates arrays or strings
+    std::vector<CallInst *> exits; // releases on repeat/repent edges out of it
+};
+
 class FunctionContext {
 public:
-    std::unordered_map<std::string, Value *> symbols;
     Function *F = 0;
 
+    // variables of enclosing functions used here: their storage there, the
+    // pointer to it here, see capture_variable()
+    std::unordered_map<Value *, Value *> captured;
+    // the slots of its variables that nested functions use, see
+    // variable_slot(), and their values on entry, restored on return
+    std::unordered_map<Value *, GlobalVariable *> slots;
+    std::vector<std::pair<GlobalVariable *, Value *>> saved_slots;
+
+    // the arrays in its frame, see allocate_inline_array()
+    struct inline_array_t {
+        AllocaInst *storage;
+        CallInst *fill;   // zero-fills it where it is declared
+        Value *data;      // its first element
+        uint64_t n;       // elements
+        uint64_t size;    // of an element
+    };
+    std::vector<inline_array_t> inline_arrays;
+
+    std::vector<segment_t> segments;
+    Value *arena_mark = 0; // taken in the entry block, released on return
+    int arena_stores = 0;  // stores of whole arrays, structures or strings
+    int outer_stores = 0;  // those to storage outside its frame
+
     FunctionContext(Function *f) : F{f} {}
 };
 
@@ -160,61 +265,129 @@ enum array_t {
 //
 
 Value *initialize_array_type(Type *type, std::vector<dimension_t> const &dims, const char *symb);
+Value *generate_element_address(Value *sym, std::vector<Value *> const &indexes);
+void open_arena_scope();
+void release_function_arena();
+void flush_output();
+static void infer_reference_noalias(Module *M);
+static void restore_variable_slots();
+
+//
+// All state of a CompilationSession
+//
+struct session_state_t {
+    // The context is owned here until a consumer (e.g. the JIT) takes it over
+    std::unique_ptr<LLVMContext> TheContextOwner;
+    LLVMContext &TheContext;
+    IRBuilder<> Builder;
 
-static std::stack<LabelStatement *> labels;
-static std::unordered_map<std::string, LabelStatement *> label_table;
+    compile_options_t options;
+    int err_cnt = 0;
+    std::string source_name; // SourceText::name(), see program_header()
 
-// nested functions
-std::unordered_map<std::string, Function *> fsymbols;
+    std::stack<Module *> modules;
+    std::vector<FunctionContext> functions; // the innermost last
+    std::stack<IfStatement> conditionals;
+    std::vector<LoopStatement> loops;
+    std::stack<SelectStatement> selects;
+    std::stack<LabelStatement *> labels;
+    std::stack<BasicBlock *> jumps; // continuation of the enclosing function
 
-// run-time library
-std::unordered_map<std::string, Function *> rtl_symbols;
+    // variables, functions, types, fields and labels of the open scopes
+    symbol_table symbols;
 
-// Map to track array element types for opaque pointer compatibility
-std::unordered_map<StructType *, Type *> array_element_types;
+    // run-time library
+    StringMap<Function *> rtl_symbols;
 
-//
-// statics & globals
-//
+    // Map to track array element types for opaque pointer compatibility
+    std::unordered_map<StructType *, Type *> array_element_types;
+    // the descriptor types by element type and number of dimensions
+    std::map<std::pair<Type *, size_t>, StructType *> array_types;
 
-IRBuilder<> Builder(TheContext);
-static std::stack<Module *> modules;
-static Module  *TheModule()
+    std::unordered_map<Value *, array_descriptor_t> array_descriptors;
+
+    // the functions that store arrays, structures or strings outside their
+    // frame, see note_arena_store()
+    SmallPtrSet<Function *, 8> outer_storing;
+
+    // what a parameter passed by reference points to, see function_header()
+    std::unordered_map<Value *, Type *> reference_params;
+
+    // the nodes of a program are released at its end, see program_end()
+    TreeArena tree_arena;
+
+    size_t struct_serial = 0; // see compose_tmp_struct_name()
+
+    compile_stats_t stats;
+
+    session_state_t()
+        : TheContextOwner(std::make_unique<LLVMContext>())
+        , TheContext(*TheContextOwner)
+        , Builder(TheContext)
+    {
+    }
+
+    ~session_state_t()
+    {
+        // the modules belong to the context, unless it was taken over
+        for (; !modules.empty(); modules.pop())
+            if (TheContextOwner)
+                delete modules.top();
+    }
+};
+
+static session_state_t &S()
+{
+    assert(current_state);
+    return *current_state;
+}
+
+static LLVMContext &TheContext()
 {
-    return modules.top();
+    return S().TheContext;
 }
 
-static std::stack<FunctionContext> functions;
+static IRBuilder<> &Builder()
+{
+    return S().Builder;
+}
 
-static std::stack<IfStatement> conditionals;
-static std::stack<LoopStatement> loops;
+static Module  *TheModule()
+{
+    return S().modules.top();
+}
 
-int err_cnt = 0;
-bool flag_verbose = false;
+TreeArena &ast_arena()
+{
+    return S().tree_arena;
+}
 
-symbol_type_table type_table;
+// the phase to time, or 0 if the phases are not timed
+static phase_time_t *timed(phase_t phase)
+{
+    return S().options.time_report ? &S().stats.phases[phase] : 0;
+}
 
-//
-//
-//
-void init_compiler()
+int yylex(YYSTYPE *yylval, yyscan_t scanner)
 {
-    // TODO: place init code here
+    phase_timer timer(timed(PHASE_LEX));
+    return scan_token(yylval, scanner);
 }
 
 ///
 ///
 ///
 void insert_rtl_symbol(std::string const &key_name, std::string const &entry_name,
-                       Type *return_type, std::vector<Type *> const &formals)
+                       Type *return_type, std::vector<Type *> const &formals,
+                       bool is_vararg = false)
 {
-    FunctionType *FT = FunctionType::get(return_type, formals, false);
+    FunctionType *FT = FunctionType::get(return_type, formals, is_vararg);
     Function *F = Function::Create(FT, Function::ExternalLinkage, entry_name, TheModule());
     unsigned idx = 0;
     for (auto &Arg : F->args())
         Arg.setName(std::string("arg_") + std::to_string(++idx));
 
-    rtl_symbols.insert(std::make_pair(key_name, F));
+    S().rtl_symbols.insert(std::make_pair(key_name, F));
 }
 
 //
@@ -222,16 +395,52 @@ void insert_rtl_symbol(std::string const &key_name, std::string const &entry_nam
 //
 void init_rtl_symbols()
 {
-    insert_rtl_symbol("output", "rtl_output", Type::getInt32Ty(TheContext), {Type::getInt32Ty(TheContext)});
-    insert_rtl_symbol("output_str", "rtl_output_str", Type::getInt32Ty(TheContext), {PointerType::getUnqual(Type::getInt8Ty(TheContext))});
-    insert_rtl_symbol("output_real", "rtl_output_real", Type::getInt32Ty(TheContext), {Type::getDoubleTy(TheContext)});
-    insert_rtl_symbol("output_bool", "rtl_output_bool", Type::getInt1Ty(TheContext), {Type::getInt1Ty(TheContext)});
-    insert_rtl_symbol("output_nl", "rtl_output_nl", Type::getInt32Ty(TheContext), {});
-    //    insert_rtl_symbol("fix", "rtl_fix", Type::getInt32Ty(TheContext),
-    //    {Type::getDoubleTy(TheContext)});
+    insert_rtl_symbol("output", "rtl_output", Type::getInt32Ty(TheContext()), {Type::getInt32Ty(TheContext())});
+    insert_rtl_symbol("output_str", "rtl_output_str", Type::getInt32Ty(TheContext()), {PointerType::getUnqual(Type::getInt8Ty(TheContext()))});
+    insert_rtl_symbol("output_real", "rtl_output_real", Type::getInt32Ty(TheContext()), {Type::getDoubleTy(TheContext())});
+    insert_rtl_symbol("output_bool", "rtl_output_bool", Type::getInt1Ty(TheContext()), {Type::getInt1Ty(TheContext())});
+    insert_rtl_symbol("output_nl", "rtl_output_nl", Type::getInt32Ty(TheContext()), {});
+    insert_rtl_symbol("output_list", "rtl_output_list", Type::getInt32Ty(TheContext()),
+                      {PointerType::getUnqual(Type::getInt8Ty(TheContext()))}, true);
+    insert_rtl_symbol("output_flush", "rtl_output_flush", Type::getVoidTy(TheContext()), {});
+    //    insert_rtl_symbol("fix", "rtl_fix", Type::getInt32Ty(TheContext()),
+    //    {Type::getDoubleTy(TheContext())});
     insert_rtl_symbol("allocate_array", "rtl_allocate_array",
-                      PointerType::getUnqual(Type::getInt32Ty(TheContext)),
-                      {Type::getInt32Ty(TheContext), Type::getInt32Ty(TheContext)});
+                      PointerType::getUnqual(Type::getInt32Ty(TheContext())),
+                      {Type::getInt32Ty(TheContext()), Type::getInt32Ty(TheContext())});
+    insert_rtl_symbol("arena_mark", "rtl_arena_mark",
+                      PointerType::getUnqual(Type::getInt8Ty(TheContext())), {});
+    insert_rtl_symbol("arena_release", "rtl_arena_release", Type::getVoidTy(TheContext()),
+                      {PointerType::getUnqual(Type::getInt8Ty(TheContext()))});
+    insert_rtl_symbol("arena_release_keep", "rtl_arena_release_keep", Type::getVoidTy(TheContext()),
+                      {PointerType::getUnqual(Type::getInt8Ty(TheContext())),
+                       PointerType::getUnqual(Type::getInt8Ty(TheContext())), Type::getInt32Ty(TheContext())});
+    insert_rtl_symbol("arena_keep_value", "rtl_arena_keep_value", Type::getVoidTy(TheContext()),
+                      {PointerType::getUnqual(Type::getInt8Ty(TheContext())),
+                       PointerType::getUnqual(Type::getInt8Ty(TheContext())),
+                       PointerType::getUnqual(Type::getInt8Ty(TheContext())), Type::getInt32Ty(TheContext())});
+    insert_rtl_symbol("bounds_error", "rtl_bounds_error", Type::getVoidTy(TheContext()),
+                      {Type::getInt32Ty(TheContext()), Type::getInt32Ty(TheContext()),
+                       Type::getInt32Ty(TheContext())});
+    S().rtl_symbols["bounds_error"]->addFnAttr(Attribute::NoReturn);
+    S().rtl_symbols["bounds_error"]->addFnAttr(Attribute::Cold);
+
+    // strings, see rtl_string.c
+    Type *string = PointerType::getUnqual(Type::getInt8Ty(TheContext()));
+    insert_rtl_symbol("string_concat", "rtl_string_concat", string, {Type::getInt32Ty(TheContext())}, true);
+    insert_rtl_symbol("string_substr", "rtl_string_substr", string,
+                      {string, Type::getInt32Ty(TheContext()), Type::getInt32Ty(TheContext())});
+    insert_rtl_symbol("string_character", "rtl_string_character", string, {Type::getInt32Ty(TheContext())});
+    insert_rtl_symbol("string_keep", "rtl_string_keep", string,
+                      {PointerType::getUnqual(Type::getInt8Ty(TheContext())), string});
+    for (auto entry : {"string_concat", "string_substr", "string_character"}) {
+        S().rtl_symbols[entry]->setDoesNotThrow();
+        S().rtl_symbols[entry]->addRetAttr(Attribute::NonNull);
+    }
+    S().rtl_symbols["string_character"]->setDoesNotAccessMemory(); // a static table
+
+    insert_rtl_symbol("input_list", "rtl_input_list", Type::getInt32Ty(TheContext()),
+                      {PointerType::getUnqual(Type::getInt8Ty(TheContext()))}, true);
 }
 
 //
@@ -240,22 +449,25 @@ void init_rtl_symbols()
 
 void program_header(TreeNode *node)
 {
-    auto id = dynamic_cast<TreeIdentNode *>(node);
+    auto id = dyn_cast_or_null<TreeIdentNode>(node);
 
-    modules.push(new Module(id->id, TheContext));
+    S().modules.push(new Module(id->id, TheContext()));
+    if (!S().source_name.empty())
+        TheModule()->setSourceFileName(S().source_name);
+    set_module_target(TheModule());
 
     init_rtl_symbols();
     
-    std::vector<Type *> Doubles(0, Type::getDoubleTy(TheContext));
-    FunctionType *FT = FunctionType::get(Builder.getInt32Ty(), Doubles, false);
+    std::vector<Type *> Doubles(0, Type::getDoubleTy(TheContext()));
+    FunctionType *FT = FunctionType::get(Builder().getInt32Ty(), Doubles, false);
     Function *F = Function::Create(FT, Function::ExternalLinkage, "main", TheModule());
 
     // Set names for all arguments.
     for (auto &Arg : F->args())
         Arg.setName("arg");
 
-    BasicBlock *BB = BasicBlock::Create(TheContext, "entry", F);
-    Builder.SetInsertPoint(BB);
+    BasicBlock *BB = BasicBlock::Create(TheContext(), "entry", F);
+    Builder().SetInsertPoint(BB);
 
     set_current_function(F);
 }
@@ -265,69 +477,109 @@ void program_end(TreeNode *node)
     auto F = get_current_function();
     // TODO: pop(); ... ; delete F;
     
-    auto rc = Builder.getInt32(0);
+    auto rc = Builder().getInt32(0);
 
-    Builder.CreateRet(rc);
+    Builder().CreateRet(rc);
+    release_function_arena();
+    flush_output();
 
-    verifyFunction(*F);
+    {
+        phase_timer timer(timed(PHASE_VERIFY));
+        verifyFunction(*F);
+    }
 
-    // auto id = dynamic_cast<TreeIdentNode *>(node);
+    // auto id = dyn_cast_or_null<TreeIdentNode>(node);
     // TODO: verify ending label == module name
 
-    if(err_cnt == 0)
-        TheModule()->print(outs(), nullptr);
+    if(S().err_cnt == 0) {
+        infer_reference_noalias(TheModule());
+        {
+            phase_timer timer(timed(PHASE_OPTIMIZE));
+            ipo_options_t ipo;
+            ipo.inline_functions = S().options.inline_functions;
+            ipo.report = S().options.inline_report ? &errs() : 0;
+            ipo.inlined = &S().stats.calls_inlined;
+            optimize_module(TheModule(), S().options.opt_level, ipo);
+        }
+        if (S().options.stats)
+            count_module(*TheModule(), S().stats);
+        if (S().options.emit_mode == EMIT_IR) {
+            phase_timer timer(timed(PHASE_EMIT));
+            TheModule()->print(outs(), nullptr);
+        }
+    }
 
     functions_pop();
+    S().stats.tree_nodes += S().tree_arena.objects_allocated();
+    S().stats.tree_bytes += S().tree_arena.bytes_allocated();
+    S().tree_arena.release();
 }
 
 TreeNode *make_binary(TreeNode *left, TreeNode *right, int op)
 {
-    if (flag_verbose) {
+    if (S().options.verbose) {
         if (left && right)
             errs() << "[" << token_to_string(op) << "," << left->show() << "," << right->show()
                    << "]\n";
         else
             errs() << "[" << token_to_string(op) << "," << left->show() << ",<null>]\n";
     }
-    return new TreeBinaryNode(left, right, op);
+    return ast_arena().make<TreeBinaryNode>(left, right, op);
 }
 
 TreeNode *make_unary(TreeNode *left, int op)
 {
-    return new TreeUnaryNode(left, op); // TODO:
+    return ast_arena().make<TreeUnaryNode>(left, op);
 }
 
 TreeNode *make_boolean(int op)
 {
-    return new TreeBooleanNode(op != 0);
+    return ast_arena().make<TreeBooleanNode>(op != 0);
 }
 
 void syntax_error(std::string errmsg)
 {
-    ++err_cnt;
+    ++S().err_cnt;
     errs() << errmsg << "\n";
 }
 
-size_t get_field_offset(Type *type, TreeNode *node)
+//
+// The number of the field of the structure type, -1 if it has no such field
+//
+int get_field_offset(Type *type, TreeNode *node)
 {
-    size_t off = 0;
-    if (flag_verbose)
+    if (S().options.verbose)
         errs() << "get_field_offset: " << node->show() << "\n";
     assert(node->oper == IDENT);
-    auto ident = dynamic_cast<TreeIdentNode *>(node);
+    auto ident = dyn_cast_or_null<TreeIdentNode>(node);
     assert(ident);
-    StructType *stype = cast<StructType>(type);
-    assert(stype);
-    auto fname = stype->getName() + "." + ident->id;
-    Value *off_val = symbols_find(fname.str());
-    if (off_val) {
-        ConstantInt *cint = cast<ConstantInt>(off_val);
-        assert(cint != 0);
-        off = (size_t)cint->getLimitedValue();
-    } else {
-        syntax_error(ident->id + ": is not a name of a field");
-    }
-    return off;
+    if (symbol_t *field = S().symbols.find(symbol_of(ident), SYMBOL_FIELD, type))
+        return field->field;
+    syntax_error(std::string(ident->id) + ": is not a name of a field");
+    return -1;
+}
+
+//
+// The type of the storage a variable symbol points to: its alloca, or the
+// actual argument of a parameter passed by reference. 0 for a parameter
+// passed by value, which is not an lvalue.
+//
+static Type *storage_type(Value *sym)
+{
+    if (auto var = dyn_cast_or_null<AllocaInst>(sym))
+        return var->getAllocatedType();
+    if (auto var = dyn_cast_or_null<GlobalVariable>(sym))
+        return var->getValueType();
+    auto pos = S().reference_params.find(sym);
+    return pos == S().reference_params.end() ? 0 : pos->second;
+}
+
+// the type of what lvalue points to
+static Type *lvalue_type(Value *lvalue)
+{
+    if (auto gep = dyn_cast<GEPOperator>(lvalue))
+        return gep->getResultElementType();
+    return storage_type(lvalue);
 }
 
 //
@@ -341,90 +593,62 @@ size_t get_field_offset(Type *type, TreeNode *node)
 Value *generate_lvalue(TreeNode *target)
 {
     Value *lvalue = 0;
-    if (auto node = dynamic_cast<TreeIdentNode *>(target)) {
-        std::string id = node->id;
-        auto pos = symbols_find(id);
+    if (auto node = dyn_cast_or_null<TreeIdentNode>(target)) {
+        auto pos = symbols_find(symbol_of(node));
         if (pos) {
             lvalue = pos;
         } else {
-            syntax_error(id + ": ident not found");
+            syntax_error(std::string(node->id) + ": ident not found");
         }
     } else if (target->oper == LBRACK) {
-        std::stack<Value *> indexes;
+        std::vector<Value *> indexes; // reverse order, as generate_aij()
         while (target->oper == LBRACK) {
             auto R = generate_expr(target->right);
-            indexes.push(R);
+            indexes.push_back(R);
             target = target->left;
         }
-        if (auto ident = dynamic_cast<TreeIdentNode *>(target)) {
-            auto sym = symbols_find(ident->id);
+        if (auto ident = dyn_cast_or_null<TreeIdentNode>(target)) {
+            auto sym = symbols_find(symbol_of(ident));
             if (!sym) {
-                syntax_error(ident->id + ": not found");
+                syntax_error(std::string(ident->id) + ": not found");
                 return lvalue; // null?
             }
 
-            if (flag_verbose) {
+            if (S().options.verbose) {
                 show_type_details(sym->getType()); // DEBUG
             }
 
             if (!isArrayType(sym)) {
-                syntax_error(ident->id + ": is not array");
+                syntax_error(std::string(ident->id) + ": is not array");
                 return lvalue;
             }
 
-            StructType *sym_type = array_get_type(sym);
-            Type *array_elem_type = array_get_elem_type(sym_type);
-
-            int off = 0;
-            Value *I = Const(0);
-            Value *R, *L;
-            while (indexes.size()) {
-                R = indexes.top();
-                indexes.pop();
-
-                auto LB = Builder.CreateGEP(sym_type, sym,
-                                            {Const(0), Const(0), Const(off + array_t::low_bound)},
-                                            "array_descr"); // low bound
-                LB = Builder.CreateLoad(Type::getInt32Ty(TheContext), LB, "lb");
-                R = Builder.CreateSub(R, LB, "sub_lb");
-                auto S = Builder.CreateGEP(sym_type, sym,
-                                           {Const(0), Const(0), Const(off + array_t::stride)},
-                                           "stride_addr"); // stride for the current dimension
-                S = Builder.CreateLoad(Type::getInt32Ty(TheContext), S, "stride");
-                R = Builder.CreateMul(R, S, "R_mul_S");
-                I = Builder.CreateAdd(I, R, "I_plus_R");
-                off += array_t::dim_size;
-            }
-            L = Builder.CreateGEP(sym_type, sym, {Const(0), Const(1)}, "descr");
-            Type *ptr_type = PointerType::getUnqual(array_elem_type);
-            L = Builder.CreateLoad(ptr_type, L, "array_start");
-            lvalue = Builder.CreateGEP(array_elem_type, L, {I}, "lvalue");
+            lvalue = generate_element_address(sym, indexes);
         } else {
             assert("Not implemented yet..." == 0);
             // generate_store(node->left, e);
             // generate_store(node->right, e);
         }
     } else if (target->oper == PERIOD) {
-        if (auto ident = dynamic_cast<TreeIdentNode *>(target->left)) {
-            auto sym = symbols_find(ident->id);
+        if (auto ident = dyn_cast_or_null<TreeIdentNode>(target->left)) {
+            auto sym = symbols_find(symbol_of(ident));
             if (!sym) {
-                syntax_error(ident->id + ": not found");
+                syntax_error(std::string(ident->id) + ": not found");
                 return lvalue; // null?
             }
-            if (flag_verbose) {
+            if (S().options.verbose) {
                 show_type_details(sym->getType());
                 if (sym->getType())
                     sym->getType()->dump();
             }
-            Type *struct_type = nullptr;
-            if (auto *AI = dyn_cast<AllocaInst>(sym)) {
-                struct_type = AI->getAllocatedType();
-            } else {
+            Type *struct_type = storage_type(sym);
+            if (!struct_type)
                 struct_type = sym->getType();
-            }
             int off = get_field_offset(struct_type, target->right);
-            lvalue = Builder.CreateStructGEP(struct_type, sym, off);
-            if (flag_verbose) {
+            if (off < 0)
+                return lvalue;
+            lvalue = Builder().CreateStructGEP(struct_type, sym, off);
+            if (S().options.verbose) {
                 errs() << "sym: " << sym << "\n";
                 lvalue->dump();
             }
@@ -437,9 +661,33 @@ Value *generate_lvalue(TreeNode *target)
     return lvalue;
 }
 
+//
+// A store of a value that may point to arena storage, arrays or strings:
+// it may outlive its segment, and the function if lvalue is outside its
+// frame. Calling a function that stores outside its frame is one, too.
+//
+// f, or a function being defined, as it may call itself
+static bool stores_outside(Function *f)
+{
+    for (auto &ctx : S().functions)
+        if (ctx.F == f)
+            return true;
+    return S().outer_storing.count(f) != 0;
+}
+
+static void note_arena_store(Value *lvalue)
+{
+    auto &ctx = S().functions.back();
+
+    ++ctx.arena_stores;
+    auto local = lvalue ? dyn_cast<AllocaInst>(getUnderlyingObject(lvalue)) : 0;
+    if (!local || local->getFunction() != ctx.F)
+        ++ctx.outer_stores;
+}
+
 void generate_store(TreeNode *targets, Value *e)
 {
-    if (flag_verbose)
+    if (S().options.verbose)
         errs() << "generate_store: " << targets->show() << "\n";
 
     if (targets->oper == BECOMES) {
@@ -447,218 +695,263 @@ void generate_store(TreeNode *targets, Value *e)
         generate_store(targets->right, e);
     } else {
         auto lvalue = generate_lvalue(targets);
-        Builder.CreateStore(e, lvalue);
+        Builder().CreateStore(e, lvalue);
+        for (auto &loop : S().loops)
+            loop.assigned.insert(lvalue);
+        S().array_descriptors.erase(lvalue); // whole array assigned, descriptor changed
+        if (e->getType()->isStructTy() || e->getType()->isPointerTy())
+            note_arena_store(lvalue);
     }
 }
 
 //
-bool is_loadable(Value *val, std::string id)
+bool is_loadable(Value *val)
 {
-    return !(val->getValueID() == Value::ArgumentVal);
+    return !(val->getValueID() == Value::ArgumentVal) || S().reference_params.count(val);
 }
 
 Value *generate_load(TreeIdentNode *node)
 {
     Value *val = 0;
-    std::string id = node->id;
-    auto pos = symbols_find(id);
+    auto pos = symbols_find(symbol_of(node));
     if (pos) {
-        if (is_loadable(pos, id)) {
-            Type *load_type = nullptr;
-            if (auto *AI = dyn_cast<AllocaInst>(pos)) {
-                load_type = AI->getAllocatedType();
-            } else {
+        if (is_loadable(pos)) {
+            Type *load_type = storage_type(pos);
+            if (!load_type)
                 load_type = pos->getType();
-            }
-            val = Builder.CreateLoad(load_type, pos, "tmpvar");
+            val = Builder().CreateLoad(load_type, pos, "tmpvar");
         } else {
             val = pos;
         }
     } else {
-        syntax_error(id + ": ident not found");
+        syntax_error(std::string(node->id) + ": ident not found");
     }
     return val;
 }
 
-Value *allocate_string_constant(TreeTextNode *node)
-{
-    Value *val = Builder.CreateGlobalStringPtr(node->text, "c_str");
-    return val;
-}
-
-//  L > R
-Value *generate_compare_gtr_expr(Value *L, Value *R)
+//
+// rtl_string_t, see mini_system.h
+//
+static StructType *string_header_type()
 {
-    if (L->getType()->isDoubleTy() && R->getType()->isIntegerTy())
-        R = Builder.CreateSIToFP(R, Type::getDoubleTy(TheContext), "float");
-    else if (L->getType()->isIntegerTy() && R->getType()->isDoubleTy())
-        L = Builder.CreateSIToFP(L, Type::getDoubleTy(TheContext), "float");
-
-    Value *val;
-    if (L->getType()->isDoubleTy() && R->getType()->isDoubleTy())
-        val = Builder.CreateFCmpUGT(L, R, "gtr");
-    else
-        val = Builder.CreateICmpSGT(L, R, "gtr");
-    return val;
+    if (auto type = StructType::getTypeByName(TheContext(), "rtl_string"))
+        return type;
+    Type *ptr = PointerType::getUnqual(Type::getInt8Ty(TheContext()));
+    return StructType::create(TheContext(),
+                              {Type::getInt32Ty(TheContext()), ptr, ptr,
+                               ArrayType::get(Type::getInt8Ty(TheContext()), RTL_STRING_SSO)},
+                              "rtl_string");
 }
 
-//  L >= R
-Value *generate_compare_geq_expr(Value *L, Value *R)
-{
-    if (L->getType()->isDoubleTy() && R->getType()->isIntegerTy())
-        R = Builder.CreateSIToFP(R, Type::getDoubleTy(TheContext), "float");
-    else if (L->getType()->isIntegerTy() && R->getType()->isDoubleTy())
-        L = Builder.CreateSIToFP(L, Type::getDoubleTy(TheContext), "float");
-
-    Value *val;
-    if (L->getType()->isFloatingPointTy() && R->getType()->isFloatingPointTy())
-        val = Builder.CreateFCmpUGE(L, R, "geq");
-    else
-        val = Builder.CreateICmpSGE(L, R, "geq");
-    return val;
+//
+// A literal is a constant header pointing to constant characters; it
+// costs nothing at run time.
+//
+static Value *string_constant(StringRef text)
+{
+    StructType *header = string_header_type();
+    Type *ptr = PointerType::getUnqual(Type::getInt8Ty(TheContext()));
+    if (text.empty())
+        if (auto var = TheModule()->getNamedGlobal("str.empty"))
+            return ConstantExpr::getPointerCast(var, ptr);
+    Constant *chars = Builder().CreateGlobalStringPtr(text, "c_str");
+    Constant *init = ConstantStruct::get(header, {Builder().getInt32(text.size()), chars,
+                                                  ConstantPointerNull::get(cast<PointerType>(ptr)),
+                                                  ConstantAggregateZero::get(header->getElementType(3))});
+    auto var = new GlobalVariable(*TheModule(), header, true, GlobalValue::PrivateLinkage, init,
+                                  text.empty() ? "str.empty" : "str");
+    var->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
+    return ConstantExpr::getPointerCast(var, ptr);
 }
 
-//  L < R
-Value *generate_compare_lss_expr(Value *L, Value *R)
+Value *allocate_string_constant(TreeTextNode *node)
 {
-    if (L->getType()->isDoubleTy() && R->getType()->isIntegerTy())
-        R = Builder.CreateSIToFP(R, Type::getDoubleTy(TheContext), "float");
-    else if (L->getType()->isIntegerTy() && R->getType()->isDoubleTy())
-        L = Builder.CreateSIToFP(L, Type::getDoubleTy(TheContext), "float");
-
-    Value *val;
-    if (L->getType()->isFloatingPointTy() && R->getType()->isFloatingPointTy())
-        val = Builder.CreateFCmpULT(L, R, "cmptmp");
-    else
-        val = Builder.CreateICmpSLT(L, R, "cmptmp");
-    return val;
+    return string_constant(node->text);
 }
 
-//  L <= R
-Value *generate_compare_leq_expr(Value *L, Value *R)
+// the length field of the header; headers are never written once made
+static Value *generate_string_length(Value *str)
 {
-    if (L->getType()->isDoubleTy() && R->getType()->isIntegerTy())
-        R = Builder.CreateSIToFP(R, Type::getDoubleTy(TheContext), "float");
-    else if (L->getType()->isIntegerTy() && R->getType()->isDoubleTy())
-        L = Builder.CreateSIToFP(L, Type::getDoubleTy(TheContext), "float");
-
-    Value *val;
-    if (L->getType()->isFloatingPointTy() && R->getType()->isFloatingPointTy())
-        val = Builder.CreateFCmpULE(L, R, "leq");
-    else
-        val = Builder.CreateICmpSLE(L, R, "leq");
-    return val;
+    Type *ptr = PointerType::getUnqual(Type::getInt32Ty(TheContext()));
+    auto is_null = Builder().CreateIsNull(str, "no_string");
+    Value *header = Builder().CreateSelect(is_null, string_constant(""), str, "string");
+    auto length = Builder().CreateLoad(Type::getInt32Ty(TheContext()),
+                                       Builder().CreatePointerCast(header, ptr), "length");
+    length->setMetadata(LLVMContext::MD_invariant_load, MDNode::get(TheContext(), {}));
+    return length;
 }
 
-// L = R
-Value *generate_compare_eql_expr(Value *L, Value *R)
+static void collect_concat_parts(TreeNode *expr, std::vector<Value *> &parts)
 {
-    if (L->getType()->isDoubleTy() && R->getType()->isIntegerTy())
-        R = Builder.CreateSIToFP(R, Type::getDoubleTy(TheContext), "float");
-    else if (L->getType()->isIntegerTy() && R->getType()->isDoubleTy())
-        L = Builder.CreateSIToFP(L, Type::getDoubleTy(TheContext), "float");
-
-    Value *val;
-    if (L->getType()->isFloatingPointTy() && R->getType()->isFloatingPointTy())
-        val = Builder.CreateFCmpUEQ(L, R, "cmptmp");
-    else
-        val = Builder.CreateICmpEQ(L, R, "cmptmp");
-    return val;
+    if (expr->kind == TREE_BINARY && expr->oper == CONCAT) {
+        collect_concat_parts(expr->left, parts);
+        collect_concat_parts(expr->right, parts);
+    } else {
+        parts.push_back(generate_expr(expr));
+    }
 }
 
-Value *generate_div(Value *L, Value *R)
+//
+// a || b || c ... is one rtl_string_concat() call, which copies every
+// character once: a chain of pairwise calls would copy the right operands
+// again at every step
+//
+static Value *generate_concat(TreeNode *expr)
 {
-    if (L->getType()->isDoubleTy() && R->getType()->isIntegerTy())
-        R = Builder.CreateSIToFP(R, Type::getDoubleTy(TheContext), "float");
-    else if (L->getType()->isIntegerTy() && R->getType()->isDoubleTy())
-        L = Builder.CreateSIToFP(L, Type::getDoubleTy(TheContext), "float");
-
-    Value *val = 0;
-    if (L->getType()->isDoubleTy() && R->getType()->isDoubleTy())
-        val = Builder.CreateFDiv(L, R, "fdiv");
-    else
-        val = Builder.CreateSDiv(L, R, "div");
-
-    return val;
+    std::vector<Value *> args {0};
+    collect_concat_parts(expr, args);
+    args[0] = Builder().getInt32(args.size() - 1);
+    open_arena_scope();
+    return generate_rtl_call("string_concat", args);
 }
 
-Value *generate_sub(Value *L, Value *R)
+static Value *generate_substr(TreeNode *expr)
 {
-    if (L->getType()->isDoubleTy() && R->getType()->isIntegerTy())
-        R = Builder.CreateSIToFP(R, Type::getDoubleTy(TheContext), "float");
-    else if (L->getType()->isIntegerTy() && R->getType()->isDoubleTy())
-        L = Builder.CreateSIToFP(L, Type::getDoubleTy(TheContext), "float");
-
-    Value *val = 0;
-    if (L->getType()->isDoubleTy() && R->getType()->isDoubleTy())
-        val = Builder.CreateFSub(L, R, "fsub");
-    else
-        val = Builder.CreateSub(L, R, "sub");
-
-    return val;
+    Value *str = generate_expr(expr->left);
+    Value *start = generate_expr(expr->right->left);
+    Value *length = generate_expr(expr->right->right);
+    open_arena_scope();
+    return generate_rtl_call("string_substr", {str, start, length});
 }
 
-Value *generate_mul(Value *L, Value *R)
+// L = R
+Value *generate_compare_eql_expr(Value *L, Value *R)
 {
     if (L->getType()->isDoubleTy() && R->getType()->isIntegerTy())
-        R = Builder.CreateSIToFP(R, Type::getDoubleTy(TheContext), "float");
+        R = Builder().CreateSIToFP(R, Type::getDoubleTy(TheContext()), "float");
     else if (L->getType()->isIntegerTy() && R->getType()->isDoubleTy())
-        L = Builder.CreateSIToFP(L, Type::getDoubleTy(TheContext), "float");
+        L = Builder().CreateSIToFP(L, Type::getDoubleTy(TheContext()), "float");
 
-    Value *val = 0;
-    if (L->getType()->isDoubleTy() && R->getType()->isDoubleTy())
-        val = Builder.CreateFMul(L, R, "fmul");
+    Value *val;
+    if (L->getType()->isFloatingPointTy() && R->getType()->isFloatingPointTy())
+        val = Builder().CreateFCmpUEQ(L, R, "cmptmp");
     else
-        val = Builder.CreateMul(L, R, "mul");
-
+        val = Builder().CreateICmpEQ(L, R, "cmptmp");
     return val;
 }
 
 Value *generate_add(Value *L, Value *R, const char *name = "add")
 {
     if (L->getType()->isDoubleTy() && R->getType()->isIntegerTy())
-        R = Builder.CreateSIToFP(R, Type::getDoubleTy(TheContext), "float");
+        R = Builder().CreateSIToFP(R, Type::getDoubleTy(TheContext()), "float");
     else if (L->getType()->isIntegerTy() && R->getType()->isDoubleTy())
-        L = Builder.CreateSIToFP(L, Type::getDoubleTy(TheContext), "float");
+        L = Builder().CreateSIToFP(L, Type::getDoubleTy(TheContext()), "float");
 
     Value *val;
     if (L->getType()->isDoubleTy() && R->getType()->isDoubleTy())
-        val = Builder.CreateFAdd(L, R, name);
+        val = Builder().CreateFAdd(L, R, name);
     else
-        val = Builder.CreateAdd(L, R, name);
+        val = Builder().CreateAdd(L, R, name);
     return val;
 }
 
-void build_actual_args(TreeNode *anode, std::vector<Value *> &args)
+void build_actual_args(TreeNode *anode, std::vector<TreeNode *> &args)
 {
-    if (auto bnode = dynamic_cast<TreeBinaryNode *>(anode)) {
+    if (auto bnode = dyn_cast_or_null<TreeBinaryNode>(anode)) {
         if (bnode->oper == COMMA) {
             build_actual_args(bnode->left, args);
             build_actual_args(bnode->right, args);
         } else {
-            args.push_back(generate_expr(bnode));
+            args.push_back(bnode);
         }
-    } else {
-        args.push_back(generate_expr(anode));
+    } else if (anode) {
+        args.push_back(anode);
+    }
+}
+
+//
+// The address of the actual argument of a parameter passed by reference:
+// a variable, an element or a field is passed as is, the value of any other
+// expression is passed in a temporary of its own.
+//
+static Value *generate_reference_arg(TreeNode *actual, Type *type)
+{
+    bool variable = isa<TreeIdentNode>(actual) ||
+                    (isa<TreeBinaryNode>(actual) && (actual->oper == LBRACK || actual->oper == PERIOD));
+    if (variable) {
+        Value *lvalue = generate_lvalue(actual);
+        if (!lvalue)
+            return 0; // reported already
+        if (lvalue_type(lvalue) == type)
+            return lvalue;
+        if (lvalue_type(lvalue)) {
+            syntax_error(actual->show() + ": argument type mismatch");
+            return 0;
+        }
+    }
+
+    Value *val = generate_expr(actual);
+    if (!val)
+        return 0;
+    if (val->getType() != type) {
+        syntax_error(actual->show() + ": argument type mismatch");
+        return 0;
     }
+    BasicBlock &entry = get_current_function()->getEntryBlock();
+    IRBuilder<> TmpB(&entry, entry.begin());
+    Value *tmp = TmpB.CreateAlloca(type, 0, "arg_tmp");
+    Builder().CreateStore(val, tmp);
+    return tmp;
 }
 
 Value *generate_call(TreeNode *fnode, TreeNode *anode)
 {
     Value *val = 0;
 
-    if (auto ident = dynamic_cast<TreeIdentNode *>(fnode)) {
-        Value *F = symbols_find_function(ident->id);
+    if (auto ident = dyn_cast_or_null<TreeIdentNode>(fnode)) {
+        Value *F = symbols_find_function(symbol_of(ident));
         if (F) {
-            std::vector<Value *> args;
-            build_actual_args(anode, args);
             if (auto *Func = dyn_cast<Function>(F)) {
-                val = Builder.CreateCall(Func->getFunctionType(), F, args, "fcall");
+                if (!S().loops.empty())
+                    Func->addFnAttr(Attribute::InlineHint); // see optimize_module()
+
+                std::vector<TreeNode *> actuals;
+                build_actual_args(anode, actuals);
+                if (actuals.size() != Func->arg_size()) {
+                    syntax_error(std::string(ident->id) + ": wrong number of arguments");
+                    return 0;
+                }
+
+                std::vector<Value *> args;
+                for (size_t i = 0; i != actuals.size(); ++i) {
+                    auto pos = S().reference_params.find(Func->getArg(i));
+                    Value *arg = pos == S().reference_params.end()
+                                     ? generate_expr(actuals[i])
+                                     : generate_reference_arg(actuals[i], pos->second);
+                    if (!arg)
+                        return 0;
+                    args.push_back(arg);
+                }
+                val = Builder().CreateCall(Func->getFunctionType(), F, args, "fcall");
+                for (auto &loop : S().loops)
+                    loop.calls = true;
+                if (stores_outside(Func))
+                    note_arena_store(0);
+
+                // what the callee may have assigned through its parameters
+                for (size_t i = 0; i != args.size(); ++i) {
+                    Argument *formal = Func->getArg(i);
+                    if (!S().reference_params.count(formal) || formal->onlyReadsMemory())
+                        continue;
+                    for (auto &loop : S().loops)
+                        loop.assigned.insert(args[i]);
+                    S().array_descriptors.erase(args[i]);
+                }
+
+                // and what it, or a function it calls, may have assigned of
+                // the variables nested functions use
+                auto &ctx = S().functions.back();
+                for (auto &loop : S().loops) {
+                    for (auto &slot : ctx.slots)
+                        loop.assigned.insert(slot.first);
+                    for (auto &captured : ctx.captured)
+                        loop.assigned.insert(captured.second);
+                }
             } else {
-                syntax_error(ident->id + ": Not a function");
+                syntax_error(std::string(ident->id) + ": Not a function");
             }
         } else {
-            syntax_error(ident->id + ": Function name is not found");
+            syntax_error(std::string(ident->id) + ": Function name is not found");
         }
     } else {
         syntax_error("Function name must be ident");
@@ -676,15 +969,15 @@ Value *resolve_array_symbol(TreeNode *node)
 {
     Value *sym = 0;
     if (node->oper == IDENT) {
-        auto ident = dynamic_cast<TreeIdentNode *>(node);
+        auto ident = dyn_cast_or_null<TreeIdentNode>(node);
         assert(ident);
-        sym = symbols_find(ident->id);
+        sym = symbols_find(symbol_of(ident));
         if (!sym) {
-            syntax_error(ident->id + ": not found");
+            syntax_error(std::string(ident->id) + ": not found");
             return 0;
         }
         if (!isArrayType(sym)) {
-            syntax_error(ident->id + ": is not array");
+            syntax_error(std::string(ident->id) + ": is not array");
             return 0;
         }
     } else if (node->oper == PERIOD) {
@@ -699,14 +992,14 @@ Value *resolve_array_symbol(TreeNode *node)
 
 Value *resolve_struct_symbol(TreeIdentNode *ident)
 {
-    Value *sym = symbols_find(ident->id);
+    Value *sym = symbols_find(symbol_of(ident));
     if (!sym) {
-        syntax_error(ident->id + ": not found");
+        syntax_error(std::string(ident->id) + ": not found");
         return 0;
     }
     // TODO: implement isStructType
     // if(!isStructType(sym)) {
-    //     syntax_error(ident->id + ": is not structure");
+    //     syntax_error(std::string(ident->id) + ": is not structure");
     //     return 0;
     // }
     return sym;
@@ -720,21 +1013,20 @@ Value *generate_dot(TreeNode *dot)
 {
     Value *val = 0;
 
-    auto id = dynamic_cast<TreeIdentNode *>(dot->left);
+    auto id = dyn_cast_or_null<TreeIdentNode>(dot->left);
     assert(id != 0);
     if (Value *sym = resolve_struct_symbol(id)) {
-        Type *struct_type = nullptr;
-        if (auto *AI = dyn_cast<AllocaInst>(sym)) {
-            struct_type = AI->getAllocatedType();
-        } else {
+        Type *struct_type = storage_type(sym);
+        if (!struct_type)
             struct_type = sym->getType();
-        }
-        auto off = get_field_offset(struct_type, dot->right);
-        auto LB = Builder.CreateStructGEP(struct_type, sym, off, "struct_fld");
-        // val = Builder.CreateLoad(LB, "load_fld");
+        int off = get_field_offset(struct_type, dot->right);
+        if (off < 0)
+            return 0;
+        auto LB = Builder().CreateStructGEP(struct_type, sym, off, "struct_fld");
+        // val = Builder().CreateLoad(LB, "load_fld");
         val = LB;
     } else {
-        syntax_error(id->id + ": cannot be resolved as a struct symbol");
+        syntax_error(std::string(id->id) + ": cannot be resolved as a struct symbol");
     }
     return val;
 }
@@ -743,67 +1035,262 @@ Value *generate_dot_load(TreeNode *dot)
 {
     Value *val = 0;
 
-    auto id = dynamic_cast<TreeIdentNode *>(dot->left);
+    auto id = dyn_cast_or_null<TreeIdentNode>(dot->left);
     assert(id != 0);
     if (Value *sym = resolve_struct_symbol(id)) {
-        Type *struct_type = nullptr;
-        if (auto *AI = dyn_cast<AllocaInst>(sym)) {
-            struct_type = AI->getAllocatedType();
-        } else {
+        Type *struct_type = storage_type(sym);
+        if (!struct_type)
             struct_type = sym->getType();
-        }
         int off = get_field_offset(struct_type, dot->right);
-        auto LB = Builder.CreateStructGEP(struct_type, sym, off, "struct_fld");
+        if (off < 0)
+            return 0;
+        auto LB = Builder().CreateStructGEP(struct_type, sym, off, "struct_fld");
 
         // Get the type of the field we're loading
         StructType *stype = cast<StructType>(struct_type);
         Type *field_type = stype->getElementType(off);
-        val = Builder.CreateLoad(field_type, LB, "load_fld");
+        val = Builder().CreateLoad(field_type, LB, "load_fld");
     } else {
-        syntax_error(id->id + ": cannot be resolved as a struct symbol");
+        syntax_error(std::string(id->id) + ": cannot be resolved as a struct symbol");
     }
 
     return val;
 }
 
+// loads of the descriptor fields for the first ndims dimensions, up only
+// if bounds are checked
+static array_descriptor_t load_array_descriptor(IRBuilder<> &B, Value *sym, size_t ndims, bool bounds)
+{
+    Value *zero = B.getInt32(0);
+    StructType *arr_type = array_get_type(sym);
+    Type *arr_elem_type = array_get_elem_type(arr_type);
+
+    array_descriptor_t descr;
+    for (size_t i = 0; i != ndims; ++i) {
+        auto LB = B.CreateGEP(arr_type, sym, {zero, zero, Const(i * array_t::dim_size + array_t::low_bound)},
+                              "lb_addr"); // low bound
+        descr.low.push_back(B.CreateLoad(Type::getInt32Ty(TheContext()), LB, "lb"));
+        if (bounds) {
+            auto UB = B.CreateGEP(arr_type, sym, {zero, zero, Const(i * array_t::dim_size + array_t::up_bound)},
+                                  "ub_addr"); // high bound + 1
+            descr.up.push_back(B.CreateLoad(Type::getInt32Ty(TheContext()), UB, "ub"));
+        }
+        auto field = B.CreateGEP(arr_type, sym, {zero, zero, Const(i * array_t::dim_size + array_t::stride)},
+                                 "stride_gep"); // stride
+        descr.stride.push_back(B.CreateLoad(Type::getInt32Ty(TheContext()), field, "stride"));
+    }
+
+    auto L = B.CreateGEP(arr_type, sym, {zero, Const(1)}, "data_base_addr"); // data base address
+    Type *ptr_type = PointerType::getUnqual(arr_elem_type);
+    descr.data = B.CreateLoad(ptr_type, L, "array_start");
+    return descr;
+}
+
+static size_t descriptor_load_count(array_descriptor_t const &descr)
+{
+    return descr.low.size() + descr.up.size() + descr.stride.size() + 1;
+}
+
 //
-//  NOTE: indexes are in reverse order
+// The cached descriptor of an array declared before the open loops, as the
+// innermost one sees it. Each loop reloads it where its iterations begin;
+// the reloads stay only if the body stores the array whole or passes it by
+// reference, which is known at the end of the body, see
+// settle_loop_descriptors(). Until then, a use before such a store would
+// see the storage of the previous iteration.
 //
-Value *generate_aij(Value *sym, std::vector<Value *> const &indexes)
+static array_descriptor_t loop_descriptor(Value *sym, array_descriptor_t descr)
+{
+    for (size_t i = descr.loops; i < S().loops.size(); ++i) {
+        auto &loop = S().loops[i];
+        auto pos = loop.descriptors.find(sym);
+        if (pos == loop.descriptors.end()) {
+            IRBuilder<> B(loop.EntryBB, loop.EntryBB->getFirstInsertionPt());
+            auto reload = load_array_descriptor(B, sym, descr.low.size(), S().options.check_bounds);
+            pos = loop.descriptors.emplace(sym, std::make_pair(descr, reload)).first;
+        }
+        descr = pos->second.second;
+    }
+    return descr;
+}
+
+// the reloads of loop_descriptor() that the loop does not need: it runs
+// once, or does not change the array
+static void settle_loop_descriptors(LoopStatement &loop, bool repeats)
 {
-    Value *val = 0;
+    for (auto &entry : loop.descriptors) {
+        array_descriptor_t &outer = entry.second.first;
+        array_descriptor_t &reload = entry.second.second;
+        if (repeats && loop.assigned.count(entry.first)) {
+            S().stats.descriptor_loads += descriptor_load_count(reload);
+            continue;
+        }
+
+        // the checks of bounds the loop range implies fold again
+        auto replace = [](Value *by, Value *load) {
+            auto inst = cast<Instruction>(load);
+            auto address = dyn_cast<Instruction>(inst->getOperand(0));
+            replaceAndRecursivelySimplify(inst, by);
+            if (address && address->use_empty())
+                address->eraseFromParent();
+        };
+        for (size_t i = 0; i != reload.low.size(); ++i) {
+            replace(outer.low[i], reload.low[i]);
+            replace(outer.stride[i], reload.stride[i]);
+            if (!reload.up.empty())
+                replace(outer.up[i], reload.up[i]);
+        }
+        replace(outer.data, reload.data);
+    }
+    loop.descriptors.clear();
+}
+
+//
+// Descriptor fields for the first ndims dimensions of the array: the cached
+// SSA values if the array was declared in this function, loads otherwise.
+//
+array_descriptor_t get_array_descriptor(Value *sym, size_t ndims)
+{
+    auto pos = S().array_descriptors.find(sym);
+    if (pos != S().array_descriptors.end())
+        return loop_descriptor(sym, pos->second);
+
+    array_descriptor_t descr = load_array_descriptor(Builder(), sym, ndims, S().options.check_bounds);
+    S().stats.descriptor_loads += descriptor_load_count(descr);
+    return descr;
+}
+
+//
+// The loop whose variable the index was just loaded from, if the index is
+// known to lie in [from, to] there: the loop has a limit and a constant
+// positive step, and its body has not assigned the variable so far. The
+// rest of the body may still do it, see loop_footer().
+//
+static LoopStatement *counted_loop_of(Value *index)
+{
+    auto LI = dyn_cast<LoadInst>(index);
+    if (!LI || !LI->getType()->isIntegerTy(32))
+        return 0;
+
+    for (auto loop = S().loops.rbegin(); loop != S().loops.rend(); ++loop)
+        if (loop->iv == LI->getPointerOperand()) {
+            bool counted = loop->to && loop->step && !loop->assigned.count(loop->iv) &&
+                           loop->from->getType() == index->getType() &&
+                           loop->to->getType() == index->getType();
+            return counted ? &*loop : 0;
+        }
+    return 0;
+}
+
+//
+// -fcheck-bounds: low <= index < up, or rtl_bounds_error().
+//
+// Inside a counted loop over the index, low <= from && to < up implies the
+// check. That test is loop invariant and guards the check; with constant
+// bounds it folds to true. Whether the body keeps the index in range is
+// known only at its end, so the guard is one of the loop's range_guards.
+//
+static void generate_range_check(Value *index, Value *low, Value *up)
+{
+    // one unsigned compare covers both bounds
+    Value *offset = Builder().CreateSub(index, low, "bounds_offset");
+    Value *extent = Builder().CreateSub(up, low, "bounds_extent");
+    Value *in_bounds = Builder().CreateICmpULT(offset, extent, "in_bounds");
+
+    BasicBlock *ok = BasicBlock::Create(TheContext(), "in_bounds", get_current_function());
+    BasicBlock *error = BasicBlock::Create(TheContext(), "bounds_error", get_current_function());
+    Builder().CreateCondBr(in_bounds, ok, error);
+    Builder().SetInsertPoint(error);
+    generate_rtl_call("bounds_error", {index, low, Builder().CreateSub(up, Const(1))});
+    Builder().CreateUnreachable();
+    Builder().SetInsertPoint(ok);
+}
+
+// a guard that is always taken: the check it guards is not needed
+static void drop_range_check(BranchInst *guard)
+{
+    BasicBlock *check = guard->getSuccessor(1);
+    SmallVector<BasicBlock *, 3> dead{check};
+    dead.append(succ_begin(check), succ_end(check)); // in_bounds, bounds_error
+
+    BranchInst::Create(guard->getSuccessor(0), guard);
+    guard->eraseFromParent();
+    DeleteDeadBlocks(dead);
+    ++S().stats.bounds_checks_elided;
+}
+
+static void generate_bounds_check(Value *index, Value *low, Value *up)
+{
+    Function *F = get_current_function();
+
+    ++S().stats.bounds_checks;
+    if (auto loop = counted_loop_of(index)) {
+        Value *implied = Builder().CreateAnd(Builder().CreateICmpSLE(low, loop->from),
+                                             Builder().CreateICmpSLT(loop->to, up), "range_in_bounds");
+        if (loop->step > 1) // to + step must not wrap around
+            implied = Builder().CreateAnd(
+                implied, Builder().CreateICmpSLE(loop->to, Const(INT32_MAX - loop->step)));
+
+        BasicBlock *range_ok = BasicBlock::Create(TheContext(), "range_ok", F);
+        BasicBlock *check = BasicBlock::Create(TheContext(), "bounds_check", F);
+        loop->range_guards.push_back(Builder().CreateCondBr(implied, range_ok, check));
+        Builder().SetInsertPoint(check);
+        generate_range_check(index, low, up);
+        Builder().CreateBr(range_ok);
+        Builder().SetInsertPoint(range_ok);
+        return;
+    }
 
-    Value *zero = Builder.getInt32(0);
+    generate_range_check(index, low, up);
+}
+
+//
+//  Address of a[i][j]...: data + sum((index - low) * stride)
+//  The arithmetic is nsw, so that SCEV sees an affine function of the loop
+//  induction variables and LSR can turn the access into a pointer increment.
+//
+//  NOTE: indexes are in reverse order
+//
+Value *generate_element_address(Value *sym, std::vector<Value *> const &indexes)
+{
     StructType *arr_type = array_get_type(sym);
+    if (!arr_type) {
+        syntax_error("subscripted value is not an array");
+        return 0;
+    }
     Type *arr_elem_type = array_get_elem_type(arr_type);
 
+    size_t ndims = cast<ArrayType>(arr_type->getElementType(0))->getNumElements() / array_t::dim_size;
+    if (indexes.size() > ndims) {
+        syntax_error("too many indexes for an array of " + std::to_string(ndims) + " dimension(s)");
+        return 0;
+    }
+
+    array_descriptor_t descr = get_array_descriptor(sym, indexes.size());
+
     Value *I = Const(0);
-    Value *R = Const(0);
-    for (int i = 0; i != indexes.size(); ++i) {
-
-        auto LB = Builder.CreateGEP(arr_type, sym,
-                                    {zero, zero, Const(i * array_t::dim_size + array_t::low_bound)},
-                                    "lb_addr"); // low bound
-        LB = Builder.CreateLoad(Type::getInt32Ty(TheContext), LB, "lb");
-
-        R = indexes[indexes.size() - i - 1]; // index
-        R = Builder.CreateSub(R, LB, "r_lb");
-        auto S = Builder.CreateGEP(arr_type, sym,
-                                   {zero, zero, Const(i * array_t::dim_size + array_t::stride)},
-                                   "stride_gep"); // stride
-        S = Builder.CreateLoad(Type::getInt32Ty(TheContext), S, "stride");
-        R = Builder.CreateMul(R, S, "r_mul_s");
-        I = Builder.CreateAdd(I, R, "i_add_r");
-    }
-
-    auto L =
-        Builder.CreateGEP(arr_type, sym, {zero, Const(1)}, "data_base_addr"); // data base address
-    Type *ptr_type = PointerType::getUnqual(arr_elem_type);
-    L = Builder.CreateLoad(ptr_type, L, "array_start");
-    auto a_ij = Builder.CreateGEP(arr_elem_type, L, {I}, "a_ij");
-    val = Builder.CreateLoad(arr_elem_type, a_ij, "load_a_ij");
+    for (size_t i = 0; i != indexes.size(); ++i) {
+        Value *R = indexes[indexes.size() - i - 1]; // index
+        if (S().options.check_bounds)
+            generate_bounds_check(R, descr.low[i], descr.up[i]);
+        R = Builder().CreateNSWSub(R, descr.low[i], "r_lb");
+        R = Builder().CreateNSWMul(R, descr.stride[i], "r_mul_s");
+        I = i ? Builder().CreateNSWAdd(I, R, "i_add_r") : R;
+    }
 
-    return val;
+    return Builder().CreateInBoundsGEP(arr_elem_type, descr.data, {I}, "a_ij");
+}
+
+//
+//  NOTE: indexes are in reverse order
+//
+Value *generate_aij(Value *sym, std::vector<Value *> const &indexes)
+{
+    Type *arr_elem_type = array_get_elem_type(array_get_type(sym));
+    Value *a_ij = generate_element_address(sym, indexes);
+    if (!a_ij)
+        return 0;
+    return Builder().CreateLoad(arr_elem_type, a_ij, "load_a_ij");
 }
 
 //
@@ -826,79 +1313,124 @@ Value *generate_aij(TreeNode *node1, TreeNode *node2)
     return val;
 }
 
-Value *generate_expr(TreeNode *expr)
+Value *generate_binary_expr(TreeBinaryNode *bp)
 {
-    Value *val = 0;
+    switch (bp->oper) {
+    case CALLSYM:
+        return generate_call(bp->left, bp->right);
+    case LBRACK:
+        return generate_aij(bp->left, bp->right);
+    case PERIOD:
+        return generate_dot_load(bp);
+    case CONCAT:
+        return generate_concat(bp);
+    case SUBSTR:
+        return generate_substr(bp);
+    }
 
-    if (flag_verbose)
-        errs() << "generate_expr: " << typeid(*expr).name() << '\n';
-
-    if (auto bp = dynamic_cast<TreeBinaryNode *>(expr)) {
-        if (bp->oper == CALLSYM)
-            val = generate_call(bp->left, bp->right);
-        else if (bp->oper == LBRACK)
-            val = generate_aij(bp->left, bp->right);
-        else if (bp->oper == PERIOD)
-            val = generate_dot_load(bp);
-        else {
-            Value *L = generate_expr(expr->left);
-            Value *R = generate_expr(expr->right);
-            if (bp->oper == PLUS)
-                val = generate_add(L, R);
-            else if (bp->oper == MINUS)
-                val = generate_sub(L, R);
-            else if (bp->oper == TIMES)
-                val = generate_mul(L, R);
-            else if (bp->oper == SLASH)
-                val = generate_div(L, R);
-            else if (bp->oper == GTR)
-                val = generate_compare_gtr_expr(L, R);
-            else if (bp->oper == LEQ)
-                val = generate_compare_leq_expr(L, R);
-            else if (bp->oper == LSS)
-                val = generate_compare_lss_expr(L, R);
-            else if (bp->oper == GEQ)
-                val = generate_compare_geq_expr(L, R);
-            else if (bp->oper == EQL)
-                val = generate_compare_eql_expr(L, R);
-            else if (bp->oper == AND)
-                val = Builder.CreateAnd(L, R, "andtmp");
-            else if (bp->oper == OR)
-                val = Builder.CreateOr(L, R, "ortmp");
-            else
-                errs() << "Not implemented op: " << token_to_string(bp->oper) << "\n";
-        }
-    } else if (auto up = dynamic_cast<TreeUnaryNode *>(expr)) {
-        Value *L = generate_expr(expr->left);
-        if (up->oper == MINUS) {
-            if (L->getType()->isFloatingPointTy())
-                val = Builder.CreateFNeg(L, "fneg");
-            else
-                val = Builder.CreateNeg(L, "neg");
-        } else if (up->oper == FIX) {
+    // both operands are of one type, see analyze_expression(); the
+    // comparisons of reals are unordered
+    Value *L = generate_expr(bp->left);
+    Value *R = generate_expr(bp->right);
+    bool real = bp->left->type == VALUE_REAL;
+    switch (bp->oper) {
+    case PLUS:
+        return real ? Builder().CreateFAdd(L, R, "add") : Builder().CreateAdd(L, R, "add");
+    case MINUS:
+        return real ? Builder().CreateFSub(L, R, "fsub") : Builder().CreateSub(L, R, "sub");
+    case TIMES:
+        return real ? Builder().CreateFMul(L, R, "fmul") : Builder().CreateMul(L, R, "mul");
+    case SLASH:
+        return real ? Builder().CreateFDiv(L, R, "fdiv") : Builder().CreateSDiv(L, R, "div");
+    case MOD:
+        return Builder().CreateSRem(L, R, "mod");
+    case GTR:
+        return real ? Builder().CreateFCmpUGT(L, R, "gtr") : Builder().CreateICmpSGT(L, R, "gtr");
+    case LEQ:
+        return real ? Builder().CreateFCmpULE(L, R, "leq") : Builder().CreateICmpSLE(L, R, "leq");
+    case LSS:
+        return real ? Builder().CreateFCmpULT(L, R, "cmptmp") : Builder().CreateICmpSLT(L, R, "cmptmp");
+    case GEQ:
+        return real ? Builder().CreateFCmpUGE(L, R, "geq") : Builder().CreateICmpSGE(L, R, "geq");
+    case EQL:
+        return real ? Builder().CreateFCmpUEQ(L, R, "cmptmp") : Builder().CreateICmpEQ(L, R, "cmptmp");
+    case NEQ:
+        return real ? Builder().CreateFCmpUNE(L, R, "neq") : Builder().CreateICmpNE(L, R, "neq");
+    case AND:
+        return Builder().CreateAnd(L, R, "andtmp");
+    case OR:
+        return Builder().CreateOr(L, R, "ortmp");
+    case XOR:
+        return Builder().CreateXor(L, R, "xortmp");
+    }
+    errs() << "Not implemented op: " << token_to_string(bp->oper) << "\n";
+    return 0;
+}
+
+Value *generate_unary_expr(TreeUnaryNode *up)
+{
+    Value *L = generate_expr(up->left);
+    if (!L)
+        return 0;
+    switch (up->oper) {
+    case LENGTH:
+        return generate_string_length(L);
+    case CHARACTER:
+        return generate_rtl_call("string_character", {L});
+    case MINUS:
+        if (up->type == VALUE_REAL)
+            return Builder().CreateFNeg(L, "fneg");
+        return Builder().CreateNeg(L, "neg");
+    case NOT:
+        return Builder().CreateNot(L, "not");
+    case FIX:
 #if 0
-            val = generate_rtl_call("fix", {L});
+        return generate_rtl_call("fix", {L});
 #else
-            val = Builder.CreateFPToSI(L, Type::getInt32Ty(TheContext), "fix");
+        return Builder().CreateFPToSI(L, Type::getInt32Ty(TheContext()), "fix");
 #endif
-        } else if (up->oper == FLOAT) {
-            val = Builder.CreateSIToFP(L, Type::getDoubleTy(TheContext), "float");
-        } else {
-            errs() << "Unary oper " << token_to_string(up->oper) << " is not implemented\n";
-        }
-    } else if (auto np = dynamic_cast<TreeNumericalNode *>(expr)) {
-        val = ConstantInt::get(Type::getInt32Ty(TheContext), np->num);
-    } else if (auto np = dynamic_cast<TreeDNumericalNode *>(expr)) {
-        val = ConstantFP::get(Type::getDoubleTy(TheContext), np->num);
-    } else if (auto node = dynamic_cast<TreeIdentNode *>(expr)) {
-        val = generate_load(node);
-    } else if (auto node = dynamic_cast<TreeTextNode *>(expr)) {
-        val = allocate_string_constant(node);
-    } else if (auto np = dynamic_cast<TreeBooleanNode *>(expr)) {
-        val = ConstantInt::get(Type::getInt1Ty(TheContext), np->num);
-    } else {
-        errs() << "Non-supported: " << typeid(*expr).name() << '\n';
-        ;
+    case FLOAT:
+        return Builder().CreateSIToFP(L, Type::getDoubleTy(TheContext()), "float");
+    }
+    errs() << "Unary oper " << token_to_string(up->oper) << " is not implemented\n";
+    return 0;
+}
+
+Value *generate_expr(TreeNode *expr)
+{
+    Value *val = 0;
+
+    if (S().options.verbose)
+        errs() << "generate_expr: " << expr->show() << '\n';
+
+    // a whole expression is analyzed before its code is generated
+    if (expr->type == VALUE_NONE)
+        expr = analyze_expression(expr);
+    if (expr->type == VALUE_ERROR)
+        return 0; // reported already
+
+    switch (expr->kind) {
+    case TREE_BINARY:
+        val = generate_binary_expr(cast<TreeBinaryNode>(expr));
+        break;
+    case TREE_UNARY:
+        val = generate_unary_expr(cast<TreeUnaryNode>(expr));
+        break;
+    case TREE_NUMBER:
+        val = ConstantInt::get(Type::getInt32Ty(TheContext()), cast<TreeNumericalNode>(expr)->num);
+        break;
+    case TREE_DNUMBER:
+        val = ConstantFP::get(Type::getDoubleTy(TheContext()), cast<TreeDNumericalNode>(expr)->num);
+        break;
+    case TREE_IDENT:
+        val = generate_load(cast<TreeIdentNode>(expr));
+        break;
+    case TREE_TEXT:
+        val = allocate_string_constant(cast<TreeTextNode>(expr));
+        break;
+    case TREE_BOOLEAN:
+        val = ConstantInt::get(Type::getInt1Ty(TheContext()), cast<TreeBooleanNode>(expr)->num);
+        break;
     }
 
     if (val == 0)
@@ -908,11 +1440,14 @@ Value *generate_expr(TreeNode *expr)
 
 void assign_statement(TreeNode *targets, TreeNode *expr)
 {
-    if (flag_verbose)
+    if (S().options.verbose)
         errs() << targets->show() << " = " << expr->show() << "\n";
 
-    Value *e = generate_expr(expr);
-    generate_store(targets, e);
+    expr = analyze_assignment(targets, expr);
+    if (!expr)
+        return; // reported already
+    if (Value *e = generate_expr(expr))
+        generate_store(targets, e);
 }
 
 TreeNode *base_type(int type)
@@ -920,21 +1455,21 @@ TreeNode *base_type(int type)
     return make_unary(0, type); // TODO: ....
 }
 
-void get_ids(TreeNode *vars, std::vector<std::string> &res)
+void get_ids(TreeNode *vars, std::vector<TreeIdentNode *> &res)
 {
     if (vars == 0)
         return;
-    if (auto bn = dynamic_cast<TreeBinaryNode *>(vars)) {
+    if (auto bn = dyn_cast_or_null<TreeBinaryNode>(vars)) {
         get_ids(bn->left, res);
         get_ids(bn->right, res);
-    } else if (auto id = dynamic_cast<TreeIdentNode *>(vars)) {
-        res.push_back(id->id);
+    } else if (auto id = dyn_cast_or_null<TreeIdentNode>(vars)) {
+        res.push_back(id);
     }
 }
 
 type_value_t create_alloca(Type *t, const char *s)
 {
-    Value *v = s ? Builder.CreateAlloca(t, 0, s) : 0;
+    Value *v = s ? Builder().CreateAlloca(t, 0, s) : 0;
     return type_value_t(t, v);
 }
 
@@ -943,10 +1478,9 @@ type_value_t create_alloca(Type *t, const char *s)
 ///
 std::string compose_tmp_struct_name()
 {
-    static size_t serial = 0;
 
     return std::string("struct_") + get_current_function()->getName().str() + "_" +
-           std::to_string(++serial);
+           std::to_string(++S().struct_serial);
 }
 
 void build_field_list(TreeNode *anode, std::vector<TreeNode *> &fields)
@@ -961,11 +1495,11 @@ void build_field_list(TreeNode *anode, std::vector<TreeNode *> &fields)
 
 std::string field_name(TreeNode *node)
 {
-    if (flag_verbose)
+    if (S().options.verbose)
         errs() << "field_name: " << node->show() << "\n";
     assert(node->oper == FIELD);
-    if (auto id = dynamic_cast<TreeIdentNode *>(node->left))
-        return id->id;
+    if (auto id = dyn_cast_or_null<TreeIdentNode>(node->left))
+        return std::string(id->id);
     return "<none>";
 }
 
@@ -974,37 +1508,51 @@ std::string field_name(TreeNode *node)
 ///
 symbol_type *construct_structure_type(TreeNode *node, std::string const &sname)
 {
-    symbol_type *stype = 0;
-
     std::vector<TreeNode *> fields;
     build_field_list(node, fields);
 
     std::vector<Type *> ftypes;
-    size_t off = 0;
-    for (TreeNode *fld : fields) {
-        auto fname = sname + "." + field_name(fld);
-        if (flag_verbose)
-            errs() << "FIELD: " << fname << "\n";
-        Type *ftype = node_to_type(fld->right);
-        ftypes.push_back(ftype);
-        auto off_value = Builder.getInt32(off++);
-        symbols_insert(fname, off_value);
-        if (flag_verbose)
-            off_value->dump();
+    for (TreeNode *fld : fields)
+        ftypes.push_back(node_to_type(fld->right));
+
+    // an identified type: the fields are bound to the structure declared,
+    // not to any other of the same layout
+    StructType *stype = StructType::create(TheContext(), ftypes, sname);
+    for (unsigned off = 0; off != fields.size(); ++off) {
+        if (S().options.verbose)
+            errs() << "FIELD: " << sname << "." << field_name(fields[off]) << " " << off << "\n";
+        symbol_t field(SYMBOL_FIELD, symbol_of(cast<TreeIdentNode>(fields[off]->left)));
+        field.type = stype;
+        field.field = off;
+        if (!S().symbols.insert(field))
+            syntax_error(field_name(fields[off]) + ": is a field already");
     }
 
-    stype = new symbol_type(sname, 0, CreateStructType(ftypes, sname));
-    return stype;
+    return new symbol_type(sname, 0, stype);
 }
 
 type_value_t node_to_type(TreeNode *node, const char *sym)
 {
-    if (node->oper == T_STRING)
-        return create_alloca(PointerType::getUnqual(Type::getInt8Ty(TheContext)), sym);
+    if (auto ident = dyn_cast<TreeIdentNode>(node)) {
+        symbol_t *type = S().symbols.find(symbol_of(ident), SYMBOL_TYPE);
+        if (!type) {
+            syntax_error(std::string(ident->id) + ": is not a type");
+            return create_alloca(Type::getInt32Ty(TheContext()), sym);
+        }
+        if (type->type)
+            return create_alloca(type->type, sym);
+        return node_to_type(type->definition, sym);
+    }
+    if (node->oper == T_STRING) {
+        auto tv = create_alloca(PointerType::getUnqual(Type::getInt8Ty(TheContext())), sym);
+        if (tv.second)
+            Builder().CreateStore(string_constant(""), tv.second); // never a null string
+        return tv;
+    }
     if (node->oper == T_REAL)
-        return create_alloca(Type::getDoubleTy(TheContext), sym);
+        return create_alloca(Type::getDoubleTy(TheContext()), sym);
     if (node->oper == T_BOOLEAN)
-        return create_alloca(Type::getInt1Ty(TheContext), sym);
+        return create_alloca(Type::getInt1Ty(TheContext()), sym);
     if (node->oper == ARRAY) {
         // array of arrays will be converted into multi-dimensional arrays
         std::vector<dimension_t> dims;
@@ -1013,7 +1561,7 @@ type_value_t node_to_type(TreeNode *node, const char *sym)
         do {
             auto bounds = node->left;
             auto L = generate_expr(bounds->left);
-            auto R = bounds->right ? generate_expr(bounds->right) : Builder.getInt32(1);
+            auto R = bounds->right ? generate_expr(bounds->right) : Builder().getInt32(1);
             dims.push_back(dimension_t(R, L));
             node = node->right;
         } while (node->oper == ARRAY);
@@ -1035,7 +1583,7 @@ type_value_t node_to_type(TreeNode *node, const char *sym)
         return create_alloca(type, sym);
     }
 
-    return create_alloca(Type::getInt32Ty(TheContext), sym);
+    return create_alloca(Type::getInt32Ty(TheContext()), sym);
 }
 
 Type *getArrayElementPointerTy(Type *array)
@@ -1050,42 +1598,100 @@ Type *getArrayElementPointerTy(Type *array)
 size_t getSizeofArrayElement(Type *type)
 {
     Type *pointer_type = getArrayElementPointerTy(type);
-    if (pointer_type == PointerType::getUnqual(Type::getInt32Ty(TheContext)))
+    if (pointer_type == PointerType::getUnqual(Type::getInt32Ty(TheContext())))
         return 4;
     return 8;
 }
 
 Value *Const(int c)
 {
-    return Builder.getInt32(c);
+    return Builder().getInt32(c);
+}
+
+//
+// Arrays of constant shape up to this many bytes live in the frame of the
+// declaring function instead of the heap.
+//
+static const uint64_t inline_array_limit = 4096;
+
+//
+// Storage for a small array of constant shape: a fixed-size alloca in the
+// entry block, so that a declaration inside a loop does not grow the stack,
+// zero-filled on every execution of the declaration like the memory of
+// rtl_allocate_array(). Not used in functions that return a structure, where
+// an array could outlive the frame. A function that stores arrays outside
+// its frame moves them to the arena, see move_inline_arrays().
+//
+static Value *allocate_inline_array(Type *elem_type, uint64_t n, uint64_t elem_size)
+{
+    BasicBlock &entry = get_current_function()->getEntryBlock();
+    IRBuilder<> TmpB(&entry, entry.begin());
+    Type *storage_type = ArrayType::get(elem_type, n);
+    AllocaInst *storage = TmpB.CreateAlloca(storage_type, 0, "array_data");
+
+    uint64_t size = TheModule()->getDataLayout().getTypeAllocSize(storage_type);
+    CallInst *fill = Builder().CreateMemSet(storage, Builder().getInt8(0), size, storage->getAlign());
+    Value *data = Builder().CreateConstInBoundsGEP2_32(storage_type, storage, 0, 0);
+    S().functions.back().inline_arrays.push_back({storage, fill, data, n, elem_size});
+    return data;
+}
+
+//
+// A function that stores whole arrays or structures outside its frame, into
+// a parameter passed by reference or a variable of an enclosing function,
+// or calls one that does, may store one of its own arrays there, where it
+// outlives the frame. Which ones is not known, all of its arrays are
+// allocated from the arena instead, which it does not release then. The
+// program's frame outlives any other.
+//
+static void move_inline_arrays(FunctionContext &ctx)
+{
+    for (auto &a : ctx.inline_arrays) {
+        IRBuilder<> B(a.fill);
+        Value *mem = B.CreateCall(S().rtl_symbols["allocate_array"], {Const(a.n), Const(a.size)});
+        a.data->replaceAllUsesWith(B.CreatePointerCast(mem, a.data->getType()));
+        if (auto data = dyn_cast<Instruction>(a.data))
+            data->eraseFromParent();
+        auto dest = dyn_cast<Instruction>(a.fill->getArgOperand(0));
+        a.fill->eraseFromParent();
+        if (dest && dest != a.storage && dest->use_empty())
+            dest->eraseFromParent(); // a cast, with typed pointers
+        if (a.storage->use_empty())
+            a.storage->eraseFromParent();
+    }
+    ctx.inline_arrays.clear();
 }
 
 Value *initialize_array_type(Type *type, std::vector<dimension_t> const &dims, const char *sym)
 {
-    Value *val = Builder.CreateAlloca(type, 0, sym);
+    Value *val = Builder().CreateAlloca(type, 0, sym);
     StructType *struct_type = cast<StructType>(type);
 
-    Value *total = Builder.getInt32(1);
+    Value *total = Builder().getInt32(1);
     std::stack<Value *> strides;
+    array_descriptor_t descr;
+    descr.stride.resize(dims.size());
 
     for (int i = 0; i != dims.size(); ++i) {
         auto Low = dims[i].low;
         auto Up = dims[i].up;
+        descr.low.push_back(Low);
 
-        auto pos = Builder.CreateGEP(
+        auto pos = Builder().CreateGEP(
             struct_type, val,
             {Const(0), Const(0), Const(i * array_t::dim_size + array_t::low_bound)});
-        Builder.CreateStore(Low, pos);
+        Builder().CreateStore(Low, pos);
 
-        pos = Builder.CreateGEP(
+        pos = Builder().CreateGEP(
             struct_type, val,
             {Const(0), Const(0), Const(i * array_t::dim_size + array_t::up_bound)});
-        Up = Builder.CreateAdd(Up, Const(1));
-        Builder.CreateStore(Up, pos);
+        Up = Builder().CreateAdd(Up, Const(1));
+        Builder().CreateStore(Up, pos);
+        descr.up.push_back(Up);
 
-        auto len = Builder.CreateSub(Up, Low);
+        auto len = Builder().CreateSub(Up, Low);
         strides.push(len);
-        total = Builder.CreateMul(total, len);
+        total = Builder().CreateMul(total, len);
     }
 
     Value *stride = Const(1);
@@ -1093,20 +1699,33 @@ Value *initialize_array_type(Type *type, std::vector<dimension_t> const &dims, c
     for (int i = dims.size(); i--;) {
         int off = i * array_t::dim_size;
         auto pos =
-            Builder.CreateGEP(struct_type, val, {Const(0), Const(0), Const(off + array_t::stride)});
-        Builder.CreateStore(stride, pos);
+            Builder().CreateGEP(struct_type, val, {Const(0), Const(0), Const(off + array_t::stride)});
+        Builder().CreateStore(stride, pos);
+        descr.stride[i] = stride;
         if (i) {
-            stride = Builder.CreateMul(stride, strides.top());
+            stride = Builder().CreateMul(stride, strides.top());
             strides.pop();
         }
     }
 
     size_t sz = getSizeofArrayElement(type);
 
-    auto array_mem = generate_rtl_call("allocate_array", {total, Builder.getInt32(sz)});
-    array_mem = Builder.CreatePointerCast(array_mem, getArrayElementPointerTy(type));
-    auto pos = Builder.CreateStructGEP(struct_type, val, 1);
-    Builder.CreateStore(array_mem, pos);
+    Value *array_mem = 0;
+    auto n = dyn_cast<ConstantInt>(total);
+    if (n && n->getZExtValue() * sz <= inline_array_limit &&
+        !get_current_function()->getReturnType()->isStructTy()) {
+        array_mem = allocate_inline_array(array_get_elem_type(struct_type), n->getZExtValue(), sz);
+    } else {
+        open_arena_scope();
+        array_mem = generate_rtl_call("allocate_array", {total, Builder().getInt32(sz)});
+        array_mem = Builder().CreatePointerCast(array_mem, getArrayElementPointerTy(type));
+    }
+    auto pos = Builder().CreateStructGEP(struct_type, val, 1);
+    Builder().CreateStore(array_mem, pos);
+
+    descr.data = array_mem;
+    descr.loops = S().loops.size();
+    S().array_descriptors[val] = descr;
     return val;
 }
 
@@ -1117,16 +1736,16 @@ Type *node_to_type(TreeNode *type)
 
 void variable_declaration(TreeNode *variables, TreeNode *type)
 {
-    if (flag_verbose)
+    if (S().options.verbose)
         errs() << "variable_declaration: type=" << type->show() << "\n";
 
-    std::vector<std::string> names;
+    std::vector<TreeIdentNode *> names;
     get_ids(variables, names);
-    for (auto s : names) {
+    for (auto ident : names) {
         // allocate memory for the variable of the type
-        Value *symb = generate_alloca(type, s);
-        auto res = symbols_insert(s, symb);
-        assert(res);
+        Value *symb = generate_alloca(type, std::string(ident->id));
+        if (!symbols_insert(symbol_of(ident), symb))
+            syntax_error(std::string(ident->id) + ": is declared already");
     }
 }
 
@@ -1137,102 +1756,188 @@ Value *generate_alloca(TreeNode *type, std::string const &s)
 
 Value *generate_rtl_call(const char *entry, std::vector<Value *> const &args)
 {
-    auto pos = rtl_symbols.find(entry);
+    auto pos = S().rtl_symbols.find(entry);
     Value *val = 0;
-    if (pos != rtl_symbols.end()) {
+    if (pos != S().rtl_symbols.end()) {
         if (Function *function = dynamic_cast<Function *>(pos->second)) {
-            val = Builder.CreateCall(function, args, "calltmp");
+            val = Builder().CreateCall(function, args,
+                                     function->getReturnType()->isVoidTy() ? "" : "calltmp");
         }
     } else {
-        ++err_cnt;
+        ++S().err_cnt;
         errs() << "generate_rtl_call: " << entry << " not defined\n";
     }
     return val;
 }
 
-void generate_output_call(std::vector<Value *> const &val)
+//
+// type letter of an output item for rtl_output_list()
+//
+// the letter of an item of rtl_output_list() and rtl_input_list(), 0 if
+// the library does not write or read values of the type
+static char io_type_code(value_type_t type)
+{
+    switch (type) {
+    case VALUE_INTEGER:
+        return 'i';
+    case VALUE_REAL:
+        return 'r';
+    case VALUE_BOOLEAN:
+        return 'b';
+    case VALUE_STRING:
+        return 's';
+    default:
+        return 0;
+    }
+}
+
+void collect_output_items(TreeNode *expr, std::vector<TreeNode *> &items)
 {
-    if (val[0]->getType() == PointerType::getUnqual(Type::getInt8Ty(TheContext)))
-        generate_rtl_call("output_str", val);
-    else if (val[0]->getType() == Type::getDoubleTy(TheContext))
-        generate_rtl_call("output_real", val);
-    else if (val[0]->getType() == Type::getInt1Ty(TheContext))
-        generate_rtl_call("output_bool", val);
-    else
-        generate_rtl_call("output", val);
+    auto node = dyn_cast_or_null<TreeBinaryNode>(expr);
+    if (node && node->oper == COMMA) {
+        collect_output_items(node->left, items);
+        collect_output_items(node->right, items);
+    } else {
+        items.push_back(analyze_expression(expr));
+    }
 }
 
+//
+// The whole output list goes to the run-time library in one call:
+// rtl_output_list("<type letters>", item, ...)
+//
 TreeNode *make_output(TreeNode *expr, bool append_nl)
 {
-    //  make_output: 14TreeBinaryNode
-    //  make_output: 17TreeNumericalNode
-    //  make_output: 13TreeIdentNode
-
-    if (auto node = dynamic_cast<TreeBinaryNode *>(expr)) {
-        if (node->oper == COMMA) {
-            std::vector<Value *> val {generate_expr(node->left)};
-            generate_output_call(val);
-            make_output(node->right);
-        } else {
-            std::vector<Value *> val {generate_expr(node)};
-            generate_output_call(val);
+    std::vector<TreeNode *> items;
+    collect_output_items(expr, items);
+
+    std::string types;
+    std::vector<Value *> args {0};
+    for (auto item : items) {
+        if (item->type == VALUE_ERROR)
+            continue; // reported already
+        char code = io_type_code(item->type);
+        if (!code) {
+            syntax_error("cannot output " + item->show());
+            continue;
         }
-    } else {
-        std::vector<Value *> val {generate_expr(expr)};
-        generate_output_call(val);
+        Value *val = generate_expr(item);
+        if (!val)
+            continue;
+        if (code == 'b')
+            val = Builder().CreateZExt(val, Type::getInt32Ty(TheContext())); // C promotion
+        types += code;
+        args.push_back(val);
+    }
+    if (append_nl)
+        types += 'n';
+
+    args[0] = Builder().CreateGlobalStringPtr(types, "output_types");
+    generate_rtl_call("output_list", args);
+
+    return 0;
+}
+
+static void collect_input_targets(TreeNode *targets, std::vector<TreeNode *> &items)
+{
+    auto node = dyn_cast_or_null<TreeBinaryNode>(targets);
+    if (node && node->oper == COMMA) {
+        collect_input_targets(node->left, items);
+        collect_input_targets(node->right, items);
+    } else if (targets) {
+        items.push_back(targets);
     }
+}
 
-    if (append_nl) {
-        std::vector<Value *> val(0); // no args
-        generate_rtl_call("output_nl", val);
+//
+// The whole input list is read by the run-time library in one call:
+// rtl_input_list("<type letters>", &target, ...)
+//
+TreeNode *make_input(TreeNode *targets)
+{
+    std::vector<TreeNode *> items;
+    collect_input_targets(targets, items);
+
+    std::string types;
+    std::vector<Value *> args {0};
+    for (auto target : items) {
+        if (analyze_expression(target)->type == VALUE_ERROR)
+            continue; // reported already
+        char code = io_type_code(target->type);
+        if (!code) {
+            syntax_error("cannot input " + target->show());
+            continue;
+        }
+        Value *lvalue = generate_lvalue(target);
+        if (!lvalue)
+            continue;
+        types += code;
+        args.push_back(lvalue);
+        for (auto &loop : S().loops)
+            loop.assigned.insert(lvalue);
+        if (target->type == VALUE_STRING) {
+            open_arena_scope();
+            note_arena_store(lvalue);
+        }
     }
+    if (args.size() == 1)
+        return 0;
+
+    args[0] = Builder().CreateGlobalStringPtr(types, "input_types");
+    generate_rtl_call("input_list", args);
 
     return 0;
 }
 
+//
+// Write out what is left in the output buffer before main returns.
+//
+void flush_output()
+{
+    Function *F = get_current_function();
+
+    for (auto &BB : *F)
+        if (auto ret = dyn_cast<ReturnInst>(BB.getTerminator()))
+            CallInst::Create(S().rtl_symbols["output_flush"], {}, "", ret);
+}
+
 Function *get_current_function()
 {
-    return functions.size() ? functions.top().F : 0;
+    return S().functions.size() ? S().functions.back().F : 0;
 }
 
 void cond_specification(TreeNode *expr)
 {
     auto if_stat = IfStatement(get_current_function());
 
-    conditionals.push(if_stat);
-    Value *Compare = generate_expr(expr);
+    S().conditionals.push(if_stat);
+    expr = analyze_expression(expr);
 
-    Value *Condtn {};
-    if (Compare->getType() == Type::getInt1Ty(TheContext)) {
-        Value *Zero = Builder.getInt1(false);
-        Condtn = Builder.CreateICmpNE(Compare, Zero, "ifcond");
-#if 0
-    } else if(Compare->getType() == Type::getInt32Ty(TheContext)) {
-        Value *Zero = Builder.getInt32(0);
-        Condtn = Builder.CreateICmpNE(Compare, Zero, "ifcond");
-#endif
+    if (expr->type == VALUE_BOOLEAN) {
+        Value *Zero = Builder().getInt1(false);
+        Value *Condtn = Builder().CreateICmpNE(generate_expr(expr), Zero, "ifcond");
+        Builder().CreateCondBr(Condtn, if_stat.ThenBB, if_stat.ElseBB);
     } else {
-        syntax_error("Must be boolean type");
-    }
-    if (Condtn) {
-        Builder.CreateCondBr(Condtn, if_stat.ThenBB, if_stat.ElseBB);
-        Builder.SetInsertPoint(if_stat.ThenBB);
+        if (expr->type != VALUE_ERROR)
+            syntax_error("Must be boolean type");
+        Builder().CreateBr(if_stat.ThenBB);
     }
+    Builder().SetInsertPoint(if_stat.ThenBB);
 }
 
 void false_branch_begin()
 {
-    auto &cond = conditionals.top();
-    Builder.CreateBr(cond.MergeBB);
-    Builder.SetInsertPoint(cond.ElseBB);
+    auto &cond = S().conditionals.top();
+    Builder().CreateBr(cond.MergeBB);
+    Builder().SetInsertPoint(cond.ElseBB);
 }
 
 void false_branch_end()
 {
-    auto &cond = conditionals.top();
+    auto &cond = S().conditionals.top();
 
-    Builder.CreateBr(cond.MergeBB);
-    Builder.SetInsertPoint(cond.MergeBB);
+    Builder().CreateBr(cond.MergeBB);
+    Builder().SetInsertPoint(cond.MergeBB);
 
     simple_cond_statement();
 }
@@ -1240,18 +1945,30 @@ void false_branch_end()
 // if <cond> then <true-branch> fi;
 void true_branch_end()
 {
-    auto &cond = conditionals.top();
-    Builder.CreateBr(cond.ElseBB);
-    Builder.SetInsertPoint(cond.ElseBB);
-    Builder.CreateBr(cond.MergeBB);
-    Builder.SetInsertPoint(cond.MergeBB);
+    auto &cond = S().conditionals.top();
+    Builder().CreateBr(cond.ElseBB);
+    Builder().SetInsertPoint(cond.ElseBB);
+    Builder().CreateBr(cond.MergeBB);
+    Builder().SetInsertPoint(cond.MergeBB);
 
     simple_cond_statement();
 }
 
 void simple_cond_statement()
 {
-    conditionals.pop();
+    S().conditionals.pop();
+}
+
+//
+// The step of a loop if it is a positive integer constant (1 if there is no
+// step), 0 otherwise
+//
+static int64_t constant_step(TreeNode *expr_step)
+{
+    if (!expr_step)
+        return 1;
+    auto number = dyn_cast<TreeNumericalNode>(expr_step);
+    return number && number->num > 0 ? number->num : 0;
 }
 
 //
@@ -1259,76 +1976,123 @@ void simple_cond_statement()
 //     loop_target: i
 //     control: FOR(TO(1 BY(<null> 10)) while-cond)
 //
-//   MergeBB:
-//           if NOT while-cond goto ElseBB;
-//           if (index > to) goto ElseBB;
+// is lowered to a loop in LLVM's canonical form, so that the loop passes
+// (LICM, unrolling, the vectorizers) apply:
+//
+//           index = from;                 (preheader)
+//           to' = to; by' = by;
+//   for_cond:
+//           if NOT while-cond goto for_end;
+//           if (index > to') goto for_end;
 //
 //           <loop-body>
-//   ThenBB:
-//           index = index + by;
-//           goto MergeBB;
-//   ElseBB:
+//   for_inc:                              the only latch, target of repeat
+//           index = index + by';
+//           goto for_cond;                !llvm.loop
+//   for_end:                              target of repent
 //
+// to and by are evaluated again in for_inc only if the body may have
+// changed them (see loop_invariant()), as EASY evaluates them on every
+// iteration.
 //
 void loop_head(TreeNode *loop_target, TreeNode *control)
 {
-    if (flag_verbose) {
+    if (S().options.verbose) {
         errs() << "loop_target: " << loop_target->show() << "\n";
         errs() << "control: " << control->show() << "\n";
     }
 
-    if (auto for_node = dynamic_cast<TreeBinaryNode *>(control)) {
-        TreeNode *expr_step = 0;
-        TreeNode *expr_to = 0;
-        if (for_node->oper == FOR) {
-            if (auto to_node = dynamic_cast<TreeBinaryNode *>(for_node->left)) {
-                Value *init_expr = generate_expr(to_node->left);
-                generate_store(loop_target, init_expr);
-
-                if (auto by_node = dynamic_cast<TreeBinaryNode *>(to_node->right)) {
-                    // by_node->oper == BY
-                    expr_step =
-                        by_node->left; // ? generate_expr(by_node->left) : Builder.getInt32(1);
-                    expr_to = by_node->right; // ? generate_expr(by_node->right) : 0;
-                }
+    auto for_node = dyn_cast_or_null<TreeBinaryNode>(control);
+    if (!for_node)
+        return; // Never here
+    if (for_node->oper != FOR) {
+        syntax_error("Unexpected operation = " + std::to_string(for_node->oper));
+        return;
+    }
+    auto to_node = dyn_cast_or_null<TreeBinaryNode>(for_node->left);
+    if (!to_node)
+        return;
 
-                auto if_stat = IfStatement(get_current_function());
-                conditionals.push(if_stat);
+    TreeNode *expr_step = 0;
+    TreeNode *expr_to = 0;
+    if (auto by_node = dyn_cast_or_null<TreeBinaryNode>(to_node->right)) {
+        // by_node->oper == BY
+        expr_step = by_node->left;
+        expr_to = by_node->right;
+    }
 
-                if (labels.size() && labels.top()->isForLoop()) {
-                    labels.top()->RepentBB = if_stat.ElseBB; // loop exit
-                    labels.top()->RepeatBB = if_stat.ThenBB; // loop continue
-                }
+    // from, to and by are of the type of the loop variable
+    value_type_t type = analyze_expression(loop_target)->type;
+    std::string what = "for " + loop_target->show();
+    if (TreeNode *from = analyze_conversion(to_node->left, type, what))
+        to_node->left = from;
+    if (TreeNode *step = expr_step ? analyze_conversion(expr_step, type, what + " by") : 0)
+        expr_step = step;
+    if (TreeNode *to = expr_to ? analyze_conversion(expr_to, type, what + " to") : 0)
+        expr_to = to;
+
+    // preheader
+    Value *init_expr = generate_expr(to_node->left);
+    generate_store(loop_target, init_expr);
+
+    auto loop_stat = LoopStatement(loop_target, expr_step, expr_to);
+    loop_stat.to = expr_to ? generate_expr(expr_to) : 0;
+    loop_stat.by = expr_step ? generate_expr(expr_step) : Builder().getInt32(1);
+    BasicBlock *preheader = Builder().GetInsertBlock();
+
+    Function *F = get_current_function();
+    loop_stat.HeaderBB = BasicBlock::Create(TheContext(), "for_cond", F);
+    loop_stat.EntryBB = loop_stat.HeaderBB;
+    loop_stat.LatchBB = BasicBlock::Create(TheContext(), "for_inc", F);
+    loop_stat.ExitBB = BasicBlock::Create(TheContext(), "for_end", F);
+
+    if (S().labels.size() && S().labels.top()->isForLoop() && !S().labels.top()->RepeatBB) {
+        S().labels.top()->RepentBB = loop_stat.ExitBB; // loop exit
+        S().labels.top()->RepeatBB = loop_stat.LatchBB; // loop continue
+    }
 
-                auto loop_stat = LoopStatement(loop_target, expr_step, expr_to);
-                loops.push(loop_stat);
-
-                Builder.CreateBr(if_stat.MergeBB);
-                Builder.SetInsertPoint(if_stat.MergeBB);
-                Value *index = generate_load(dynamic_cast<TreeIdentNode *>(loop_target));
-
-                if (auto cond_control = for_node->right) {
-                    // Generate "while(...)"
-                    auto cont = BasicBlock::Create(TheContext, "to_label", get_current_function());
-                    Value *cond_val = generate_expr(cond_control); // while(expr)
-                    Value *Zero = Builder.getInt1(false);
-                    Value *while_cond = Builder.CreateICmpNE(cond_val, Zero, "while_cond");
-                    Builder.CreateCondBr(while_cond, cont, if_stat.ElseBB);
-                    Builder.SetInsertPoint(cont);
-                }
+    if (auto target = dyn_cast_or_null<TreeIdentNode>(loop_target)) {
+        loop_stat.iv = dyn_cast_or_null<AllocaInst>(symbols_find(symbol_of(target)));
+        loop_stat.from = init_expr;
+        // a real variable may stop growing (x + 1 = x), it is not counted
+        loop_stat.step = type == VALUE_INTEGER ? constant_step(expr_step) : 0;
+    }
+    S().loops.push_back(loop_stat);
+    auto &loop = S().loops.back();
+
+    // header; loop_footer() keeps the phi only if the body changes the limit
+    Builder().CreateBr(loop.HeaderBB);
+    Builder().SetInsertPoint(loop.HeaderBB);
+    if (loop.to && !isa<Constant>(loop.to)) {
+        loop.to_phi = Builder().CreatePHI(loop.to->getType(), 2, "to");
+        loop.to_phi->addIncoming(loop.to, preheader);
+        loop.to = loop.to_phi;
+    }
 
-                if (expr_to) {
-                    auto cont = BasicBlock::Create(TheContext, "loop_body", get_current_function());
-                    Value *cmp = Builder.CreateICmpSLE(index, generate_expr(expr_to), "cmp");
-                    Builder.CreateCondBr(cmp, cont, if_stat.ElseBB);
-                    Builder.SetInsertPoint(cont);
-                }
-            }
+    if (auto cond_control = for_node->right) {
+        // Generate "while(...)"
+        auto cont = BasicBlock::Create(TheContext(), "to_label", F);
+        cond_control = analyze_expression(cond_control);
+        if (cond_control->type == VALUE_BOOLEAN) {
+            Value *cond_val = generate_expr(cond_control); // while(expr)
+            Value *Zero = Builder().getInt1(false);
+            Value *while_cond = Builder().CreateICmpNE(cond_val, Zero, "while_cond");
+            Builder().CreateCondBr(while_cond, cont, loop.ExitBB);
         } else {
-            syntax_error("Unexpected operation = " + std::to_string(for_node->oper));
+            if (cond_control->type != VALUE_ERROR)
+                syntax_error("Must be boolean type");
+            Builder().CreateBr(cont);
         }
-    } else {
-        // Never here
+        Builder().SetInsertPoint(cont);
+    }
+
+    if (loop.to && (type == VALUE_INTEGER || type == VALUE_REAL)) {
+        auto cont = BasicBlock::Create(TheContext(), "loop_body", F);
+        Value *index = generate_load(dyn_cast_or_null<TreeIdentNode>(loop_target));
+        Value *cmp = type == VALUE_REAL ? Builder().CreateFCmpOLE(index, loop.to, "cmp")
+                                        : Builder().CreateICmpSLE(index, loop.to, "cmp");
+        Builder().CreateCondBr(cmp, cont, loop.ExitBB);
+        Builder().SetInsertPoint(cont);
     }
 }
 
@@ -1340,6 +2104,56 @@ TreeNode *control(TreeNode *step_control, TreeNode *cond_control)
     return make_binary(step_control, cond_control, FOR);
 }
 
+//
+// An expression of constants and variables other than the loop variable
+// that the loop body has neither assigned nor (through a function call) may
+// have assigned
+//
+static bool loop_invariant(TreeNode *expr, LoopStatement const &loop)
+{
+    if (!expr)
+        return true;
+
+    switch (expr->kind) {
+    case TREE_NUMBER:
+    case TREE_DNUMBER:
+    case TREE_BOOLEAN:
+        return true;
+    case TREE_IDENT: {
+        auto var = dyn_cast_or_null<AllocaInst>(symbols_find(symbol_of(cast<TreeIdentNode>(expr))));
+        return var && var != loop.iv && !loop.calls && !loop.assigned.count(var);
+    }
+    case TREE_UNARY:
+        return loop_invariant(expr->left, loop);
+    case TREE_BINARY:
+        switch (expr->oper) {
+        case CALLSYM:
+        case LBRACK:
+        case PERIOD:
+            return false;
+        }
+        return loop_invariant(expr->left, loop) && loop_invariant(expr->right, loop);
+    default:
+        return false;
+    }
+}
+
+//
+// Loop properties for the back edge. A counted loop with a constant limit
+// terminates, which lets LLVM delete it if it has no effect.
+//
+static MDNode *loop_metadata(bool terminates)
+{
+    SmallVector<Metadata *, 2> properties;
+    properties.push_back(0); // the loop ID refers to itself
+    if (terminates)
+        properties.push_back(MDNode::get(TheContext(), MDString::get(TheContext(), "llvm.loop.mustprogress")));
+
+    MDNode *id = MDNode::getDistinct(TheContext(), properties);
+    id->replaceOperandWith(0, id);
+    return id;
+}
+
 //
 // ident (optional)
 //
@@ -1347,123 +2161,353 @@ void loop_footer(TreeNode *ident)
 {
     // TODO: verify ident == label
 
-    auto &cond = conditionals.top();
-    auto &loop = loops.top();
+    auto &loop = S().loops.back();
+    settle_loop_descriptors(loop, true);
+    bool to_invariant = loop_invariant(loop.To, loop);
+    // index + step cannot wrap: the index stays in [from, to] and to is at
+    // most INT32_MAX - step; a limit known only at run time may be larger
+    auto limit = dyn_cast_or_null<ConstantInt>(loop.to);
+    bool no_wrap = limit && loop.step && limit->getSExtValue() <= INT32_MAX - loop.step;
+    bool terminates = no_wrap && !loop.assigned.count(loop.iv);
+
+    // the body, or a function it calls, assigns the variable: the range
+    // implies none of the checks
+    for (auto guard : loop.range_guards) {
+        auto C = dyn_cast<ConstantInt>(guard->getCondition());
+        if (loop.assigned.count(loop.iv))
+            guard->setCondition(Builder().getFalse());
+        else if (C && C->isOne())
+            drop_range_check(guard);
+    }
 
-    // ThenBB:
+    // for_inc:
     //   index += step;
+    Builder().CreateBr(loop.LatchBB);
+    loop.LatchBB->moveAfter(Builder().GetInsertBlock());
+    Builder().SetInsertPoint(loop.LatchBB);
+    Value *by = loop_invariant(loop.By, loop) ? loop.by : generate_expr(loop.By);
+    Value *index = generate_load(dyn_cast_or_null<TreeIdentNode>(loop.Target));
+    if (terminates && by->getType() == index->getType())
+        index = Builder().CreateNSWAdd(index, by, "increment");
+    else
+        index = generate_add(index, by, "increment");
+    generate_store(loop.Target, index);
 
-    Builder.CreateBr(cond.ThenBB);
-    Builder.SetInsertPoint(cond.ThenBB);
-    Value *index = generate_load(dynamic_cast<TreeIdentNode *>(loop.Target));
+    if (loop.to_phi && to_invariant) {
+        loop.to_phi->replaceAllUsesWith(loop.to_phi->getIncomingValue(0));
+        loop.to_phi->eraseFromParent();
+    } else if (loop.to_phi) {
+        loop.to_phi->addIncoming(generate_expr(loop.To), Builder().GetInsertBlock());
+    }
+    Builder().CreateBr(loop.HeaderBB)->setMetadata(LLVMContext::MD_loop, loop_metadata(terminates));
 
-    //    index = Builder.CreateAdd(index, loop.By, "increment");
-    Value *loop_by = loop.By ? generate_expr(loop.By) : Builder.getInt32(1);
-    index = generate_add(index, loop_by, "increment");
-    generate_store(loop.Target, index);
-    Builder.CreateBr(cond.MergeBB);
+    loop.ExitBB->moveAfter(loop.LatchBB);
+    Builder().SetInsertPoint(loop.ExitBB);
+
+    S().loops.pop_back();
+}
+
+//
+// select expr of
+//     case s1 s2: <body1>
+//     case s3: <body2>
+//     otherwise: <body3>
+// end select;
+//
+// The select expression is evaluated where the statement starts; the
+// dispatch is added at the end of that block once all cases are known:
+//
+//   dispatch:
+//           switch expr [s1 -> case, s2 -> case, s3 -> case1], otherwise
+//   case:   <body1>; goto select_end
+//   case1:  <body2>; goto select_end
+//   otherwise:
+//           <body3>; goto select_end
+//   select_end:
+//
+// A switch needs integer constant selectors of the type of the expression;
+// LLVM lowers it to a jump table when the values are dense and to a binary
+// search otherwise. Any other selector makes the dispatch a chain of
+// comparisons, evaluated in order. In both cases the first matching case
+// is executed.
+//
+void select_header(TreeNode *expr)
+{
+    SelectStatement select;
+    expr = analyze_expression(expr);
+    select.type = expr->type;
+    if (select.type == VALUE_STRING || select.type == VALUE_ARRAY || select.type == VALUE_STRUCTURE)
+        syntax_error("select takes a number or a boolean");
+    else
+        select.value = generate_expr(expr);
+    select.DispatchBB = Builder().GetInsertBlock();
+    select.EndBB = BasicBlock::Create(TheContext(), "select_end", get_current_function());
+    S().selects.push(select);
+}
+
+// the selectors of a case, analyzed in place; numbers are compared as
+// numbers, see generate_compare_eql_expr()
+static void analyze_selectors(TreeNode *&selector, value_type_t type)
+{
+    if (selector->kind == TREE_BINARY && selector->oper == COMMA) {
+        analyze_selectors(selector->left, type);
+        analyze_selectors(selector->right, type);
+        return;
+    }
+    selector = analyze_expression(selector);
+    value_type_t own = selector->type;
+    bool numbers = (own == VALUE_INTEGER || own == VALUE_REAL) &&
+                   (type == VALUE_INTEGER || type == VALUE_REAL);
+    if (own != VALUE_ERROR && own != type && !numbers) {
+        syntax_error(selector->show() + ": expected " + value_type_name(type) + ", not " +
+                     value_type_name(own));
+        selector->type = VALUE_ERROR;
+    }
+}
+
+void select_case(TreeNode *selector)
+{
+    auto &select = S().selects.top();
+    if (select.value)
+        analyze_selectors(selector, select.type);
+    auto body = BasicBlock::Create(TheContext(), "case", get_current_function(), select.EndBB);
+    select.cases.emplace_back(selector, body);
+    Builder().SetInsertPoint(body);
+}
+
+void select_otherwise()
+{
+    auto &select = S().selects.top();
+    select.OtherwiseBB = BasicBlock::Create(TheContext(), "otherwise", get_current_function(), select.EndBB);
+    Builder().SetInsertPoint(select.OtherwiseBB);
+}
+
+void select_case_end()
+{
+    Builder().CreateBr(S().selects.top().EndBB);
+}
+
+// the selector list of one case, in order
+static void flatten_selector(TreeNode *selector, std::vector<TreeNode *> &selectors)
+{
+    if (selector && selector->kind == TREE_BINARY && selector->oper == COMMA) {
+        flatten_selector(selector->left, selectors);
+        flatten_selector(selector->right, selectors);
+    } else if (selector) {
+        selectors.push_back(selector);
+    }
+}
 
-    // Builder.CreateBr(cond.ElseBB);
-    Builder.SetInsertPoint(cond.ElseBB);
+//
+// The switch for select, or 0 if a selector is not an integer constant of
+// the type of the select expression
+//
+static SwitchInst *generate_select_switch(SelectStatement &select, BasicBlock *otherwise)
+{
+    if (!select.value->getType()->isIntegerTy())
+        return 0;
+
+    std::vector<std::pair<ConstantInt *, BasicBlock *>> labels;
+    for (auto const &c : select.cases) {
+        std::vector<TreeNode *> selectors;
+        flatten_selector(c.first, selectors);
+        for (auto selector : selectors) {
+            // folded by analyze_selectors()
+            if (!isa<TreeNumericalNode>(selector) && !isa<TreeBooleanNode>(selector))
+                return 0;
+            auto label = dyn_cast_or_null<ConstantInt>(generate_expr(selector));
+            if (!label || label->getType() != select.value->getType())
+                return 0;
+            labels.emplace_back(label, c.second);
+        }
+    }
+
+    auto sw = Builder().CreateSwitch(select.value, otherwise, labels.size());
+    for (auto const &label : labels)
+        if (sw->findCaseValue(label.first) == sw->case_default()) // the first case wins
+            sw->addCase(label.first, label.second);
+    ++S().stats.select_switches;
+    return sw;
+}
+
+static void generate_select_chain(SelectStatement &select, BasicBlock *otherwise)
+{
+    BasicBlock *first = select.cases.empty() ? otherwise : select.cases.front().second;
+    for (auto const &c : select.cases) {
+        std::vector<TreeNode *> selectors;
+        flatten_selector(c.first, selectors);
+        for (auto selector : selectors) {
+            Value *label = generate_expr(selector);
+            if (!label)
+                continue; // reported already
+            Value *match = generate_compare_eql_expr(select.value, label);
+            auto next = BasicBlock::Create(TheContext(), "select_next", get_current_function(), first);
+            Builder().CreateCondBr(match, c.second, next);
+            Builder().SetInsertPoint(next);
+        }
+    }
+    Builder().CreateBr(otherwise);
+    ++S().stats.select_chains;
+}
+
+void select_footer()
+{
+    auto &select = S().selects.top();
+    BasicBlock *otherwise = select.OtherwiseBB ? select.OtherwiseBB : select.EndBB;
+
+    Builder().SetInsertPoint(select.DispatchBB);
+    if (select.value && !generate_select_switch(select, otherwise))
+        generate_select_chain(select, otherwise);
+    else if (!select.value)
+        Builder().CreateBr(otherwise);
+
+    select.EndBB->moveAfter(&get_current_function()->back());
+    Builder().SetInsertPoint(select.EndBB);
+    S().selects.pop();
+}
+
+//
+// A label is bound in the scope around the labeled statement until its end,
+// see clear_label(). A label of an enclosing function is not visible.
+//
+static void insert_label(LabelStatement *label)
+{
+    symbol_t sym(SYMBOL_LABEL, label->label);
+    sym.label = label;
+    // TODO: make sure the label is unique
+    S().symbols.insert(sym);
+    S().labels.push(label);
+    label->segments = S().functions.back().segments.size();
+}
+
+// release the arena mark of the segments that a branch to label leaves
+static void leave_segments(LabelStatement *label)
+{
+    auto &ctx = S().functions.back();
 
-    conditionals.pop();
-    loops.pop();
+    if (label->segments < ctx.segments.size()) {
+        Value *none = ConstantPointerNull::get(PointerType::getUnqual(Type::getInt8Ty(TheContext())));
+        auto exit = cast<CallInst>(generate_rtl_call("arena_release", {none}));
+        ctx.segments[label->segments].exits.push_back(exit); // see segment_end()
+    }
+}
+
+static LabelStatement *find_label(TreeIdentNode *ident)
+{
+    symbol_t *sym = S().symbols.find(symbol_of(ident), SYMBOL_LABEL);
+    return sym && sym->level == S().functions.size() ? sym->label : 0;
 }
 
 // create a labelwhich preceed the for-loop
 void set_for_label(TreeNode *node)
 {
-    auto ident = dynamic_cast<TreeIdentNode *>(node);
+    auto ident = dyn_cast_or_null<TreeIdentNode>(node);
     assert(ident);
 
-    auto label = new LabelStatement(ident->id);
-    auto res = label_table.insert(std::make_pair(ident->id, label));
-    // TODO: make sure the label is unique
-    labels.push(label);
+    auto label = new LabelStatement(symbol_of(ident));
+    insert_label(label);
 }
 
 void set_label(TreeNode *node)
 {
-    auto ident = dynamic_cast<TreeIdentNode *>(node);
+    auto ident = dyn_cast_or_null<TreeIdentNode>(node);
     assert(ident);
 
-    auto label = new LabelStatement(get_current_function(), ident->id);
-    auto res = label_table.insert(std::make_pair(ident->id, label));
-    // TODO: make sure the label is unique
-    labels.push(label);
+    auto label = new LabelStatement(get_current_function(), symbol_of(ident));
+    insert_label(label);
 
-    Builder.CreateBr(label->RepeatBB);
-    Builder.SetInsertPoint(label->RepeatBB);
+    Builder().CreateBr(label->RepeatBB);
+    Builder().SetInsertPoint(label->RepeatBB);
+
+    // repeat makes the statement a loop
+    LoopStatement loop;
+    loop.EntryBB = label->RepeatBB;
+    S().loops.push_back(loop);
 }
 
 void clear_label()
 {
-    auto label = labels.top();
-    labels.pop();
+    auto label = S().labels.top();
+    S().labels.pop();
+
+    if (!label->isForLoop()) {
+        settle_loop_descriptors(S().loops.back(), label->RepeatBB->hasNPredecessorsOrMore(2));
+        S().loops.pop_back();
+    }
 
-    auto res = label_table.erase(label->label);
-    (void)res; // silence warnings
+    // the last binding, the statement's scopes are closed
+    S().symbols.erase(S().symbols.find(label->label, SYMBOL_LABEL));
     if (!label->isForLoop() && label->RepentBB) {
-        Builder.CreateBr(label->RepentBB);
-        Builder.SetInsertPoint(label->RepentBB);
+        Builder().CreateBr(label->RepentBB);
+        Builder().SetInsertPoint(label->RepentBB);
     }
 }
 
+//
+// Code that follows return/repeat/repent is unreachable. It gets a block of
+// its own, so the current block ends with exactly one terminator.
+//
+void start_unreachable_block(const char *name)
+{
+    Builder().SetInsertPoint(BasicBlock::Create(TheContext(), name, get_current_function()));
+}
+
 void make_repent(TreeNode *node)
 {
-    auto ident = dynamic_cast<TreeIdentNode *>(node);
+    auto ident = dyn_cast_or_null<TreeIdentNode>(node);
     assert(ident);
 
-    auto pos = label_table.find(ident->id);
-    if (pos != label_table.end()) {
-        LabelStatement *label = pos->second;
-        Builder.CreateBr(label->getRepentBB());
+    if (LabelStatement *label = find_label(ident)) {
+        leave_segments(label);
+        Builder().CreateBr(label->getRepentBB());
+        start_unreachable_block("after_repent");
     } else {
         // syntax error, label not found
-        syntax_error(ident->id + ": label is unknown");
+        syntax_error(std::string(ident->id) + ": label is unknown");
     }
 }
 
 void make_repeat(TreeNode *node)
 {
-    auto ident = dynamic_cast<TreeIdentNode *>(node);
+    auto ident = dyn_cast_or_null<TreeIdentNode>(node);
     assert(ident);
 
-    auto pos = label_table.find(ident->id);
-    if (pos != label_table.end()) {
-        LabelStatement *label = pos->second;
-        Builder.CreateBr(label->RepeatBB);
+    if (LabelStatement *label = find_label(ident)) {
+        leave_segments(label);
+        Builder().CreateBr(label->RepeatBB);
+        start_unreachable_block("after_repeat");
     } else {
         // syntax error, label not found
-        syntax_error(ident->id + ": label is unknown");
+        syntax_error(std::string(ident->id) + ": label is unknown");
     }
 }
 
+//
+// Parameters declared with NAME, arrays and structures are passed by
+// reference, as a pointer to the storage of the actual argument; an array is
+// passed as a pointer to its descriptor, the elements are never copied.
+//
 void get_proc_arguments(TreeNode *lst, std::vector<Type *> &arg_types,
-                        std::vector<std::string> &arg_names)
+                        std::vector<TreeIdentNode *> &arg_names, std::vector<bool> &by_reference)
 {
     if (lst) {
-        auto cp = dynamic_cast<TreeBinaryNode *>(lst);
+        auto cp = dyn_cast_or_null<TreeBinaryNode>(lst);
         assert(cp);
 
         if (cp->oper == COMMA) {
-            get_proc_arguments(cp->left, arg_types, arg_names);
-            get_proc_arguments(cp->right, arg_types, arg_names);
-        } else if (cp->oper == IDENT) {
-            arg_names.push_back(dynamic_cast<TreeIdentNode *>(cp->left)->id);
-            arg_types.push_back(node_to_type(cp->right));
-        } else if (cp->oper == NAME) {
-            // TODO: set flag "pass by name"
-            arg_names.push_back(dynamic_cast<TreeIdentNode *>(cp->left)->id);
-            arg_types.push_back(node_to_type(cp->right));
+            get_proc_arguments(cp->left, arg_types, arg_names, by_reference);
+            get_proc_arguments(cp->right, arg_types, arg_names, by_reference);
+        } else if (cp->oper == IDENT || cp->oper == NAME) {
+            Type *type = node_to_type(cp->right);
+            arg_names.push_back(cast<TreeIdentNode>(cp->left));
+            arg_types.push_back(type);
+            by_reference.push_back(cp->oper == NAME || type->isStructTy());
         } else {
             assert("Impossible!" == 0);
         }
     }
 }
 
-std::stack<BasicBlock *> jumps;
-
 //
 //    (FUNCTION,
 //          (PROCEDURE,
@@ -1475,63 +2519,433 @@ std::stack<BasicBlock *> jumps;
 //
 void function_header(TreeNode *node)
 {
-    auto funct = dynamic_cast<TreeBinaryNode *>(node);
+    auto funct = dyn_cast_or_null<TreeBinaryNode>(node);
     assert(funct);
 
     if (funct->oper == T_FUNCTION) {
-        auto proc = dynamic_cast<TreeBinaryNode *>(funct->left);
+        auto proc = dyn_cast_or_null<TreeBinaryNode>(funct->left);
         Type *type = node_to_type(funct->right);
 
         assert(proc->oper == T_PROCEDURE);
 
-        auto id = dynamic_cast<TreeIdentNode *>(proc->left);
-        //modules.push(new Module(id->id, TheContext));
+        auto id = dyn_cast_or_null<TreeIdentNode>(proc->left);
+        //S().modules.push(new Module(id->id, TheContext()));
 
         std::vector<Type *> arg_types;
-        std::vector<std::string> arg_names;
-        get_proc_arguments(proc->right, arg_types, arg_names);
+        std::vector<TreeIdentNode *> arg_names;
+        std::vector<bool> by_reference;
+        get_proc_arguments(proc->right, arg_types, arg_names, by_reference);
+
+        std::vector<Type *> param_types;
+        for (size_t i = 0; i != arg_types.size(); ++i)
+            param_types.push_back(by_reference[i] ? PointerType::getUnqual(arg_types[i]) : arg_types[i]);
 
-        FunctionType *FT = FunctionType::get(type, arg_types, false);
+        FunctionType *FT = FunctionType::get(type, param_types, false);
         Function *F = Function::Create(FT, Function::PrivateLinkage, id->id, TheModule());
 
         // add function to the symbol table (the previous one)
-        if (!symbols_insert_function(id->id, F))
-            syntax_error(id->id + ": Cannot {re}define function name");
+        if (!symbols_insert_function(symbol_of(id), F))
+            syntax_error(std::string(id->id) + ": Cannot {re}define function name");
 
-        BasicBlock *overBB = BasicBlock::Create(TheContext, "over_jump", get_current_function());
-        Builder.CreateBr(overBB);
-        jumps.push(overBB);
+        BasicBlock *overBB = BasicBlock::Create(TheContext(), "over_jump", get_current_function());
+        Builder().CreateBr(overBB);
+        S().jumps.push(overBB);
 
         // create new symbol table
         set_current_function(F);
         // Set names for all arguments.
         int i = 0;
         for (auto &arg : F->args()) {
-            arg.setName(arg_names[i]);
-            auto res = symbols_insert(arg_names[i], &arg);
-            assert(res);
+            arg.setName(StringRef(arg_names[i]->id));
+            if (by_reference[i]) {
+                // every actual argument is storage of the type, see generate_reference_arg()
+                uint64_t size = TheModule()->getDataLayout().getTypeAllocSize(arg_types[i]);
+                arg.addAttr(Attribute::NonNull);
+                arg.addAttr(Attribute::getWithDereferenceableBytes(TheContext(), size));
+                S().reference_params[&arg] = arg_types[i];
+            }
+            if (!symbols_insert(symbol_of(arg_names[i]), &arg))
+                syntax_error(std::string(arg_names[i]->id) + ": is a parameter already");
             ++i;
         }
 
-        BasicBlock *BB = BasicBlock::Create(TheContext, "entry", F);
-        Builder.SetInsertPoint(BB);
+        BasicBlock *BB = BasicBlock::Create(TheContext(), "entry", F);
+        Builder().SetInsertPoint(BB);
+    }
+}
+
+//
+// readonly and nocapture for the parameters passed by reference that the
+// body of F only loads through. Passing one on to a function counts as a
+// load if the parameter there already has the attribute.
+//
+static void infer_reference_attributes(Function *F)
+{
+    for (auto &arg : F->args()) {
+        if (!S().reference_params.count(&arg))
+            continue;
+
+        bool writes = false;
+        bool captures = false;
+        SmallVector<Value *, 8> worklist {&arg};
+        while (!worklist.empty()) {
+            Value *ptr = worklist.pop_back_val();
+            for (Use &use : ptr->uses()) {
+                auto user = use.getUser();
+                if (isa<LoadInst>(user)) {
+                    continue;
+                } else if (auto store = dyn_cast<StoreInst>(user)) {
+                    // stored away, it may be written through (the slot of a
+                    // variable a nested function uses)
+                    writes = true;
+                    if (store->getPointerOperand() != ptr)
+                        captures = true;
+                } else if (isa<GetElementPtrInst>(user)) {
+                    worklist.push_back(user);
+                } else if (auto call = dyn_cast<CallInst>(user)) {
+                    Function *callee = call->getCalledFunction();
+                    unsigned no = call->getArgOperandNo(&use);
+                    if (!callee || !callee->getArg(no)->onlyReadsMemory())
+                        writes = true;
+                    if (!callee || !callee->getArg(no)->hasNoCaptureAttr())
+                        captures = true;
+                } else {
+                    writes = captures = true;
+                }
+            }
+        }
+        if (!writes)
+            arg.addAttr(Attribute::ReadOnly);
+        if (!captures)
+            arg.addAttr(Attribute::NoCapture);
+    }
+}
+
+//
+// noalias for a parameter passed by reference if at every call the actual
+// argument is a variable of the caller that no other argument of the call
+// refers to and whose address is not stored: a function reaches the
+// variables of its callers only through its arguments and the slots of the
+// variables nested functions use (see variable_slot()).
+//
+static bool is_address_stored(Value *var)
+{
+    for (User *user : var->users())
+        if (auto store = dyn_cast<StoreInst>(user))
+            if (store->getValueOperand() == var)
+                return true;
+    return false;
+}
+
+static void infer_reference_noalias(Module *M)
+{
+    for (auto &F : *M) {
+        if (!F.hasPrivateLinkage())
+            continue;
+        for (auto &arg : F.args()) {
+            if (!S().reference_params.count(&arg))
+                continue;
+
+            bool distinct = true;
+            for (User *user : F.users()) {
+                auto call = dyn_cast<CallInst>(user);
+                if (!call || call->getCalledFunction() != &F) {
+                    distinct = false;
+                    break;
+                }
+                Value *var = getUnderlyingObject(call->getArgOperand(arg.getArgNo()));
+                distinct = isa<AllocaInst>(var) && !is_address_stored(var);
+                for (unsigned no = 0; distinct && no != call->arg_size(); ++no)
+                    if (no != arg.getArgNo() && call->getArgOperand(no)->getType()->isPointerTy())
+                        distinct = getUnderlyingObject(call->getArgOperand(no)) != var;
+                if (!distinct)
+                    break;
+            }
+            if (distinct)
+                arg.addAttr(Attribute::NoAlias);
+        }
     }
 }
 
 std::string node_to_ident(TreeNode *node)
 {
-    auto ident = dynamic_cast<TreeIdentNode *>(node);
+    auto ident = dyn_cast_or_null<TreeIdentNode>(node);
     assert(ident);
-    return ident->id;
+    return std::string(ident->id);
 }
 
 Value *get_default_value_of_type(Type *t)
 {
     if (t->isDoubleTy())
-        return ConstantFP::get(Type::getDoubleTy(TheContext), 0);
+        return ConstantFP::get(Type::getDoubleTy(TheContext()), 0);
     if (t->isIntegerTy(1))
-        return Builder.getInt1(false);
-    return Builder.getInt32(0);
+        return Builder().getInt1(false);
+    if (t->isStructTy() || t->isPointerTy())
+        return Constant::getNullValue(t);
+    return Builder().getInt32(0);
+}
+
+//
+// Run-time arena scopes. A function takes a mark in the entry block and
+// releases it before every return; a nested segment that allocates arrays
+// or strings takes a mark where it begins and releases it at its end.
+// Leaving segments by repent or repeat releases the mark of the outermost
+// one left, leaving them by return the mark of the function.
+//
+// Storage that may be reachable after the scope ends is not released: a
+// segment that stores whole arrays, structures or strings keeps its storage
+// until the function returns, a function that stores them outside its frame
+// keeps it. A function that returns a string or a structure keeps the
+// string or the arrays of the structure, they move down to its mark; if
+// the structure holds strings, or arrays of strings or structures, they are
+// copied out and back with what they refer to.
+//
+static Value *segment_mark(segment_t &seg)
+{
+    if (!seg.mark) {
+        IRBuilder<> TmpB(seg.BeginBB, seg.begin ? std::next(seg.begin->getIterator())
+                                                : seg.BeginBB->getFirstInsertionPt());
+        seg.mark = TmpB.CreateCall(S().rtl_symbols["arena_mark"], {}, "arena_mark");
+    }
+    return seg.mark;
+}
+
+void open_arena_scope()
+{
+    auto &ctx = S().functions.back();
+
+    if (!ctx.arena_mark) {
+        BasicBlock &entry = ctx.F->getEntryBlock();
+        IRBuilder<> TmpB(&entry, entry.getFirstInsertionPt());
+        ctx.arena_mark = TmpB.CreateCall(S().rtl_symbols["arena_mark"], {}, "arena_mark");
+    }
+
+    if (ctx.segments.size() > 1) {
+        segment_mark(ctx.segments.back());
+        ctx.segments.back().allocates = true;
+    }
+}
+
+//
+// The index paths of the array descriptors in a value of type t; false if
+// it holds a string, or the elements of an array may point to arena storage
+// themselves.
+//
+static bool array_paths(Type *t, std::vector<Value *> &path,
+                        std::vector<std::vector<Value *>> &paths)
+{
+    auto st = dyn_cast<StructType>(t);
+    if (!st)
+        return !t->isPointerTy();
+    if (is_array_type(st)) {
+        paths.push_back(path);
+        Type *elem_type = array_get_elem_type(st);
+        return !elem_type->isStructTy() && !elem_type->isPointerTy();
+    }
+    for (unsigned i = 0; i != st->getNumElements(); ++i) {
+        path.push_back(Const(i));
+        bool moves = array_paths(st->getElementType(i), path, paths);
+        path.pop_back();
+        if (!moves)
+            return false;
+    }
+    return true;
+}
+
+//
+// Release the function's mark before ret, but the arrays of the structure
+// it returns: ret returns the structure with the arrays moved down.
+//
+static void release_keeping_result(ReturnInst *ret, std::vector<std::vector<Value *>> const &paths)
+{
+    auto &ctx = S().functions.back();
+    Value *val = ret->getReturnValue();
+    Type *type = val->getType();
+    Type *i64 = Type::getInt64Ty(TheContext());
+    Type *ptr = PointerType::getUnqual(Type::getInt8Ty(TheContext()));
+    StructType *keep_type = StructType::get(ptr, i64); // rtl_arena_keep_t
+    ArrayType *keeps_type = ArrayType::get(keep_type, paths.size());
+
+    IRBuilder<> TmpB(&ctx.F->getEntryBlock(), ctx.F->getEntryBlock().begin());
+    Value *result = TmpB.CreateAlloca(type, 0, "result");
+    Value *keep = TmpB.CreateAlloca(keeps_type, 0, "keep");
+
+    IRBuilder<> B(ret);
+    B.CreateStore(val, result);
+    for (size_t i = 0; i != paths.size(); ++i) {
+        std::vector<Value *> at{Const(0)};
+        at.insert(at.end(), paths[i].begin(), paths[i].end());
+        Value *descr = B.CreateGEP(type, result, at);
+        StructType *arr_type = cast<StructType>(GetElementPtrInst::getIndexedType(type, at));
+
+        // the elements: (up - low) * stride of the first dimension
+        auto field = [&](int f) {
+            Value *pos = B.CreateGEP(arr_type, descr, {Const(0), Const(0), Const(f)});
+            return B.CreateLoad(B.getInt32Ty(), pos);
+        };
+        Value *count = B.CreateMul(B.CreateSub(field(array_t::up_bound), field(array_t::low_bound)),
+                                   field(array_t::stride));
+        Value *size = B.CreateMul(B.CreateZExt(count, i64),
+                                  ConstantInt::get(i64, getSizeofArrayElement(arr_type)));
+
+        Value *ref = B.CreatePointerCast(B.CreateStructGEP(arr_type, descr, 1), ptr);
+        B.CreateStore(ref, B.CreateGEP(keeps_type, keep, {Const(0), Const(i), Const(0)}));
+        B.CreateStore(size, B.CreateGEP(keeps_type, keep, {Const(0), Const(i), Const(1)}));
+    }
+    B.CreateCall(S().rtl_symbols["arena_release_keep"],
+                 {ctx.arena_mark, B.CreatePointerCast(keep, ptr), Const(paths.size())});
+    ret->setOperand(0, B.CreateLoad(type, result));
+}
+
+//
+// The entries of the rtl_arena_layout_t that describes where a value of type
+// t at offset holds strings and arrays: a string has data_offset 0, an array
+// an element layout if its elements hold some themselves.
+//
+static void layout_entries(Type *t, uint64_t offset, std::vector<Constant *> &entries);
+
+static Constant *layout_entry(uint64_t offset, uint64_t data_offset, uint64_t element_size,
+                              std::vector<Constant *> const &element)
+{
+    Type *i32 = Type::getInt32Ty(TheContext());
+    Type *ptr = PointerType::getUnqual(Type::getInt8Ty(TheContext()));
+    StructType *entry_type = StructType::get(i32, i32, i32, i32, ptr);
+
+    Constant *element_layout = Constant::getNullValue(ptr);
+    if (!element.empty()) {
+        Constant *init = ConstantArray::get(ArrayType::get(entry_type, element.size()), element);
+        auto layout = new GlobalVariable(*TheModule(), init->getType(), true,
+                                         GlobalValue::PrivateLinkage, init, "layout");
+        element_layout = ConstantExpr::getPointerCast(layout, ptr);
+    }
+    return ConstantStruct::get(entry_type, {ConstantInt::get(i32, offset), ConstantInt::get(i32, data_offset),
+                                            ConstantInt::get(i32, element_size),
+                                            ConstantInt::get(i32, element.size()), element_layout});
+}
+
+static void layout_entries(Type *t, uint64_t offset, std::vector<Constant *> &entries)
+{
+    auto st = dyn_cast<StructType>(t);
+    if (!st) {
+        if (t->isPointerTy())
+            entries.push_back(layout_entry(offset, 0, 0, {}));
+        return;
+    }
+
+    const StructLayout *sl = TheModule()->getDataLayout().getStructLayout(st);
+    if (is_array_type(st)) {
+        std::vector<Constant *> element;
+        layout_entries(array_get_elem_type(st), 0, element);
+        entries.push_back(layout_entry(offset, sl->getElementOffset(1), getSizeofArrayElement(st), element));
+        return;
+    }
+    for (unsigned i = 0; i != st->getNumElements(); ++i)
+        layout_entries(st->getElementType(i), offset + sl->getElementOffset(i), entries);
+}
+
+//
+// Release the function's mark before ret, but the strings and arrays the
+// structure it returns refers to, and the ones their elements refer to.
+//
+static void release_keeping_value(ReturnInst *ret, GlobalVariable *layout)
+{
+    auto &ctx = S().functions.back();
+    Value *val = ret->getReturnValue();
+    Type *type = val->getType();
+    Type *ptr = PointerType::getUnqual(Type::getInt8Ty(TheContext()));
+    uint64_t entries = cast<ArrayType>(layout->getValueType())->getNumElements();
+
+    IRBuilder<> TmpB(&ctx.F->getEntryBlock(), ctx.F->getEntryBlock().begin());
+    Value *result = TmpB.CreateAlloca(type, 0, "result");
+
+    IRBuilder<> B(ret);
+    B.CreateStore(val, result);
+    B.CreateCall(S().rtl_symbols["arena_keep_value"],
+                 {ctx.arena_mark, B.CreatePointerCast(result, ptr), B.CreatePointerCast(layout, ptr),
+                  Const(entries)});
+    ret->setOperand(0, B.CreateLoad(type, result));
+}
+
+void release_function_arena()
+{
+    auto &ctx = S().functions.back();
+
+    if (ctx.outer_stores) {
+        S().outer_storing.insert(ctx.F);
+        if (&ctx != &S().functions.front())
+            move_inline_arrays(ctx);
+    }
+    if (!ctx.arena_mark || ctx.outer_stores)
+        return;
+
+    Type *type = ctx.F->getReturnType();
+    std::vector<Value *> path;
+    std::vector<std::vector<Value *>> paths;
+    bool moves = type->isPointerTy() || array_paths(type, path, paths);
+    GlobalVariable *layout = 0;
+    if (!moves) {
+        std::vector<Constant *> entries;
+        layout_entries(type, 0, entries);
+        Constant *init = ConstantArray::get(ArrayType::get(entries[0]->getType(), entries.size()), entries);
+        layout = new GlobalVariable(*TheModule(), init->getType(), true, GlobalValue::PrivateLinkage, init,
+                                    "layout");
+    }
+
+    std::vector<ReturnInst *> returns;
+    for (auto &BB : *ctx.F)
+        if (auto ret = dyn_cast<ReturnInst>(BB.getTerminator()))
+            returns.push_back(ret);
+    for (auto ret : returns) {
+        if (type->isPointerTy())
+            ret->setOperand(0, CallInst::Create(S().rtl_symbols["string_keep"],
+                                                {ctx.arena_mark, ret->getReturnValue()}, "kept", ret));
+        else if (!moves)
+            release_keeping_value(ret, layout);
+        else if (paths.empty())
+            CallInst::Create(S().rtl_symbols["arena_release"], {ctx.arena_mark}, "", ret);
+        else
+            release_keeping_result(ret, paths);
+    }
+}
+
+void segment_begin()
+{
+    auto &ctx = S().functions.back();
+
+    segment_t seg;
+    seg.arena_stores = ctx.arena_stores;
+    seg.BeginBB = Builder().GetInsertBlock();
+    seg.begin = seg.BeginBB->empty() ? 0 : &seg.BeginBB->back();
+    ctx.segments.push_back(seg);
+
+    // its declarations are local to it
+    S().symbols.open_scope(S().functions.size());
+}
+
+void segment_end()
+{
+    auto &ctx = S().functions.back();
+
+    segment_t seg = ctx.segments.back();
+    ctx.segments.pop_back();
+    S().symbols.close_scope();
+
+    bool keeps = seg.arena_stores != ctx.arena_stores;
+    if (seg.mark && !keeps)
+        generate_rtl_call("arena_release", {seg.mark});
+
+    // the repeat/repent edges out of it release what it and the segments
+    // in it allocated
+    for (auto exit : seg.exits) {
+        if (seg.allocates && !keeps)
+            exit->setArgOperand(0, segment_mark(seg));
+        else
+            exit->eraseFromParent();
+    }
+    if (seg.mark && keeps)
+        cast<Instruction>(seg.mark)->eraseFromParent(); // nothing to release to
+    if (seg.allocates && !ctx.segments.empty())
+        ctx.segments.back().allocates = true;
 }
 
 /// @brief End of internal function definition.
@@ -1539,30 +2953,36 @@ Value *get_default_value_of_type(Type *t)
 void function_end(TreeNode *node)
 {
     auto F = get_current_function();
-    verifyFunction(*F);
 
-    if(flag_verbose)
+    if(S().options.verbose)
         F->dump(); // DEBUG
-    functions_pop();
     // TODO: pop(); ... ; delete F;
 
 #if 1
     // generate implicit return
     Value *rc = get_default_value_of_type(F->getReturnType());
-    Builder.CreateRet(rc);
+    Builder().CreateRet(rc);
 #endif
+    release_function_arena();
+    restore_variable_slots();
+    infer_reference_attributes(F);
+    {
+        phase_timer timer(timed(PHASE_VERIFY));
+        verifyFunction(*F);
+    }
+    functions_pop();
 
-    // auto id = dynamic_cast<TreeIdentNode *>(node);
+    // auto id = dyn_cast_or_null<TreeIdentNode>(node);
     // TODO: verify ending label == module name
 
-    //if (err_cnt == 0)
+    //if (S().err_cnt == 0)
     //    TheModule()->print(outs(), nullptr);
-    //modules.pop();
+    //S().modules.pop();
 
     // restore previous function/program
-    BasicBlock *BB = jumps.top();
-    jumps.pop();
-    Builder.SetInsertPoint(BB);
+    BasicBlock *BB = S().jumps.top();
+    S().jumps.pop();
+    Builder().SetInsertPoint(BB);
 }
 
 void subroutine_end(TreeNode *node)
@@ -1575,51 +2995,160 @@ void return_statement()
     auto F = get_current_function();
     // generate return of "default" value of the function type
     Value *rc = get_default_value_of_type(F->getReturnType());
-    Builder.CreateRet(rc);
+    Builder().CreateRet(rc);
+    start_unreachable_block("after_return");
 }
 
 void return_statement(TreeNode *node)
 {
-    Value *val = generate_expr(node);
-    Builder.CreateRet(val);
+    Type *type = get_current_function()->getReturnType();
+    node = analyze_conversion(node, type, "return");
+    if (Value *val = node ? generate_expr(node) : 0)
+        Builder().CreateRet(val);
+    start_unreachable_block("after_return");
 }
 
 void symbols_dump()
 {
-    if (functions.size()) {
-        errs() << "F: " << (functions.top().F ? functions.top().F->getName() : "<none>") << "\n";
-        for (auto item : functions.top().symbols) {
-            errs() << "\t" << item.first << "\n";
-        }
+    Function *F = get_current_function();
+    errs() << "F: " << (F ? F->getName() : "<none>") << "\n";
+    for (auto &sym : S().symbols.bindings())
+        if (sym.level == S().functions.size())
+            errs() << "\t" << StringRef(S().symbols.names.name(sym.id)) << "\n";
+}
+
+unsigned intern_symbol(std::string_view name)
+{
+    return S().symbols.names.intern(name);
+}
+
+// the id of ident, interned now if the scanner did not make it
+symbol_id_t symbol_of(TreeIdentNode *ident)
+{
+    if (ident->symbol == no_symbol)
+        ident->symbol = intern_symbol(ident->id);
+    return ident->symbol;
+}
+
+bool symbols_insert(symbol_id_t id, Value *v)
+{
+    symbol_t sym(SYMBOL_VARIABLE, id);
+    sym.value = v;
+    sym.type = storage_type(v);
+    if (!sym.type)
+        sym.type = v->getType();
+    return S().symbols.insert(sym) != 0;
+}
+
+bool symbols_insert_function(symbol_id_t id, Function *v)
+{
+    symbol_t sym(SYMBOL_FUNCTION, id);
+    sym.value = v;
+    return S().symbols.insert(sym) != 0;
+}
+
+//
+// Where nested functions find a variable of the function sym belongs to: a
+// private global that the function stores the address of the variable in
+// (a parameter passed by value is copied to a variable first). EASY has no
+// procedure values, so the innermost active call of a function is the one
+// its nested functions belong to; a function that may be called recursively
+// saves the slot on entry and restores it on return.
+//
+static GlobalVariable *variable_slot(symbol_t const &sym, Type *&type)
+{
+    FunctionContext &owner = S().functions[sym.level - 1];
+    Value *var = sym.value;
+    type = storage_type(var);
+    if (!type)
+        type = var->getType();
+
+    auto pos = owner.slots.find(var);
+    if (pos != owner.slots.end())
+        return pos->second;
+
+    Type *ptr_type = PointerType::getUnqual(type);
+    auto slot = new GlobalVariable(*TheModule(), ptr_type, false, GlobalValue::PrivateLinkage,
+                                   ConstantPointerNull::get(cast<PointerType>(ptr_type)),
+                                   owner.F->getName() + "." +
+                                       StringRef(S().symbols.names.name(sym.id)) + ".slot");
+    owner.slots[var] = slot;
+
+    BasicBlock &entry = owner.F->getEntryBlock();
+    IRBuilder<> B(&entry, entry.getFirstInsertionPt());
+    if (sym.level > 1)
+        owner.saved_slots.push_back({slot, B.CreateLoad(ptr_type, slot, "slot_saved")});
+
+    if (!storage_type(var)) {
+        Value *copy = B.CreateAlloca(type, 0, var->getName() + ".copy");
+        B.CreateStore(var, copy);
+        B.CreateStore(copy, slot);
+    } else if (auto inst = dyn_cast<Instruction>(var)) {
+        IRBuilder<>(inst->getNextNode()).CreateStore(var, slot);
     } else {
-        errs() << "Empty function stack";
+        B.CreateStore(var, slot);
     }
+
+    // nested functions may assign it whole
+    S().array_descriptors.erase(var);
+    return slot;
 }
 
-bool symbols_insert(std::string const &s, Value *v)
+//
+// A variable of an enclosing function, used here: the pointer to it, loaded
+// from its slot on entry, stands for it as a parameter passed by reference
+// does.
+//
+static Value *capture_variable(symbol_t const &sym)
 {
-    auto r = functions.top().symbols.insert(std::make_pair(s, v));
+    FunctionContext &ctx = S().functions.back();
+    auto pos = ctx.captured.find(sym.value);
+    if (pos != ctx.captured.end())
+        return pos->second;
+
+    Type *type;
+    GlobalVariable *slot = variable_slot(sym, type);
 
-    return r.second;
+    BasicBlock &entry = ctx.F->getEntryBlock();
+    IRBuilder<> B(&entry, entry.getFirstInsertionPt());
+    Value *ptr = B.CreateLoad(slot->getValueType(), slot, StringRef(S().symbols.names.name(sym.id)));
+    S().reference_params[ptr] = type;
+    ctx.captured[sym.value] = ptr;
+    return ptr;
 }
 
-bool symbols_insert_function(std::string const &s, Function *v)
+// before every return of the current function, see variable_slot()
+static void restore_variable_slots()
 {
-    auto r = fsymbols.insert(std::make_pair(s, v));
+    auto &ctx = S().functions.back();
+    if (ctx.saved_slots.empty())
+        return;
+
+    for (auto &BB : *ctx.F)
+        if (auto ret = dyn_cast<ReturnInst>(BB.getTerminator()))
+            for (auto &saved : ctx.saved_slots)
+                new StoreInst(saved.second, saved.first, ret);
+}
 
-    return r.second;
+Value *symbols_find(symbol_id_t id)
+{
+    symbol_t *sym = S().symbols.find(id, SYMBOL_VARIABLE);
+    if (!sym)
+        return 0;
+    if (sym->level == S().functions.size() || isa<Constant>(sym->value))
+        return sym->value;
+    return capture_variable(*sym);
 }
 
-Value *symbols_find(std::string const &id)
+symbol_t *symbols_lookup(symbol_id_t id, symbol_kind_t kind, Type *structure)
 {
-    auto pos = functions.top().symbols.find(id);
-    return pos == functions.top().symbols.end() ? 0 : pos->second;
+    return S().symbols.find(id, kind, structure);
 }
 
-Value *symbols_find_function(std::string const &id)
+Function *symbols_find_function(symbol_id_t id)
 {
-    auto pos = fsymbols.find(id);
-    return pos == fsymbols.end() ? 0 : pos->second;
+    symbol_t *sym = S().symbols.find(id, SYMBOL_FUNCTION);
+    return sym ? cast<Function>(sym->value) : 0;
 }
 
 //
@@ -1627,29 +3156,45 @@ Value *symbols_find_function(std::string const &id)
 //
 TreeNode *type_identifier(TreeNode *node)
 {
-    errs() << "type_identifier: " << typeid(*node).name() << '\n';
+    if (S().options.verbose)
+        errs() << "type_identifier: " << node->show() << '\n';
     return node;
 }
 
+//
+// An identified type per element type and number of dimensions: with opaque
+// pointers the literal {[n x i32], ptr} would be one type for the arrays of
+// all element types.
+//
 Type *CreateArrayType(Type *item_type, size_t ndims)
 {
+    Type *elem_type = item_type ? item_type : Type::getInt32Ty(TheContext());
+    StructType *&result = S().array_types[{elem_type, ndims}];
+    if (result)
+        return result;
+
     std::vector<Type *> types;
 
-    Type *vecTy = ArrayType::get(Type::getInt32Ty(TheContext), array_t::dim_size * ndims);
+    Type *vecTy = ArrayType::get(Type::getInt32Ty(TheContext()), array_t::dim_size * ndims);
     types.push_back(vecTy);
-    Type *elem_type = item_type ? item_type : Type::getInt32Ty(TheContext);
     Type *ptr = PointerType::getUnqual(elem_type);
     types.push_back(ptr);
 
-    StructType *result = StructType::get(TheContext, TypeArray(types));
+    result = StructType::create(TheContext(), TypeArray(types), "array");
     // Store the element type for later retrieval
-    array_element_types[result] = elem_type;
+    S().array_element_types[result] = elem_type;
     return result;
 }
 
+bool is_array_type(Type *type)
+{
+    auto stype = dyn_cast_or_null<StructType>(type);
+    return stype && S().array_element_types.count(stype);
+}
+
 Type *CreateStructType(std::vector<Type *> items, std::string const &name)
 {
-    StructType *t = StructType::get(TheContext, TypeArray(items));
+    StructType *t = StructType::get(TheContext(), TypeArray(items));
     if (!t->isLiteral())
         t->setName(name);
     return t;
@@ -1662,7 +3207,7 @@ Type *CreateStructType(Type *item, size_t n)
     Type *vecTy = ArrayType::get(item, n);
     types.push_back(vecTy);
 
-    return StructType::get(TheContext, TypeArray(types));
+    return StructType::get(TheContext(), TypeArray(types));
 }
 
 //
@@ -1670,55 +3215,197 @@ Type *CreateStructType(Type *item, size_t n)
 //
 StructType *array_get_type(Value *sym)
 {
-    if (auto *AI = dyn_cast<AllocaInst>(sym)) {
-        if (AI->getAllocatedType()->isStructTy())
-            return cast<StructType>(AI->getAllocatedType());
-    }
-    return 0;
+    return dyn_cast_or_null<StructType>(storage_type(sym));
 }
 
 Type *array_get_elem_type(StructType *arr_type)
 {
-    auto it = array_element_types.find(arr_type);
-    if (it != array_element_types.end()) {
+    auto it = S().array_element_types.find(arr_type);
+    if (it != S().array_element_types.end()) {
         return it->second;
     }
     // Fallback to int32 if not found
-    return Type::getInt32Ty(TheContext);
+    return Type::getInt32Ty(TheContext());
 }
 
 //
 //
 //
+//
+// A type name stands for its definition, evaluated again for every
+// declaration of that type (the bounds of an array type are expressions).
+// A structure is constructed once, its fields belong to that one type.
+//
 void type_declaration(TreeNode *ident_node, TreeNode *type_node)
 {
-    TreeIdentNode *ident = dynamic_cast<TreeIdentNode *>(ident_node);
+    TreeIdentNode *ident = dyn_cast_or_null<TreeIdentNode>(ident_node);
     assert(ident);
-    Type *type = node_to_type(type_node);
 
-#if 0
-    // TODO: save definition in type table
-    symbols_insert(ident->id, type);
-#else
-    (void)type;
-#endif
+    symbol_t type(SYMBOL_TYPE, symbol_of(ident));
+    if (auto name = dyn_cast<TreeIdentNode>(type_node)) {
+        symbol_t *other = S().symbols.find(symbol_of(name), SYMBOL_TYPE);
+        if (!other) {
+            syntax_error(std::string(name->id) + ": is not a type");
+            return;
+        }
+        type.type = other->type;
+        type.definition = other->definition;
+    } else {
+        type.definition = type_node;
+        if (type_node->oper == STRUCTURE)
+            type.type = node_to_type(type_node);
+    }
+
+    if (!S().symbols.insert(type))
+        syntax_error(std::string(ident->id) + ": is declared already");
 }
 
 llvm::LLVMContext *get_global_context()
 {
-    return &TheContext;
+    return &TheContext();
 }
 
+//
+// A function opens a scope for its parameters, its segments are nested in
+// it, see segment_begin()
+//
 void set_current_function(Function *F)
 {
-    functions.push(F);
+    S().functions.emplace_back(F);
+    S().symbols.open_scope(S().functions.size());
 }
 
 void functions_pop()
 {
-    if (flag_verbose)
+    if (S().options.verbose)
         symbols_dump();
-    functions.pop(); // TODO: delete ?
+    S().symbols.close_scope();
+    S().functions.pop_back(); // TODO: delete ?
+}
+
+//
+// CompilationSession
+//
+
+CompilationSession::CompilationSession() : state(std::make_unique<session_state_t>())
+{
+}
+
+CompilationSession::~CompilationSession()
+{
+}
+
+compile_options_t &CompilationSession::options()
+{
+    return state->options;
+}
+
+//
+// yyparse() with the scanner set up for the input; parse is what it takes
+// besides the phases nested in it
+//
+static int parse(yyscan_t scanner)
+{
+    auto &phases = S().stats.phases;
+    phase_time_t nested_before[PHASE_COUNT];
+    std::copy(phases, phases + PHASE_COUNT, nested_before);
+
+    int rc;
+    {
+        phase_timer timer(timed(PHASE_PARSE));
+        rc = yyparse(scanner);
+    }
+
+    for (int p = 0; p != PHASE_COUNT; ++p)
+        if (p != PHASE_PARSE) {
+            phases[PHASE_PARSE].wall_ms -= phases[p].wall_ms - nested_before[p].wall_ms;
+            phases[PHASE_PARSE].cpu_ms -= phases[p].cpu_ms - nested_before[p].cpu_ms;
+        }
+
+    return rc == 0 && S().err_cnt ? 1 : rc;
+}
+
+int CompilationSession::compile(SourceText &source)
+{
+    Scope scope(*this);
+    state->source_name = source.name();
+
+    yyscan_t scanner;
+    if (yylex_init(&scanner)) {
+        errs() << "compile: cannot initialize the scanner\n";
+        return 1;
+    }
+    // scanned in place, yytext points into the source
+    if (!yy_scan_buffer(source.scan_data(), source.scan_size(), scanner)) {
+        errs() << "compile: the scanner does not take the source buffer\n";
+        yylex_destroy(scanner);
+        return 1;
+    }
+    int rc = parse(scanner);
+    yylex_destroy(scanner);
+    return rc;
+}
+
+int CompilationSession::compile(FILE *in)
+{
+    SourceText source;
+    if (auto ec = source.read(in)) {
+        errs() << "compile: " << ec.message() << "\n";
+        return 1;
+    }
+    return compile(source);
+}
+
+int CompilationSession::compile(StringRef text)
+{
+    // the scanner writes to its buffer, text is const
+    SourceText source;
+    source.assign(text);
+    return compile(source);
+}
+
+int CompilationSession::errors() const
+{
+    return state->err_cnt;
+}
+
+compile_stats_t &CompilationSession::stats()
+{
+    return state->stats;
+}
+
+LLVMContext &CompilationSession::context()
+{
+    return state->TheContext;
+}
+
+IRBuilder<> &CompilationSession::builder()
+{
+    return state->Builder;
+}
+
+std::unique_ptr<Module> CompilationSession::take_module()
+{
+    if (state->modules.empty())
+        return nullptr;
+    std::unique_ptr<Module> M(state->modules.top());
+    state->modules.pop();
+    return M;
+}
+
+std::unique_ptr<LLVMContext> CompilationSession::take_context()
+{
+    return std::move(state->TheContextOwner);
+}
+
+CompilationSession::Scope::Scope(CompilationSession &session) : prev(current_state)
+{
+    current_state = session.state.get();
+}
+
+CompilationSession::Scope::~Scope()
+{
+    current_state = prev;
 }
 
 // Local Variables:
@@ -6,13 +6,14 @@
 #define __PARSER_BITS_H
 
 #include "TreeNode.h"
+#include "symbol_table.h"
 
 #include <llvm/ADT/ArrayRef.h>
+#include <memory>
 #include <vector>
 
 void program_header(TreeNode *);
 void program_end(TreeNode *);
-void init_compiler();
 TreeNode *make_binary(TreeNode *, TreeNode *, int op);
 TreeNode *make_unary(TreeNode *, int op);
 TreeNode *make_boolean(int op);
@@ -20,8 +21,10 @@ void assign_statement(TreeNode *targets, TreeNode *expr);
 TreeNode *base_type(int type);
 void variable_declaration(TreeNode *variables, TreeNode *type);
 TreeNode *make_output(TreeNode *tree, bool append_nl = false);
+TreeNode *make_input(TreeNode *targets);
 
 void cond_specification(TreeNode *);
+void syntax_error(std::string errmsg);
 
 namespace llvm {
     class Function;
@@ -29,6 +32,7 @@ namespace llvm {
     class Type;
     class StructType;
     class LLVMContext;
+    class Module;
 }
 
 llvm::LLVMContext *get_global_context();
@@ -57,15 +61,18 @@ llvm::Value *generate_dot(TreeNode *type_node);
 
 llvm::Value *Const(int c);
 
-// TODO: class?
-bool symbols_insert(std::string const &s, llvm::Value *v);
-llvm::Value * symbols_find(std::string const &s);
-llvm::Value * symbols_find_function(std::string const &s);
-bool symbols_insert_function(std::string const &s, llvm::Function *v);
-
-void symbols_push();
-void symbols_pop();
+// the open scopes, see symbol_table.h; a variable of an enclosing function
+// is found as a pointer to it
+bool symbols_insert(symbol_id_t id, llvm::Value *v);
+llvm::Value * symbols_find(symbol_id_t id);
+llvm::Function * symbols_find_function(symbol_id_t id);
+bool symbols_insert_function(symbol_id_t id, llvm::Function *v);
+symbol_id_t symbol_of(TreeIdentNode *ident);
+// the binding itself, without capturing a variable
+symbol_t *symbols_lookup(symbol_id_t id, symbol_kind_t kind, llvm::Type *structure = 0);
 bool isArrayType(llvm::Value *sym);
+// the descriptor type of an array, see CreateArrayType()
+bool is_array_type(llvm::Type *type);
 
 void false_branch_begin();
 void false_branch_end();
@@ -74,6 +81,11 @@ void simple_cond_statement();
 void loop_head(TreeNode *loop_target, TreeNode *control);
 TreeNode *control(TreeNode *step_control, TreeNode *cond_control = 0);
 void loop_footer(TreeNode *ident = 0);
+void select_header(TreeNode *expr);
+void select_case(TreeNode *selector);
+void select_otherwise();
+void select_case_end();
+void select_footer();
 void set_label(TreeNode *);
 void set_for_label(TreeNode *);
 void clear_label();
@@ -81,6 +93,9 @@ void make_repent(TreeNode *);
 void make_repeat(TreeNode *);
 
 
+void segment_begin();
+void segment_end();
+
 void function_header(TreeNode *);
 
 void function_end(TreeNode *);
@@ -100,7 +115,14 @@ typedef std::pair<llvm::Type *, llvm::Value *> type_value_t;
 type_value_t create_alloca(llvm::Type *t, const char *s);
 type_value_t node_to_type(TreeNode *node, const char *sym);
 
-extern bool flag_verbose;
+// what program_end() does with a successfully compiled module
+enum emit_mode_t {
+    EMIT_IR,      // print textual IR to stdout
+    EMIT_JIT,     // keep the module for take_module()
+    EMIT_OBJECT,  // keep the module for take_module()
+    EMIT_BITCODE, // keep the module for take_module()
+    EMIT_MODULE,  // keep the module for take_module(), for a library user
+};
 
 // Local Variables:
 // mode: c++
@@ -0,0 +1,572 @@
+// sema.cpp - Types, conversions and constant folding of expression trees
+//
+// The pass runs over an expression before any code is generated for it. It
+// only reads the symbol table and the LLVM types of the declarations; the
+// tree it returns is what generate_expr() lowers.
+
+#include "sema.h"
+#include "parser.h"
+#include "parser_bits.h"
+
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Function.h"
+#include "llvm/Support/Casting.h"
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+using namespace llvm;
+
+static TreeNode *analyze(TreeNode *node);
+
+static TreeNode *typed(TreeNode *node, value_type_t type)
+{
+    node->type = type;
+    return node;
+}
+
+static TreeNode *error(TreeNode *node, std::string const &message)
+{
+    syntax_error(message);
+    return typed(node, VALUE_ERROR);
+}
+
+static bool numeric(value_type_t type)
+{
+    return type == VALUE_INTEGER || type == VALUE_REAL;
+}
+
+static TreeNode *integer(int64_t num)
+{
+    // 32 bit two's complement, as the code generated computes
+    return typed(ast_arena().make<TreeNumericalNode>(int32_t(uint32_t(num))), VALUE_INTEGER);
+}
+
+static TreeNode *real(double num)
+{
+    return typed(ast_arena().make<TreeDNumericalNode>(num), VALUE_REAL);
+}
+
+static TreeNode *boolean(bool b)
+{
+    return typed(ast_arena().make<TreeBooleanNode>(b), VALUE_BOOLEAN);
+}
+
+// node, converted to real if it is an integer
+static TreeNode *to_real(TreeNode *node)
+{
+    if (node->type != VALUE_INTEGER)
+        return node;
+    if (auto number = dyn_cast<TreeNumericalNode>(node))
+        return real(number->num);
+    return typed(ast_arena().make<TreeUnaryNode>(node, FLOAT), VALUE_REAL);
+}
+
+value_type_t value_type_of(Type *type)
+{
+    if (!type)
+        return VALUE_ERROR;
+    if (type->isIntegerTy(1))
+        return VALUE_BOOLEAN;
+    if (type->isIntegerTy())
+        return VALUE_INTEGER;
+    if (type->isFloatingPointTy())
+        return VALUE_REAL;
+    if (type->isPointerTy())
+        return VALUE_STRING; // see string_constant()
+    if (type->isStructTy())
+        return is_array_type(type) ? VALUE_ARRAY : VALUE_STRUCTURE;
+    return VALUE_ERROR;
+}
+
+const char *value_type_name(value_type_t type)
+{
+    switch (type) {
+    case VALUE_NONE:
+        break;
+    case VALUE_INTEGER:
+        return "integer";
+    case VALUE_REAL:
+        return "real";
+    case VALUE_BOOLEAN:
+        return "boolean";
+    case VALUE_STRING:
+        return "string";
+    case VALUE_ARRAY:
+        return "array";
+    case VALUE_STRUCTURE:
+        return "structure";
+    case VALUE_ERROR:
+        return "error";
+    }
+    return "none";
+}
+
+//
+// The type of the storage a variable, a field of a structure variable or an
+// element of an array designates; 0 after an error. The subscripts are
+// analyzed in place.
+//
+static Type *variable_type(TreeNode *node)
+{
+    if (auto ident = dyn_cast<TreeIdentNode>(node)) {
+        symbol_t *var = symbols_lookup(symbol_of(ident), SYMBOL_VARIABLE);
+        if (!var) {
+            syntax_error(std::string(ident->id) + ": ident not found");
+            return 0;
+        }
+        return var->type;
+    }
+
+    if (node->kind == TREE_BINARY && node->oper == PERIOD) {
+        if (!isa<TreeIdentNode>(node->left)) {
+            syntax_error(node->left->show() + ": is not a structure variable");
+            return 0;
+        }
+        Type *structure = variable_type(node->left);
+        if (!structure)
+            return 0;
+        auto ident = cast<TreeIdentNode>(node->right);
+        symbol_t *field = symbols_lookup(symbol_of(ident), SYMBOL_FIELD, structure);
+        if (!field) {
+            syntax_error(std::string(ident->id) + ": is not a name of a field");
+            return 0;
+        }
+        return cast<StructType>(structure)->getElementType(field->field);
+    }
+
+    // a[i][j] is ('[', ('[', a, i), j)
+    bool subscripts = true;
+    TreeNode *base = node;
+    for (; base->kind == TREE_BINARY && base->oper == LBRACK; base = base->left) {
+        base->right = analyze(base->right);
+        if (base->right->type == VALUE_ERROR) {
+            subscripts = false;
+        } else if (base->right->type != VALUE_INTEGER) {
+            syntax_error(base->right->show() + ": a subscript must be an integer");
+            subscripts = false;
+        }
+    }
+    if (base == node || (!isa<TreeIdentNode>(base) && base->oper != PERIOD)) {
+        syntax_error(node->show() + ": is not a variable");
+        return 0;
+    }
+    Type *array = variable_type(base);
+    if (!array)
+        return 0;
+    if (!is_array_type(array)) {
+        syntax_error(base->show() + ": is not array");
+        return 0;
+    }
+    return subscripts ? array_get_elem_type(cast<StructType>(array)) : 0;
+}
+
+static TreeNode *analyze_variable(TreeNode *node)
+{
+    Type *type = variable_type(node);
+    return typed(node, type ? value_type_of(type) : VALUE_ERROR);
+}
+
+//
+// The actual arguments of a call of F, in place, from the no-th on: the
+// value of a parameter passed by value is converted to its type. The
+// argument of a parameter passed by reference is checked when its address
+// is taken (generate_reference_arg()).
+//
+static bool analyze_arguments(TreeNode *&args, Function *F, unsigned &no)
+{
+    if (!args)
+        return true;
+    if (args->kind == TREE_BINARY && args->oper == COMMA) {
+        bool first = analyze_arguments(args->left, F, no);
+        return analyze_arguments(args->right, F, no) && first;
+    }
+
+    args = analyze(args);
+    Type *formal = no < F->arg_size() ? F->getArg(no)->getType() : 0;
+    ++no;
+    if (args->type == VALUE_ERROR)
+        return false;
+    if (!formal || formal->isPointerTy())
+        return true;
+
+    value_type_t type = value_type_of(formal);
+    if (type == VALUE_REAL)
+        args = to_real(args);
+    if (args->type != type) {
+        syntax_error(args->show() + ": argument type mismatch");
+        return false;
+    }
+    return true;
+}
+
+static TreeNode *analyze_call(TreeNode *node)
+{
+    auto ident = dyn_cast<TreeIdentNode>(node->left);
+    if (!ident)
+        return error(node, "Function name must be ident");
+    symbol_t *function = symbols_lookup(symbol_of(ident), SYMBOL_FUNCTION);
+    if (!function)
+        return error(node, std::string(ident->id) + ": Function name is not found");
+
+    auto F = cast<Function>(function->value);
+    unsigned no = 0;
+    if (!analyze_arguments(node->right, F, no))
+        return typed(node, VALUE_ERROR);
+    if (F->getReturnType()->isVoidTy())
+        return error(node, std::string(ident->id) + ": has no value");
+    return typed(node, value_type_of(F->getReturnType()));
+}
+
+static TreeNode *analyze_concat(TreeNode *node)
+{
+    node->left = analyze(node->left);
+    node->right = analyze(node->right);
+    if (node->left->type == VALUE_ERROR || node->right->type == VALUE_ERROR)
+        return typed(node, VALUE_ERROR);
+    if (node->left->type != VALUE_STRING || node->right->type != VALUE_STRING)
+        return error(node, "operands of || must be strings");
+    return typed(node, VALUE_STRING);
+}
+
+// substr(s, start, n) is (SUBSTR, s, (COMMA, start, n))
+static TreeNode *analyze_substr(TreeNode *node)
+{
+    TreeNode *range = node->right;
+    node->left = analyze(node->left);
+    range->left = analyze(range->left);
+    range->right = analyze(range->right);
+    if (node->left->type == VALUE_ERROR || range->left->type == VALUE_ERROR ||
+        range->right->type == VALUE_ERROR)
+        return typed(node, VALUE_ERROR);
+    if (node->left->type != VALUE_STRING || range->left->type != VALUE_INTEGER ||
+        range->right->type != VALUE_INTEGER)
+        return error(node, "substr takes a string, a start position and a length");
+    return typed(node, VALUE_STRING);
+}
+
+static TreeNode *analyze_unary(TreeNode *node)
+{
+    node->left = analyze(node->left);
+    TreeNode *operand = node->left;
+    value_type_t type = operand->type;
+    if (type == VALUE_ERROR)
+        return typed(node, VALUE_ERROR);
+
+    switch (node->oper) {
+    case MINUS:
+        if (!numeric(type))
+            return error(node, "- takes a number");
+        if (auto number = dyn_cast<TreeNumericalNode>(operand))
+            return integer(-int64_t(number->num));
+        if (auto number = dyn_cast<TreeDNumericalNode>(operand))
+            return real(-number->num);
+        return typed(node, type);
+    case NOT:
+        if (type != VALUE_BOOLEAN)
+            return error(node, "not takes a boolean");
+        if (auto b = dyn_cast<TreeBooleanNode>(operand))
+            return boolean(!b->num);
+        return typed(node, VALUE_BOOLEAN);
+    case FIX:
+        if (type == VALUE_INTEGER)
+            return operand;
+        if (type != VALUE_REAL)
+            return error(node, "fix takes a number");
+        // fptosi is poison out of range, so that is left to run time
+        if (auto number = dyn_cast<TreeDNumericalNode>(operand))
+            if (number->num > INT32_MIN - 1.0 && number->num < INT32_MAX + 1.0)
+                return integer(int64_t(number->num));
+        return typed(node, VALUE_INTEGER);
+    case FLOAT:
+        if (type == VALUE_REAL)
+            return operand;
+        if (type != VALUE_INTEGER)
+            return error(node, "float takes a number");
+        return to_real(operand);
+    case LENGTH:
+        if (type != VALUE_STRING)
+            return error(node, "length takes a string");
+        if (auto text = dyn_cast<TreeTextNode>(operand))
+            return integer(text->text.size());
+        return typed(node, VALUE_INTEGER);
+    case CHARACTER:
+        if (type != VALUE_INTEGER)
+            return error(node, "character takes an integer");
+        return typed(node, VALUE_STRING);
+    }
+    return error(node, token_to_string(node->oper) + " is not implemented");
+}
+
+static TreeNode *fold_integer(TreeNode *node, int64_t a, int64_t b)
+{
+    switch (node->oper) {
+    case PLUS:
+        return integer(a + b);
+    case MINUS:
+        return integer(a - b);
+    case TIMES:
+        return integer(a * b);
+    case SLASH:
+    case MOD:
+        if (b == 0 || (a == INT32_MIN && b == -1))
+            return node; // traps at run time
+        return integer(node->oper == SLASH ? a / b : a % b);
+    case LSS:
+        return boolean(a < b);
+    case GTR:
+        return boolean(a > b);
+    case LEQ:
+        return boolean(a <= b);
+    case GEQ:
+        return boolean(a >= b);
+    case EQL:
+        return boolean(a == b);
+    case NEQ:
+        return boolean(a != b);
+    }
+    return node;
+}
+
+static TreeNode *fold_real(TreeNode *node, double a, double b)
+{
+    // the comparisons are unordered: true if an operand is a NaN
+    bool unordered = std::isnan(a) || std::isnan(b);
+    switch (node->oper) {
+    case PLUS:
+        return real(a + b);
+    case MINUS:
+        return real(a - b);
+    case TIMES:
+        return real(a * b);
+    case SLASH:
+        return real(a / b);
+    case LSS:
+        return boolean(unordered || a < b);
+    case GTR:
+        return boolean(unordered || a > b);
+    case LEQ:
+        return boolean(unordered || a <= b);
+    case GEQ:
+        return boolean(unordered || a >= b);
+    case EQL:
+        return boolean(unordered || a == b);
+    case NEQ:
+        return boolean(a != b);
+    }
+    return node;
+}
+
+static TreeNode *fold_boolean(TreeNode *node, bool a, bool b)
+{
+    switch (node->oper) {
+    case AND:
+        return boolean(a && b);
+    case OR:
+        return boolean(a || b);
+    case XOR:
+    case NEQ:
+        return boolean(a != b);
+    case EQL:
+        return boolean(a == b);
+    }
+    return node;
+}
+
+// a binary node of literals as the literal of its value
+static TreeNode *fold(TreeNode *node)
+{
+    auto a = node->left, b = node->right;
+    if (isa<TreeNumericalNode>(a) && isa<TreeNumericalNode>(b))
+        return fold_integer(node, cast<TreeNumericalNode>(a)->num, cast<TreeNumericalNode>(b)->num);
+    if (isa<TreeDNumericalNode>(a) && isa<TreeDNumericalNode>(b))
+        return fold_real(node, cast<TreeDNumericalNode>(a)->num, cast<TreeDNumericalNode>(b)->num);
+    if (isa<TreeBooleanNode>(a) && isa<TreeBooleanNode>(b))
+        return fold_boolean(node, cast<TreeBooleanNode>(a)->num, cast<TreeBooleanNode>(b)->num);
+    return node;
+}
+
+static TreeNode *analyze_binary(TreeNode *node)
+{
+    switch (node->oper) {
+    case CALLSYM:
+        return analyze_call(node);
+    case LBRACK:
+    case PERIOD:
+        return analyze_variable(node);
+    case CONCAT:
+        return analyze_concat(node);
+    case SUBSTR:
+        return analyze_substr(node);
+    }
+
+    node->left = analyze(node->left);
+    node->right = analyze(node->right);
+    value_type_t left = node->left->type;
+    value_type_t right = node->right->type;
+    if (left == VALUE_ERROR || right == VALUE_ERROR)
+        return typed(node, VALUE_ERROR);
+
+    // both operands of an arithmetic operation or a comparison of numbers
+    // are of one type
+    if (numeric(left) && numeric(right) && left != right) {
+        node->left = to_real(node->left);
+        node->right = to_real(node->right);
+        left = right = VALUE_REAL;
+    }
+
+    switch (node->oper) {
+    case PLUS:
+    case MINUS:
+    case TIMES:
+    case SLASH:
+        if (!numeric(left) || !numeric(right))
+            return error(node, node->show() + ": operands must be numbers");
+        return fold(typed(node, left));
+    case MOD:
+        if (left != VALUE_INTEGER || right != VALUE_INTEGER)
+            return error(node, node->show() + ": operands must be integers");
+        return fold(typed(node, VALUE_INTEGER));
+    case LSS:
+    case GTR:
+    case LEQ:
+    case GEQ:
+        if (!numeric(left) || !numeric(right))
+            return error(node, node->show() + ": operands must be numbers");
+        return fold(typed(node, VALUE_BOOLEAN));
+    case EQL:
+    case NEQ:
+        if (left != right || !(numeric(left) || left == VALUE_BOOLEAN))
+            return error(node, node->show() + ": operands must be numbers or booleans");
+        return fold(typed(node, VALUE_BOOLEAN));
+    case AND:
+    case OR:
+    case XOR:
+        if (left != VALUE_BOOLEAN || right != VALUE_BOOLEAN)
+            return error(node, node->show() + ": operands must be booleans");
+        return fold(typed(node, VALUE_BOOLEAN));
+    }
+    return error(node, token_to_string(node->oper) + " is not implemented");
+}
+
+static TreeNode *analyze(TreeNode *node)
+{
+    if (node->type != VALUE_NONE)
+        return node;
+
+    switch (node->kind) {
+    case TREE_NUMBER:
+        return typed(node, VALUE_INTEGER);
+    case TREE_DNUMBER:
+        return typed(node, VALUE_REAL);
+    case TREE_BOOLEAN:
+        return typed(node, VALUE_BOOLEAN);
+    case TREE_TEXT:
+        return typed(node, VALUE_STRING);
+    case TREE_IDENT:
+        return analyze_variable(node);
+    case TREE_UNARY:
+        return analyze_unary(node);
+    case TREE_BINARY:
+        return analyze_binary(node);
+    }
+    return node;
+}
+
+TreeNode *analyze_expression(TreeNode *expr)
+{
+    return analyze(expr);
+}
+
+// the declared type of an analyzed array or structure value: of a
+// variable, field, element or function result
+static Type *aggregate_type(TreeNode *expr)
+{
+    if (expr->kind == TREE_BINARY && expr->oper == CALLSYM) {
+        symbol_t *function = symbols_lookup(symbol_of(cast<TreeIdentNode>(expr->left)), SYMBOL_FUNCTION);
+        return function ? cast<Function>(function->value)->getReturnType() : 0;
+    }
+    return variable_type(expr);
+}
+
+// arrays of one element type and rank, or structures of one declaration
+static bool same_aggregate(TreeNode *expr, Type *type, std::string const &what)
+{
+    if (expr->type != VALUE_ARRAY && expr->type != VALUE_STRUCTURE)
+        return true;
+    Type *own = aggregate_type(expr);
+    if (!own || own == type)
+        return !!own;
+    syntax_error(what + ": " + value_type_name(expr->type) +
+                 (expr->type == VALUE_ARRAY ? " of another element type or rank"
+                                            : " of another type"));
+    return false;
+}
+
+TreeNode *analyze_conversion(TreeNode *expr, value_type_t type, std::string const &what)
+{
+    expr = analyze(expr);
+    if (expr->type == VALUE_ERROR || type == VALUE_ERROR)
+        return 0;
+    if (type == VALUE_REAL)
+        expr = to_real(expr);
+    if (expr->type != type) {
+        syntax_error(what + ": expected " + value_type_name(type) + ", not " +
+                     value_type_name(expr->type));
+        return 0;
+    }
+    return expr;
+}
+
+TreeNode *analyze_conversion(TreeNode *expr, Type *type, std::string const &what)
+{
+    expr = analyze_conversion(expr, value_type_of(type), what);
+    return expr && same_aggregate(expr, type, what) ? expr : 0;
+}
+
+static void collect_targets(TreeNode *targets, std::vector<TreeNode *> &list)
+{
+    if (targets->kind == TREE_BINARY && targets->oper == BECOMES) {
+        collect_targets(targets->left, list);
+        collect_targets(targets->right, list);
+    } else {
+        list.push_back(targets);
+    }
+}
+
+TreeNode *analyze_assignment(TreeNode *targets, TreeNode *expr)
+{
+    std::vector<TreeNode *> list;
+    collect_targets(targets, list);
+
+    value_type_t type = VALUE_NONE;
+    for (auto target : list) {
+        if (analyze(target)->type == VALUE_ERROR)
+            type = VALUE_ERROR;
+        else if (type == VALUE_NONE)
+            type = target->type;
+        else if (type != VALUE_ERROR && target->type != type) {
+            syntax_error(targets->show() + ": targets of different types");
+            type = VALUE_ERROR;
+        }
+    }
+
+    expr = analyze(expr);
+    if (type != VALUE_ARRAY && type != VALUE_STRUCTURE)
+        return analyze_conversion(expr, type, list.front()->show());
+
+    // the value and all targets are of the type of the first target
+    Type *aggregate = aggregate_type(list.front());
+    for (auto target : list)
+        if (!same_aggregate(target, aggregate, target->show()))
+            return 0;
+    return aggregate ? analyze_conversion(expr, aggregate, list.front()->show()) : 0;
+}
+
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// tab-width: 4
+// indent-tabs-mode: nil
+// End:
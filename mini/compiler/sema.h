@@ -0,0 +1,55 @@
+//
+// sema.h
+//
+
+#ifndef __SEMA_H
+#define __SEMA_H
+
+#include "TreeNode.h"
+
+#include <string>
+
+namespace llvm {
+class Type;
+}
+
+//
+// Semantic analysis of an expression tree, complete as the parser hands it
+// to code generation. The names are resolved in the open scopes, every node
+// gets the type of its value (TreeNode::type), an integer operand of a real
+// operation is converted by an explicit FLOAT node, and subtrees of literals
+// are folded to a literal. Code generation emits from the analyzed tree, so
+// it no longer has to decide on the types of LLVM values.
+//
+// Errors are reported with syntax_error(); the type of the nodes they are
+// in is VALUE_ERROR.
+//
+
+// the analyzed tree: expr, or the literal it folds to
+TreeNode *analyze_expression(TreeNode *expr);
+
+// expr analyzed and converted to a value of type: the conversion from
+// integer to real is the only implicit one. 0 after an error; what tells
+// the use of the value in a message.
+TreeNode *analyze_conversion(TreeNode *expr, value_type_t type, std::string const &what);
+
+// the same, to a value of a declared type: an array or a structure has to be
+// of that very type, an array of the same element type and rank
+TreeNode *analyze_conversion(TreeNode *expr, llvm::Type *type, std::string const &what);
+
+// expr analyzed and converted for an assignment to targets (BECOMES list)
+TreeNode *analyze_assignment(TreeNode *targets, TreeNode *expr);
+
+// of a variable, parameter or function result
+value_type_t value_type_of(llvm::Type *type);
+
+// "integer", "real", ...
+const char *value_type_name(value_type_t type);
+
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// tab-width: 4
+// indent-tabs-mode: nil
+// End:
+#endif
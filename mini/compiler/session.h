@@ -0,0 +1,97 @@
+//
+// session.h
+//
+
+#ifndef __SESSION_H
+#define __SESSION_H
+
+#include "parser_bits.h"
+#include "stats.h"
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+
+#include <cstdio>
+#include <memory>
+#include <string>
+
+struct compile_options_t {
+    bool verbose = false;
+    int opt_level = 0;
+    emit_mode_t emit_mode = EMIT_IR;
+    bool time_report = false;  // time the phases, see stats()
+    bool stats = false;        // count the instructions etc. of the module
+    bool check_bounds = false; // range check every array index
+    bool inline_functions = false; // inline EASY functions at -O0 too
+    bool inline_report = false;    // list the calls inlined
+    std::string cache_dir;         // of compiled output, see cache.h
+};
+
+struct session_state_t; // parser_bits.cpp
+class SourceText;      // source.h
+
+//
+// Everything needed to compile EASY programs: the LLVM context, the IR
+// builder, the modules and the code generation stacks and tables. A session
+// compiles on the thread that calls compile(); separate sessions may be used
+// concurrently on separate threads.
+//
+class CompilationSession {
+public:
+    CompilationSession();
+    ~CompilationSession();
+
+    CompilationSession(CompilationSession const &) = delete;
+    CompilationSession &operator=(CompilationSession const &) = delete;
+
+    compile_options_t &options();
+
+    // Parse the programs of source and generate their code. Returns 0 if
+    // there were neither syntax nor semantic errors. The scanner works on
+    // the buffer of source in place.
+    int compile(SourceText &source);
+
+    // the same, for the programs read from in or held in memory (copied)
+    int compile(FILE *in);
+    int compile(llvm::StringRef source);
+
+    int errors() const;
+
+    // phase times and counters, collected as the options ask
+    compile_stats_t &stats();
+
+    llvm::LLVMContext &context();
+    llvm::IRBuilder<> &builder();
+
+    // Hand the last compiled program over to the caller. The context has to
+    // go along with it if the consumer needs to own both (ORC
+    // ThreadSafeModule); the session cannot be used after that.
+    std::unique_ptr<llvm::Module> take_module();
+    std::unique_ptr<llvm::LLVMContext> take_context();
+
+    //
+    // Makes the session current on this thread for its lifetime, for code
+    // generation called outside compile() (unit tests).
+    //
+    class Scope {
+    public:
+        Scope(CompilationSession &session);
+        ~Scope();
+
+    private:
+        session_state_t *prev;
+    };
+
+private:
+    std::unique_ptr<session_state_t> state;
+};
+
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// tab-width: 4
+// indent-tabs-mode: nil
+// End:
+#endif
@@ -0,0 +1,122 @@
+// source.cpp - Source text in a buffer the scanner can lex in place
+//
+// Reading a source through stdio copies it twice (kernel to FILE buffer to
+// flex buffer) and then once more per token into a std::string of the tree.
+// Here a file is mapped into memory, flex scans the mapping itself and the
+// tree keeps views of it.
+
+#include "source.h"
+
+#include "llvm/Support/Process.h"
+
+#include <cerrno>
+
+using namespace llvm;
+
+// YY_END_OF_BUFFER_CHAR, twice
+static const size_t scan_padding = 2;
+
+// mapping a small file costs more than reading it (the threshold of LLVM's
+// MemoryBuffer)
+static const uint64_t map_threshold = 16 * 1024;
+
+std::error_code SourceText::load(const char *path)
+{
+    Expected<sys::fs::file_t> file = sys::fs::openNativeFileForRead(path);
+    if (!file)
+        return errorToErrorCode(file.takeError());
+
+    region.reset();
+    size = 0;
+    this->path = path;
+
+    sys::fs::file_status status;
+    std::error_code ec = sys::fs::status(*file, status);
+    uint64_t file_size = status.getSize();
+
+    // past the end of the file, the last page reads as zeros; mapping
+    // beyond the end of a file does not work on Windows
+#ifndef _WIN32
+    uint64_t page = sys::Process::getPageSizeEstimate();
+    uint64_t tail = file_size % page;
+    if (!ec && file_size >= map_threshold && tail != 0 && page - tail >= scan_padding) {
+        region = std::make_unique<sys::fs::mapped_file_region>(
+            *file, sys::fs::mapped_file_region::priv, file_size + scan_padding, 0, ec);
+        if (ec)
+            region.reset();
+        else
+            size = file_size;
+    }
+#endif
+
+    if (!ec && !region) {
+        memory.assign(file_size + scan_padding, '\0');
+        size_t done = 0;
+        while (done < file_size) {
+            Expected<size_t> n = sys::fs::readNativeFileSlice(
+                *file, MutableArrayRef<char>(memory.data() + done, file_size - done), done);
+            if (!n) {
+                ec = errorToErrorCode(n.takeError());
+                break;
+            }
+            if (*n == 0) // the file got shorter
+                break;
+            done += *n;
+        }
+        size = done;
+        memory.resize(size + scan_padding);
+    }
+
+    sys::fs::closeFile(*file);
+    return ec;
+}
+
+std::error_code SourceText::read(FILE *in)
+{
+    region.reset();
+    memory.clear();
+    path.clear();
+    size = 0;
+    for (;;) {
+        if (size == memory.size())
+            memory.resize(size ? 2 * size : 64 * 1024);
+        size_t n = fread(memory.data() + size, 1, memory.size() - size, in);
+        if (n == 0)
+            break;
+        size += n;
+    }
+    memory.resize(size);
+    memory.append(scan_padding, '\0');
+    return ferror(in) ? std::error_code(errno, std::generic_category()) : std::error_code();
+}
+
+void SourceText::assign(StringRef text)
+{
+    region.reset();
+    path.clear();
+    memory.assign(text.begin(), text.end());
+    memory.append(scan_padding, '\0');
+    size = text.size();
+}
+
+StringRef SourceText::text() const
+{
+    return StringRef(region ? region->const_data() : memory.data(), size);
+}
+
+char *SourceText::scan_data()
+{
+    return region ? region->data() : memory.data();
+}
+
+size_t SourceText::scan_size() const
+{
+    return size + scan_padding;
+}
+
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// tab-width: 4
+// indent-tabs-mode: nil
+// End:
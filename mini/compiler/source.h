@@ -0,0 +1,63 @@
+//
+// source.h
+//
+
+#ifndef __SOURCE_H
+#define __SOURCE_H
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/FileSystem.h"
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <system_error>
+
+//
+// The text of a source, laid out as the scanner works on it: flex scans a
+// buffer in place (yy_scan_buffer) if it ends in two NULs and may be
+// written to, as the scanner puts a NUL after the token it has matched.
+// Identifiers and text literals of the tree are views of this buffer, so
+// it has to outlive the compilation of its programs.
+//
+// A file is mapped copy-on-write, without a copy, unless it is small or the
+// NULs do not fit into its last page; then it is read into memory.
+//
+class SourceText {
+public:
+    SourceText() = default;
+    SourceText(SourceText const &) = delete;
+    SourceText &operator=(SourceText const &) = delete;
+
+    std::error_code load(const char *path);
+    std::error_code read(FILE *in);
+    void assign(llvm::StringRef text);
+
+    // the source, without the NULs
+    llvm::StringRef text() const;
+
+    // for the scanner: the source and the NULs
+    char *scan_data();
+    size_t scan_size() const;
+
+    // whether load() mapped the file
+    bool mapped() const { return region != nullptr; }
+
+    // the path load() read, "" for a source read from a stream or assigned
+    std::string const &name() const { return path; }
+
+private:
+    std::string path;
+    std::unique_ptr<llvm::sys::fs::mapped_file_region> region;
+    llvm::SmallVector<char, 0> memory;
+    size_t size = 0;
+};
+
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// tab-width: 4
+// indent-tabs-mode: nil
+// End:
+#endif
@@ -0,0 +1,169 @@
+// stats.cpp - Phase times and code generation counters (compiler -time, -stats)
+//
+
+#include "stats.h"
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+
+#include <chrono>
+#include <ctime>
+#include <vector>
+
+using namespace llvm;
+
+static double wall_now_ms()
+{
+    using namespace std::chrono;
+    return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+static double cpu_now_ms()
+{
+#ifdef CLOCK_THREAD_CPUTIME_ID
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+#else
+    return std::clock() * 1e3 / CLOCKS_PER_SEC;
+#endif
+}
+
+phase_timer::phase_timer(phase_time_t *phase)
+    : phase(phase)
+    , wall_start(phase ? wall_now_ms() : 0)
+    , cpu_start(phase ? cpu_now_ms() : 0)
+{
+}
+
+phase_timer::~phase_timer()
+{
+    if (phase) {
+        phase->wall_ms += wall_now_ms() - wall_start;
+        phase->cpu_ms += cpu_now_ms() - cpu_start;
+    }
+}
+
+void count_module(Module const &M, compile_stats_t &stats)
+{
+    for (auto const &F : M) {
+        if (F.isDeclaration())
+            continue;
+        ++stats.functions;
+        for (auto const &BB : F) {
+            ++stats.basic_blocks;
+            for (auto const &I : BB) {
+                ++stats.instructions;
+                if (isa<AllocaInst>(I))
+                    ++stats.allocas;
+                else if (auto CI = dyn_cast<CallInst>(&I))
+                    if (auto callee = CI->getCalledFunction())
+                        if (callee->getName().starts_with("rtl_"))
+                            ++stats.rtl_calls;
+            }
+        }
+    }
+}
+
+const char *phase_name(phase_t phase)
+{
+    switch (phase) {
+    case PHASE_LEX:
+        return "lex";
+    case PHASE_PARSE:
+        return "parse";
+    case PHASE_VERIFY:
+        return "verify";
+    case PHASE_OPTIMIZE:
+        return "optimize";
+    case PHASE_EMIT:
+        return "emit";
+    default:
+        return "?";
+    }
+}
+
+struct counter_t {
+    const char *name;
+    uint64_t value;
+};
+
+static std::vector<counter_t> counters_of(compile_stats_t const &stats)
+{
+    return {
+        {"tree_nodes", stats.tree_nodes},
+        {"tree_bytes", stats.tree_bytes},
+        {"descriptor_loads", stats.descriptor_loads},
+        {"bounds_checks", stats.bounds_checks},
+        {"bounds_checks_elided", stats.bounds_checks_elided},
+        {"select_switches", stats.select_switches},
+        {"select_chains", stats.select_chains},
+        {"calls_inlined", stats.calls_inlined},
+        {"functions", stats.functions},
+        {"basic_blocks", stats.basic_blocks},
+        {"instructions", stats.instructions},
+        {"allocas", stats.allocas},
+        {"rtl_calls", stats.rtl_calls},
+    };
+}
+
+static void print_text(FILE *out, compile_stats_t const &stats, bool times, bool counters)
+{
+    if (times) {
+        phase_time_t total;
+        fprintf(out, "%-10s %12s %12s\n", "phase", "wall ms", "cpu ms");
+        for (int p = 0; p != PHASE_COUNT; ++p) {
+            auto const &t = stats.phases[p];
+            fprintf(out, "%-10s %12.3f %12.3f\n", phase_name(phase_t(p)), t.wall_ms, t.cpu_ms);
+            total.wall_ms += t.wall_ms;
+            total.cpu_ms += t.cpu_ms;
+        }
+        fprintf(out, "%-10s %12.3f %12.3f\n", "total", total.wall_ms, total.cpu_ms);
+    }
+    if (counters)
+        for (auto const &c : counters_of(stats))
+            fprintf(out, "%-20s %12llu\n", c.name, (unsigned long long)c.value);
+}
+
+static void print_json(FILE *out, compile_stats_t const &stats, bool times, bool counters)
+{
+    const char *sep = "";
+
+    fprintf(out, "{");
+    if (times) {
+        fprintf(out, "\"time\": {");
+        for (int p = 0; p != PHASE_COUNT; ++p) {
+            auto const &t = stats.phases[p];
+            fprintf(out, "%s\"%s\": {\"wall_ms\": %.3f, \"cpu_ms\": %.3f}", p ? ", " : "",
+                    phase_name(phase_t(p)), t.wall_ms, t.cpu_ms);
+        }
+        fprintf(out, "}");
+        sep = ", ";
+    }
+    if (counters) {
+        fprintf(out, "%s\"stats\": {", sep);
+        sep = "";
+        for (auto const &c : counters_of(stats)) {
+            fprintf(out, "%s\"%s\": %llu", sep, c.name, (unsigned long long)c.value);
+            sep = ", ";
+        }
+        fprintf(out, "}");
+    }
+    fprintf(out, "}\n");
+}
+
+void print_stats(FILE *out, compile_stats_t const &stats, bool times, bool counters, bool json)
+{
+    if (json)
+        print_json(out, stats, times, counters);
+    else
+        print_text(out, stats, times, counters);
+}
+
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// tab-width: 4
+// indent-tabs-mode: nil
+// End:
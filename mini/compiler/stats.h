@@ -0,0 +1,83 @@
+//
+// stats.h
+//
+
+#ifndef __STATS_H
+#define __STATS_H
+
+#include <cstdint>
+#include <cstdio>
+
+namespace llvm {
+    class Module;
+}
+
+// compiler phases timed by compiler -time
+enum phase_t {
+    PHASE_LEX,      // yylex()
+    PHASE_PARSE,    // yyparse() and the code generation in its actions
+    PHASE_VERIFY,   // verifyFunction()
+    PHASE_OPTIMIZE, // -O<n> pass pipeline
+    PHASE_EMIT,     // textual IR, object file or JIT
+    PHASE_COUNT
+};
+
+struct phase_time_t {
+    double wall_ms = 0;
+    double cpu_ms = 0;
+};
+
+struct compile_stats_t {
+    phase_time_t phases[PHASE_COUNT];
+
+    // code generation, see compiler -stats
+    uint64_t tree_nodes = 0;           // TreeNodes allocated
+    uint64_t tree_bytes = 0;           // bytes of node arena used
+    uint64_t descriptor_loads = 0;     // array descriptor fields loaded
+    uint64_t bounds_checks = 0;        // array indexes checked (-fcheck-bounds)
+    uint64_t bounds_checks_elided = 0; // ... of those, proven by a for loop
+    uint64_t select_switches = 0;      // select statements lowered to a switch
+    uint64_t select_chains = 0;        // ... to a chain of comparisons
+    uint64_t calls_inlined = 0;        // by optimize_module()
+
+    // the final module
+    uint64_t functions = 0;
+    uint64_t basic_blocks = 0;
+    uint64_t instructions = 0;
+    uint64_t allocas = 0;
+    uint64_t rtl_calls = 0;
+};
+
+//
+// Adds the wall and CPU (of this thread) time of its lifetime to a phase;
+// does nothing if the phase is 0.
+//
+class phase_timer {
+public:
+    explicit phase_timer(phase_time_t *phase);
+    ~phase_timer();
+
+    phase_timer(phase_timer const &) = delete;
+    phase_timer &operator=(phase_timer const &) = delete;
+
+private:
+    phase_time_t *phase;
+    double wall_start;
+    double cpu_start;
+};
+
+// the module counters of stats, from M
+void count_module(llvm::Module const &M, compile_stats_t &stats);
+
+const char *phase_name(phase_t phase);
+
+// report what was asked for, as text or as one JSON object
+void print_stats(FILE *out, compile_stats_t const &stats, bool times, bool counters, bool json);
+
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// tab-width: 4
+// indent-tabs-mode: nil
+// End:
+#endif
@@ -0,0 +1,127 @@
+// symbol_table.cpp - Interned identifiers and the scoped symbol table
+
+#include "symbol_table.h"
+
+#include <cassert>
+#include <functional>
+
+static const size_t initial_slots = 256;
+
+symbol_interner::symbol_interner() : names(1), hashes(1), slots(initial_slots, no_symbol)
+{
+}
+
+symbol_id_t symbol_interner::find(std::string_view name) const
+{
+    size_t hash = std::hash<std::string_view>()(name);
+    size_t mask = slots.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        symbol_id_t id = slots[i];
+        if (id == no_symbol || (hashes[id] == hash && names[id] == name))
+            return id;
+    }
+}
+
+symbol_id_t symbol_interner::intern(std::string_view name)
+{
+    size_t hash = std::hash<std::string_view>()(name);
+    size_t mask = slots.size() - 1;
+    size_t i = hash & mask;
+    for (; slots[i] != no_symbol; i = (i + 1) & mask) {
+        symbol_id_t id = slots[i];
+        if (hashes[id] == hash && names[id] == name)
+            return id;
+    }
+
+    symbol_id_t id = names.size();
+    text.emplace_back(name);
+    names.push_back(text.back());
+    hashes.push_back(hash);
+    slots[i] = id;
+
+    // at most half full
+    if (2 * names.size() > slots.size())
+        grow();
+    return id;
+}
+
+void symbol_interner::grow()
+{
+    std::vector<symbol_id_t> larger(2 * slots.size(), no_symbol);
+    size_t mask = larger.size() - 1;
+    for (symbol_id_t id = 1; id != names.size(); ++id) {
+        size_t i = hashes[id] & mask;
+        while (larger[i] != no_symbol)
+            i = (i + 1) & mask;
+        larger[i] = id;
+    }
+    slots.swap(larger);
+}
+
+void symbol_table::open_scope(unsigned level)
+{
+    scopes.push_back({stack.size(), level});
+}
+
+void symbol_table::close_scope()
+{
+    assert(!scopes.empty());
+    while (stack.size() > scopes.back().first)
+        pop();
+    scopes.pop_back();
+}
+
+void symbol_table::pop()
+{
+    symbol_t const &top = stack.back();
+    innermost[top.id] = top.shadowed;
+    stack.pop_back();
+}
+
+symbol_t *symbol_table::insert(symbol_t const &symbol)
+{
+    assert(!scopes.empty());
+    assert(symbol.id != no_symbol);
+
+    if (symbol.id >= innermost.size())
+        innermost.resize(names.size() > symbol.id ? names.size() : symbol.id + 1, 0);
+
+    for (size_t i = innermost[symbol.id]; i > scopes.back().first; i = stack[i - 1].shadowed) {
+        symbol_t const &bound = stack[i - 1];
+        if (bound.kind == symbol.kind && (bound.kind != SYMBOL_FIELD || bound.type == symbol.type))
+            return 0;
+    }
+
+    stack.push_back(symbol);
+    symbol_t &bound = stack.back();
+    bound.level = scopes.back().level;
+    bound.shadowed = innermost[symbol.id];
+    innermost[symbol.id] = stack.size();
+    return &bound;
+}
+
+symbol_t *symbol_table::find(symbol_id_t id, symbol_kind_t kind, llvm::Type *structure)
+{
+    if (id >= innermost.size())
+        return 0;
+    for (size_t i = innermost[id]; i; i = stack[i - 1].shadowed) {
+        symbol_t &bound = stack[i - 1];
+        if (bound.kind == kind && (kind != SYMBOL_FIELD || bound.type == structure))
+            return &bound;
+    }
+    return 0;
+}
+
+void symbol_table::erase(symbol_t *symbol)
+{
+    assert(!stack.empty() && symbol == &stack.back());
+    (void)symbol;
+    pop();
+}
+
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// tab-width: 4
+// indent-tabs-mode: nil
+// End:
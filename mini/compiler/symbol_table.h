@@ -0,0 +1,131 @@
+//
+// symbol_table.h
+//
+
+#ifndef __SYMBOL_TABLE_H
+#define __SYMBOL_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace llvm {
+class Type;
+class Value;
+}
+class LabelStatement;
+class TreeNode;
+
+typedef uint32_t symbol_id_t;
+
+// no identifier, e.g. a TreeIdentNode made outside of the scanner
+static const symbol_id_t no_symbol = 0;
+
+//
+// Identifiers as small integers. The scanner interns every identifier it
+// reads (intern_symbol()), so the tables below index by an id instead of
+// hashing and copying the name on each lookup. An open-addressing hash
+// table maps the names, which are copied once per distinct identifier.
+//
+class symbol_interner {
+public:
+    symbol_interner();
+
+    symbol_id_t intern(std::string_view name);
+
+    // no_symbol if name was never interned
+    symbol_id_t find(std::string_view name) const;
+
+    std::string_view name(symbol_id_t id) const { return names[id]; }
+
+    // every id is below
+    size_t size() const { return names.size(); }
+
+private:
+    void grow();
+
+    std::vector<std::string_view> names; // by id
+    std::vector<size_t> hashes;          // by id
+    std::vector<symbol_id_t> slots;      // power of two long, no_symbol if free
+    std::deque<std::string> text;        // of the names, never moved
+};
+
+enum symbol_kind_t {
+    SYMBOL_VARIABLE, // value: its storage, or the parameter passed by value; type: its type
+    SYMBOL_FUNCTION, // value: the llvm::Function
+    SYMBOL_TYPE,     // type, and its definition for an array type
+    SYMBOL_FIELD,    // type: the structure, field: the number of the field
+    SYMBOL_LABEL,    // label
+};
+
+struct symbol_t {
+    symbol_kind_t kind;
+    symbol_id_t id;
+    unsigned level = 0; // of the function of the scope, see open_scope()
+
+    llvm::Value *value = 0;
+    llvm::Type *type = 0;
+    TreeNode *definition = 0;
+    unsigned field = 0;
+    LabelStatement *label = 0;
+
+    size_t shadowed = 0; // the binding of id it hides, + 1
+
+    symbol_t(symbol_kind_t k, symbol_id_t i) : kind(k), id(i) {}
+};
+
+//
+// Scoped symbol table for variables, functions, types, fields and labels.
+// A scope is opened for each function and each segment (a block with
+// declarations) and chained to the enclosing one, so a nested function sees
+// the names of the functions around it. Bindings are kept on a stack; for
+// every id, a flat array indexed by the id holds its innermost binding,
+// which links to the one it hides. A lookup is an array access and a walk
+// down that (short) chain to the first binding of the kind asked for.
+//
+class symbol_table {
+public:
+    symbol_interner names;
+
+    // level is the nesting depth of the function the scope belongs to
+    void open_scope(unsigned level);
+    void close_scope();
+    size_t scope_count() const { return scopes.size(); }
+
+    // Bind symbol in the innermost scope. 0 if that scope binds its id
+    // already, with the same kind (and, for a field, the same structure).
+    symbol_t *insert(symbol_t const &symbol);
+
+    // the innermost binding of id of kind, of the structure for a field
+    symbol_t *find(symbol_id_t id, symbol_kind_t kind, llvm::Type *structure = 0);
+
+    // remove symbol, the last binding inserted (a label at the end of the
+    // labeled statement)
+    void erase(symbol_t *symbol);
+
+    // the bindings of the open scopes, outermost first
+    std::deque<symbol_t> const &bindings() const { return stack; }
+
+private:
+    struct scope_t {
+        size_t first; // index of its first binding
+        unsigned level;
+    };
+
+    void pop();
+
+    std::deque<symbol_t> stack;
+    std::vector<size_t> innermost; // by id: index + 1 of the binding, 0 if none
+    std::vector<scope_t> scopes;
+};
+
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// tab-width: 4
+// indent-tabs-mode: nil
+// End:
+#endif
@@ -10,10 +10,8 @@
 symbol_type const *
 symbol_type_table::find(std::string const &id) const
 {
-    auto pos = _symbols.find(id);
-    if(pos != _symbols.end())
-        return pos->second;
-    return 0;
+    symbol_id_t sym = _names.find(id);
+    return sym < _symbols.size() ? _symbols[sym] : 0;
 }
 
 ///
@@ -22,8 +20,13 @@ symbol_type_table::find(std::string const &id) const
 bool
 symbol_type_table::insert(symbol_type *entry)
 {
-    auto res = _symbols.insert(std::make_pair(entry->ident, entry));
-    return res.second;
+    symbol_id_t sym = _names.intern(entry->ident);
+    if (sym >= _symbols.size())
+        _symbols.resize(_names.size(), 0);
+    if (_symbols[sym])
+        return false;
+    _symbols[sym] = entry;
+    return true;
 }
 
 // Local Variables:
@@ -6,12 +6,17 @@
 #define SYMBOL_TYPE_TABLE_H
 
 #include "symbol_type.h"
+#include "symbol_table.h"
 
 #include <string>
-#include <unordered_map>
+#include <vector>
 
+//
+// Types by name, indexed by the interned id of the name
+//
 class symbol_type_table {
-    std::unordered_map<std::string, symbol_type *> _symbols;
+    symbol_interner _names;
+    std::vector<symbol_type *> _symbols; // by id
 public:
 
     symbol_type const *find(std::string const &id) const;
@@ -0,0 +1,248 @@
+//
+// bench_compile.cpp - Compile time of synthetic EASY programs, by phase
+//
+// Every benchmark family grows one dimension of a generated program (number
+// of functions, if-nesting depth, length of declare lists, length of
+// expressions) and times one phase on it:
+//
+//   lex      - yylex() over the whole source
+//   compile  - lexing, parsing and IR generation (the parser generates IR
+//              in its actions, so parsing alone cannot be timed)
+//   verify   - verifyModule()
+//   print    - textual IR
+//
+// Throughput is reported as source bytes/s, lines/s and IR instructions/s;
+// a phase whose time per line grows with the range is worth a look.
+//
+
+#include <benchmark/benchmark.h>
+
+#include "parser.h"
+#include "parser_bits.h"
+#include "session.h"
+#include "TreeNode.h"
+
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <string>
+
+using namespace llvm;
+
+struct program_shape_t {
+    int functions = 4;
+    int depth = 4;    // nested if statements per function
+    int declares = 8; // integer variables declared in one list per function
+    int terms = 8;    // terms of the long expression per function
+};
+
+static program_shape_t by_functions(int64_t n)
+{
+    program_shape_t shape;
+    shape.functions = n;
+    return shape;
+}
+
+static program_shape_t by_depth(int64_t n)
+{
+    program_shape_t shape;
+    shape.functions = 1;
+    shape.depth = n;
+    return shape;
+}
+
+static program_shape_t by_declares(int64_t n)
+{
+    program_shape_t shape;
+    shape.functions = 1;
+    shape.declares = n;
+    return shape;
+}
+
+static program_shape_t by_terms(int64_t n)
+{
+    program_shape_t shape;
+    shape.functions = 1;
+    shape.terms = n;
+    return shape;
+}
+
+static std::string generate_function(program_shape_t const &shape, int k)
+{
+    std::string f = "f" + std::to_string(k);
+    std::string text = "    function " + f + " (x integer, y integer) integer :\n";
+
+    text += "        declare (v0";
+    for (int i = 1; i < std::max(shape.declares, 2); ++i)
+        text += ", v" + std::to_string(i);
+    text += ") integer;\n";
+
+    text += "        set v0 := x";
+    for (int i = 1; i <= shape.terms; ++i)
+        text += std::string(i % 2 ? " + " : " - ") + (i % 3 ? "x" : "y") + " * " + std::to_string(i);
+    text += ";\n";
+
+    std::string indent = "        ";
+    for (int d = 0; d != shape.depth; ++d) {
+        text += indent + "if v0 > " + std::to_string(d) + " then\n";
+        indent += "    ";
+        text += indent + "set v1 := v1 + " + std::to_string(d) + ";\n";
+    }
+    for (int d = shape.depth; d-- != 0;) {
+        indent.resize(indent.size() - 4);
+        text += indent + "else\n";
+        text += indent + "    set v1 := v1 - " + std::to_string(d) + ";\n";
+        text += indent + "fi;\n";
+    }
+
+    text += "        for v1 := 1 to 10 do\n"
+            "            set v0 := v0 + v1;\n"
+            "        end for;\n"
+            "        return v0 + v1;\n";
+    text += "    end function " + f + ";\n\n";
+    return text;
+}
+
+static std::string generate_program(program_shape_t const &shape)
+{
+    std::string text = "/* generated */\nprogram BENCH:\n";
+    for (int k = 0; k != shape.functions; ++k)
+        text += generate_function(shape, k);
+    for (int k = 0; k != shape.functions; ++k)
+        text += "    output f" + std::to_string(k) + "(1, 2);\n";
+    text += "end program BENCH;\n";
+    return text;
+}
+
+static int64_t count_lines(std::string const &text)
+{
+    return std::count(text.begin(), text.end(), '\n');
+}
+
+static int64_t count_instructions(Module const &M)
+{
+    int64_t n = 0;
+    for (auto const &F : M)
+        n += F.getInstructionCount();
+    return n;
+}
+
+static std::unique_ptr<Module> compile_text(CompilationSession &session, std::string &text)
+{
+    session.options().emit_mode = EMIT_OBJECT; // keep the module, do not print it
+    FILE *in = fmemopen(text.data(), text.size(), "r");
+    if (!in)
+        return nullptr;
+    int rc = session.compile(in);
+    fclose(in);
+    return rc ? nullptr : session.take_module();
+}
+
+static void set_rates(benchmark::State &state, std::string const &text, int64_t instructions)
+{
+    using benchmark::Counter;
+    state.SetBytesProcessed(state.iterations() * text.size());
+    state.counters["lines/s"] = Counter(count_lines(text), Counter::kIsIterationInvariantRate);
+    if (instructions)
+        state.counters["instructions/s"] = Counter(instructions, Counter::kIsIterationInvariantRate);
+}
+
+template <program_shape_t (*Shape)(int64_t)>
+static void BM_lex(benchmark::State &state)
+{
+    std::string text = generate_program(Shape(state.range(0)));
+    CompilationSession session;
+    CompilationSession::Scope scope(session); // identifiers go to its node arena
+
+    int64_t tokens = 0;
+    for (auto _ : state) {
+        FILE *in = fmemopen(text.data(), text.size(), "r");
+        yyscan_t scanner;
+        yylex_init(&scanner);
+        yyset_in(in, scanner);
+
+        YYSTYPE yylval;
+        tokens = 0;
+        while (yylex(&yylval, scanner))
+            ++tokens;
+
+        yylex_destroy(scanner);
+        fclose(in);
+        ast_arena().release();
+    }
+    set_rates(state, text, 0);
+    state.counters["tokens"] = tokens;
+}
+
+template <program_shape_t (*Shape)(int64_t)>
+static void BM_compile(benchmark::State &state)
+{
+    std::string text = generate_program(Shape(state.range(0)));
+
+    int64_t instructions = 0;
+    for (auto _ : state) {
+        CompilationSession session;
+        auto M = compile_text(session, text);
+        if (!M) {
+            state.SkipWithError("generated program does not compile");
+            return;
+        }
+        instructions = count_instructions(*M);
+    }
+    set_rates(state, text, instructions);
+}
+
+template <program_shape_t (*Shape)(int64_t)>
+static void BM_verify(benchmark::State &state)
+{
+    std::string text = generate_program(Shape(state.range(0)));
+    CompilationSession session;
+    auto M = compile_text(session, text);
+    if (!M) {
+        state.SkipWithError("generated program does not compile");
+        return;
+    }
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(verifyModule(*M, &errs()));
+    set_rates(state, text, count_instructions(*M));
+}
+
+template <program_shape_t (*Shape)(int64_t)>
+static void BM_print(benchmark::State &state)
+{
+    std::string text = generate_program(Shape(state.range(0)));
+    CompilationSession session;
+    auto M = compile_text(session, text);
+    if (!M) {
+        state.SkipWithError("generated program does not compile");
+        return;
+    }
+
+    for (auto _ : state) {
+        raw_null_ostream out;
+        M->print(out, nullptr);
+    }
+    set_rates(state, text, count_instructions(*M));
+}
+
+BENCHMARK_TEMPLATE(BM_lex, by_functions)->RangeMultiplier(4)->Range(1, 1024);
+BENCHMARK_TEMPLATE(BM_compile, by_functions)->RangeMultiplier(4)->Range(1, 1024);
+BENCHMARK_TEMPLATE(BM_verify, by_functions)->RangeMultiplier(4)->Range(1, 1024);
+BENCHMARK_TEMPLATE(BM_print, by_functions)->RangeMultiplier(4)->Range(1, 1024);
+
+BENCHMARK_TEMPLATE(BM_compile, by_depth)->RangeMultiplier(4)->Range(1, 256);
+BENCHMARK_TEMPLATE(BM_compile, by_declares)->RangeMultiplier(4)->Range(4, 4096);
+BENCHMARK_TEMPLATE(BM_lex, by_terms)->RangeMultiplier(4)->Range(4, 4096);
+BENCHMARK_TEMPLATE(BM_compile, by_terms)->RangeMultiplier(4)->Range(4, 4096);
+
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// tab-width: 4
+// indent-tabs-mode: nil
+// End:
@@ -0,0 +1,162 @@
+//
+//
+//
+
+#include <gtest/gtest.h>
+
+#include "mini_system.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+TEST(arena, aligned)
+{
+    void *mark = rtl_arena_mark();
+
+    for (size_t n : {1, 3, 64, 100, 4096, 100000}) {
+        void *p = rtl_arena_allocate(n);
+        EXPECT_EQ(0, reinterpret_cast<uintptr_t>(p) % RTL_ARENA_ALIGN) << n;
+    }
+
+    rtl_arena_release(mark);
+}
+
+TEST(arena, release_reuses_memory)
+{
+    void *mark = rtl_arena_mark();
+    void *p = rtl_arena_allocate(1000);
+    rtl_arena_release(mark);
+
+    EXPECT_EQ(p, rtl_arena_allocate(1000));
+    rtl_arena_release(mark);
+}
+
+TEST(arena, release_across_chunks)
+{
+    void *mark = rtl_arena_mark();
+    size_t chunks = rtl_arena_stats()->chunks;
+
+    for (int i = 0; i != 100; ++i)
+        rtl_arena_allocate(10000);
+    EXPECT_LT(chunks, rtl_arena_stats()->chunks);
+
+    rtl_arena_release(mark);
+    EXPECT_EQ(mark, rtl_arena_mark());
+}
+
+TEST(arena, allocate_array_zeroed)
+{
+    void *mark = rtl_arena_mark();
+
+    int *a = rtl_allocate_array(10, 4);
+    for (int i = 0; i != 10; ++i)
+        a[i] = i + 1;
+    rtl_arena_release(mark);
+
+    size_t allocations = rtl_arena_stats()->allocations;
+    int *b = rtl_allocate_array(10, 4);
+    EXPECT_EQ(a, b);
+    for (int i = 0; i != 10; ++i)
+        EXPECT_EQ(0, b[i]);
+    EXPECT_EQ(allocations + 1, rtl_arena_stats()->allocations);
+
+    rtl_arena_release(mark);
+}
+
+TEST(arena, release_keep_moves_down)
+{
+    void *mark = rtl_arena_mark();
+
+    int *junk = rtl_allocate_array(100, 4);
+    int *a = rtl_allocate_array(10, 4);
+    int *b = rtl_allocate_array(20, 4);
+    junk[0] = -1;
+    a[9] = 9;
+    b[19] = 19;
+
+    void *pa = a, *pb = b, *pb2 = b;
+    rtl_arena_keep_t keep[] = {{&pb, 80}, {&pa, 40}, {&pb2, 80}};
+    rtl_arena_release_keep(mark, keep, 3);
+
+    EXPECT_EQ(mark, pa); // by address, so a first
+    EXPECT_EQ(9, static_cast<int *>(pa)[9]);
+    EXPECT_EQ(19, static_cast<int *>(pb)[19]);
+    EXPECT_EQ(pb, pb2);
+    EXPECT_GT(static_cast<char *>(rtl_arena_mark()), static_cast<char *>(pb));
+
+    rtl_arena_release(mark);
+}
+
+TEST(arena, release_keep_across_chunks)
+{
+    int *before = rtl_allocate_array(1, 4);
+    void *mark = rtl_arena_mark();
+
+    for (int i = 0; i != 20; ++i)
+        rtl_allocate_array(10000, 1);
+    int *a = rtl_allocate_array(10000, 4);
+    a[0] = 1;
+    a[9999] = 2;
+
+    void *pa = a, *pbefore = before;
+    rtl_arena_keep_t keep[] = {{&pa, 40000}, {&pbefore, 4}};
+    rtl_arena_release_keep(mark, keep, 2);
+
+    EXPECT_EQ(before, pbefore); // not allocated since the mark
+    EXPECT_EQ(1, static_cast<int *>(pa)[0]);
+    EXPECT_EQ(2, static_cast<int *>(pa)[9999]);
+
+    rtl_arena_release(mark);
+    EXPECT_EQ(mark, rtl_arena_mark());
+}
+
+// a structure holding a string and two arrays of strings that are one
+TEST(arena, keep_value_with_strings)
+{
+    struct strings {
+        int32_t dims[3];
+        rtl_string_t const **data;
+    };
+    struct value {
+        int32_t k;
+        rtl_string_t const *s;
+        strings names, alias;
+    };
+
+    rtl_string_t const *older = rtl_string_make("made before the mark", 20);
+    void *mark = rtl_arena_mark();
+
+    rtl_allocate_array(1000, 4);
+    value v = {7, rtl_string_make("short", 5), {{1, 4, 1}, 0}, {}};
+    v.names.data = reinterpret_cast<rtl_string_t const **>(rtl_allocate_array(3, 8));
+    v.names.data[0] = rtl_string_make("a string longer than a header holds", 35);
+    v.names.data[1] = older;
+    v.alias = v.names;
+
+    rtl_arena_layout_t const string[] = {{0, 0, 0, 0, 0}};
+    rtl_arena_layout_t const layout[] = {
+        {offsetof(value, s), 0, 0, 0, 0},
+        {offsetof(value, names), offsetof(strings, data), 8, 1, string},
+        {offsetof(value, alias), offsetof(strings, data), 8, 1, string},
+    };
+    rtl_arena_keep_value(mark, &v, layout, 3);
+
+    EXPECT_EQ(7, v.k);
+    EXPECT_EQ(std::string("short"), std::string(v.s->data, v.s->length));
+    EXPECT_EQ(v.names.data, v.alias.data);
+    EXPECT_EQ(std::string("a string longer than a header holds"),
+              std::string(v.names.data[0]->data, v.names.data[0]->length));
+    EXPECT_EQ(older, v.names.data[1]); // not allocated since the mark
+    EXPECT_EQ(nullptr, v.names.data[2]);
+    EXPECT_LT(static_cast<char *>(rtl_arena_mark()), static_cast<char *>(mark) + 4000); // the rest released
+
+    rtl_arena_release(mark);
+}
+
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// tab-width: 4
+// indent-tabs-mode: nil
+// End:
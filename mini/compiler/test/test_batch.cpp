@@ -0,0 +1,82 @@
+//
+//
+//
+
+#include <gtest/gtest.h>
+
+#include "batch.h"
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+static std::string write_sample(fs::path const &dir, char const *name, char const *text)
+{
+    auto path = dir / name;
+    std::ofstream(path) << text;
+    return path.string();
+}
+
+TEST(batch, compile_batch)
+{
+    auto dir = fs::path("out") / "batch" / "compile_batch";
+    std::error_code ec;
+    fs::remove_all(dir, ec);
+    fs::create_directories(dir, ec);
+
+    std::vector<std::string> sources;
+    for (int i = 0; i != 6; ++i) {
+        std::string name = "good" + std::to_string(i) + ".mini";
+        sources.push_back(write_sample(dir, name.c_str(), R"(/* good */
+program GOOD:
+    declare (i, s) integer;
+    set s := 0;
+    for i := 1 to 100 do
+        set s := s + i;
+    end for;
+    output s;
+end program GOOD;
+)"));
+    }
+    sources.push_back(write_sample(dir, "bad.mini", R"(/* bad */
+program BAD:
+    set := 1;
+end program BAD;
+)"));
+    sources.push_back((dir / "missing.mini").string());
+
+    compile_options_t options;
+    options.opt_level = 2;
+    auto results = compile_batch(sources, options, 3, dir.string().c_str());
+
+    ASSERT_EQ(sources.size(), results.size());
+    for (size_t i = 0; i != sources.size(); ++i)
+        EXPECT_EQ(sources[i], results[i].source);
+
+    for (int i = 0; i != 6; ++i) {
+        EXPECT_EQ(0, results[i].rc) << results[i].source;
+        EXPECT_TRUE(fs::is_regular_file(results[i].output)) << results[i].output;
+        EXPECT_LT(0, results[i].compile_ms);
+    }
+    EXPECT_NE(0, results[6].rc);
+    EXPECT_TRUE(results[6].output.empty());
+    EXPECT_NE(0, results[7].rc);
+    EXPECT_FALSE(fs::exists(dir / "bad.o"));
+}
+
+TEST(batch, default_object_name)
+{
+    EXPECT_EQ("bar.o", default_object_name("foo/bar.mini"));
+    EXPECT_EQ("bar.o", default_object_name("bar"));
+    EXPECT_EQ("a.o", default_object_name(0));
+}
+
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// tab-width: 4
+// indent-tabs-mode: nil
+// End:
@@ -0,0 +1,150 @@
+//
+//
+//
+
+#include <gtest/gtest.h>
+
+#include "batch.h"
+#include "cache.h"
+#include "source.h"
+
+#include "llvm/IR/Module.h"
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+static char const sample[] = R"(/* cached */
+program CACHED:
+    declare (i, s) integer;
+    set s := 0;
+    for i := 1 to 100 do
+        set s := s + i;
+    end for;
+    output s;
+end program CACHED;
+)";
+
+static fs::path clean_dir(char const *name)
+{
+    auto dir = fs::path("out") / "cache" / name;
+    std::error_code ec;
+    fs::remove_all(dir, ec);
+    fs::create_directories(dir, ec);
+    return dir;
+}
+
+TEST(cache, key)
+{
+    compile_options_t options;
+    options.emit_mode = EMIT_OBJECT;
+    std::string key = cache_key(sample, "", options);
+
+    EXPECT_EQ(64u, key.size()); // SHA-256, hex
+    EXPECT_EQ(key, cache_key(sample, "", options));
+    EXPECT_NE(key, cache_key(std::string(sample) + " ", "", options));
+    EXPECT_NE(key, cache_key(sample, "cached.mini", options)); // the source_filename
+
+    compile_options_t O2 = options;
+    O2.opt_level = 2;
+    EXPECT_NE(key, cache_key(sample, "", O2));
+    compile_options_t ir = options;
+    ir.emit_mode = EMIT_IR;
+    EXPECT_NE(key, cache_key(sample, "", ir));
+    compile_options_t checked = options;
+    checked.check_bounds = true;
+    EXPECT_NE(key, cache_key(sample, "", checked));
+}
+
+TEST(cache, store_lookup)
+{
+    auto dir = clean_dir("store_lookup").string();
+    compile_options_t options;
+    std::string key = cache_key(sample, "", options);
+
+    EXPECT_EQ("", cache_lookup(dir, key, EMIT_IR));
+    ASSERT_TRUE(cache_store(dir, key, EMIT_IR, "; ModuleID = 'CACHED'\n"));
+
+    std::string path = cache_lookup(dir, key, EMIT_IR);
+    ASSERT_NE("", path);
+    std::ifstream in(path);
+    std::string line;
+    std::getline(in, line);
+    EXPECT_EQ("; ModuleID = 'CACHED'", line);
+    EXPECT_EQ("", cache_lookup(dir, key, EMIT_OBJECT));
+}
+
+TEST(cache, applies)
+{
+    compile_options_t options;
+    EXPECT_FALSE(cache_applies(options)); // no directory
+    options.cache_dir = "cache";
+    EXPECT_TRUE(cache_applies(options));
+    options.stats = true;
+    EXPECT_FALSE(cache_applies(options));
+    options.stats = false;
+    options.emit_mode = EMIT_JIT;
+    EXPECT_FALSE(cache_applies(options));
+}
+
+TEST(cache, batch_reuses_objects)
+{
+    auto dir = clean_dir("batch_reuses_objects");
+    auto source = dir / "cached.mini";
+    std::ofstream(source) << sample;
+
+    compile_options_t options;
+    options.opt_level = 2;
+    options.cache_dir = (dir / "cache").string();
+    std::vector<std::string> sources {source.string()};
+
+    auto first = compile_batch(sources, options, 1, dir.string().c_str());
+    ASSERT_EQ(0, first[0].rc);
+    EXPECT_FALSE(first[0].cached);
+    auto size = fs::file_size(first[0].output);
+    fs::remove(first[0].output);
+
+    auto second = compile_batch(sources, options, 1, dir.string().c_str());
+    ASSERT_EQ(0, second[0].rc);
+    EXPECT_TRUE(second[0].cached);
+    EXPECT_EQ(size, fs::file_size(second[0].output));
+}
+
+// the IR of a file records its name, a copy of the file has its own entry
+TEST(cache, batch_keyed_by_name)
+{
+    auto dir = clean_dir("batch_keyed_by_name");
+    auto source = dir / "cached.mini", copy = dir / "copy.mini";
+    std::ofstream(source) << sample;
+    std::ofstream(copy) << sample;
+
+    compile_options_t options;
+    options.cache_dir = (dir / "cache").string();
+    std::vector<std::string> sources {source.string()};
+    ASSERT_EQ(0, compile_batch(sources, options, 1, dir.string().c_str())[0].rc);
+
+    sources = {copy.string()};
+    auto second = compile_batch(sources, options, 1, dir.string().c_str());
+    ASSERT_EQ(0, second[0].rc);
+    EXPECT_FALSE(second[0].cached);
+
+    CompilationSession session;
+    session.options().emit_mode = EMIT_MODULE;
+    SourceText text;
+    ASSERT_FALSE(text.load(copy.string().c_str()));
+    ASSERT_EQ(0, session.compile(text));
+    auto M = session.take_module();
+    ASSERT_TRUE(M);
+    EXPECT_EQ(copy.string(), M->getSourceFileName());
+    EXPECT_EQ("CACHED", M->getModuleIdentifier());
+}
+
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// tab-width: 4
+// indent-tabs-mode: nil
+// End:
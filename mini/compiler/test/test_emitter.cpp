@@ -0,0 +1,75 @@
+//
+//
+//
+
+#include <gtest/gtest.h>
+
+#include "emitter.h"
+
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#include <filesystem>
+#include <memory>
+
+namespace fs = std::filesystem;
+
+using namespace llvm;
+
+static LLVMContext TheContext;
+
+TEST(emitter, emit_object_file)
+{
+    auto M = std::make_unique<Module>("emit_object_file", TheContext);
+    IRBuilder<> B(TheContext);
+    FunctionType *FT = FunctionType::get(B.getInt32Ty(), {}, false);
+    Function *F = Function::Create(FT, Function::ExternalLinkage, "main", M.get());
+    B.SetInsertPoint(BasicBlock::Create(TheContext, "entry", F));
+    B.CreateRet(B.getInt32(0));
+
+    auto object_file = fs::path("out") / "emitter" / "emit_object_file.o";
+    std::error_code ec;
+    fs::create_directories(object_file.parent_path(), ec);
+    fs::remove(object_file, ec);
+
+    ASSERT_TRUE(emit_object_file(M.get(), object_file.string().c_str(), 2));
+    ASSERT_TRUE(fs::is_regular_file(object_file));
+    EXPECT_LT(0, fs::file_size(object_file));
+}
+
+TEST(emitter, emit_bitcode_file)
+{
+    auto M = std::make_unique<Module>("emit_bitcode_file", TheContext);
+    IRBuilder<> B(TheContext);
+    FunctionType *FT = FunctionType::get(B.getInt32Ty(), {}, false);
+    Function *F = Function::Create(FT, Function::ExternalLinkage, "main", M.get());
+    B.SetInsertPoint(BasicBlock::Create(TheContext, "entry", F));
+    B.CreateRet(B.getInt32(0));
+
+    auto bitcode_file = fs::path("out") / "emitter" / "emit_bitcode_file.bc";
+    std::error_code ec;
+    fs::create_directories(bitcode_file.parent_path(), ec);
+    fs::remove(bitcode_file, ec);
+
+    ASSERT_TRUE(emit_bitcode_file(M.get(), bitcode_file.string().c_str()));
+    auto buffer = MemoryBuffer::getFile(bitcode_file.string());
+    ASSERT_TRUE(bool(buffer));
+
+    LLVMContext C;
+    auto read = parseBitcodeFile((*buffer)->getMemBufferRef(), C);
+    ASSERT_TRUE(bool(read));
+    EXPECT_TRUE((*read)->getFunction("main"));
+    EXPECT_EQ(M->getTargetTriple(), (*read)->getTargetTriple());
+}
+
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// tab-width: 4
+// indent-tabs-mode: nil
+// End:
@@ -0,0 +1,161 @@
+//
+//
+//
+
+#include <gtest/gtest.h>
+
+#include "mini_system.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <future>
+#include <string>
+#include <thread>
+
+#include <unistd.h>
+
+static void input_from(std::string const &text)
+{
+    static std::string saved;
+    saved = text;
+    rtl_input_from(saved.data(), saved.size());
+}
+
+TEST(input, integers)
+{
+    input_from("1 -2\n+3,\t2147483647 -2147483648");
+    EXPECT_EQ(1, rtl_input_int());
+    EXPECT_EQ(-2, rtl_input_int());
+    EXPECT_EQ(3, rtl_input_int());
+    EXPECT_EQ(INT32_MAX, rtl_input_int());
+    EXPECT_EQ(INT32_MIN, rtl_input_int());
+}
+
+TEST(input, reals_as_strtod)
+{
+    char const *samples[] = {"0",      "1.5",      "-0.125",  "3.14159",  "2.25e1",
+                             "1e-5",   "6.02E23",  "12345678901234567890.5", "0.1",
+                             "1e300",  "4.9e-324", ".5",      "5.",       "123456789012345.6789"};
+    std::string text;
+    for (auto s : samples)
+        text += std::string(s) + " ";
+    input_from(text);
+
+    for (auto s : samples)
+        EXPECT_EQ(strtod(s, 0), rtl_input_real()) << s;
+}
+
+TEST(input, negative_zero)
+{
+    input_from("-0 -0.0 -0e5 0");
+    for (int i = 0; i != 3; ++i) {
+        double zero = rtl_input_real();
+        EXPECT_EQ(0, zero);
+        EXPECT_TRUE(std::signbit(zero)) << i;
+    }
+    EXPECT_FALSE(std::signbit(rtl_input_real()));
+}
+
+TEST(input, strings_and_list)
+{
+    input_from("word \"two words\" 7 1.25 false TRUE");
+    rtl_string_t const *a = 0, *b = 0;
+    int32_t i = 0;
+    double r = 0;
+    char f = 1, t = 0;
+    rtl_input_list("ssirbb", &a, &b, &i, &r, &f, &t);
+
+    EXPECT_EQ("word", std::string(a->data, a->length));
+    EXPECT_EQ("two words", std::string(b->data, b->length));
+    EXPECT_EQ(7, i);
+    EXPECT_EQ(1.25, r);
+    EXPECT_EQ(0, f);
+    EXPECT_EQ(1, t);
+}
+
+// items across the end of what is read ahead, and longer than the buffer,
+// from a pipe
+TEST(input, long_items_from_pipe)
+{
+    std::string head(RTL_INPUT_BUFFER_SIZE - 100, 'h');
+    std::string quoted = std::string(5000, 'q') + " q";
+    std::string word(2 * RTL_INPUT_BUFFER_SIZE + 1, 'w');
+    std::string text = head + " \"" + quoted + "\" " + word + " -" + std::string(RTL_INPUT_MAX_ITEM, '0') + "\n";
+
+    int fds[2];
+    ASSERT_EQ(0, pipe(fds));
+    int saved = dup(0);
+    dup2(fds[0], 0);
+    close(fds[0]);
+    std::thread writer([&] {
+        for (size_t done = 0; done != text.size();)
+            done += write(fds[1], text.data() + done, text.size() - done);
+        close(fds[1]);
+    });
+    rtl_input_from(0, 0);
+
+    rtl_string_t const *s = rtl_input_string();
+    EXPECT_EQ(head, std::string(s->data, s->length));
+    s = rtl_input_string();
+    EXPECT_EQ(quoted, std::string(s->data, s->length));
+    s = rtl_input_string();
+    EXPECT_EQ(word.size(), size_t(s->length));
+    EXPECT_EQ(word, std::string(s->data, s->length));
+    EXPECT_EQ(0, rtl_input_int());
+
+    writer.join();
+    dup2(saved, 0);
+    close(saved);
+    input_from("");
+}
+
+// an item is taken as soon as a separator ends it, while the writer keeps
+// the pipe open
+TEST(input, item_from_open_pipe)
+{
+    int fds[2];
+    ASSERT_EQ(0, pipe(fds));
+    int saved = dup(0);
+    dup2(fds[0], 0);
+    close(fds[0]);
+
+    std::promise<void> taken;
+    bool waited_out = false;
+    std::thread writer([&] {
+        EXPECT_EQ(2, write(fds[1], "5\n", 2));
+        waited_out = taken.get_future().wait_for(std::chrono::seconds(10)) != std::future_status::ready;
+        EXPECT_EQ(3, write(fds[1], "-6 ", 3));
+        close(fds[1]);
+    });
+    rtl_input_from(0, 0);
+
+    EXPECT_EQ(5, rtl_input_int());
+    taken.set_value();
+    EXPECT_EQ(-6, rtl_input_int());
+    writer.join();
+    EXPECT_FALSE(waited_out); // the first item waited for the end of the input
+
+    dup2(saved, 0);
+    close(saved);
+    input_from("");
+}
+
+TEST(input, errors)
+{
+    input_from("12x");
+    EXPECT_EXIT(rtl_input_int(), testing::ExitedWithCode(1), "input item 1: expected an integer");
+    input_from("2147483648");
+    EXPECT_EXIT(rtl_input_int(), testing::ExitedWithCode(1), "out of range");
+    input_from("  \n");
+    EXPECT_EXIT(rtl_input_real(), testing::ExitedWithCode(1), "end of input");
+    input_from("\"no end");
+    EXPECT_EXIT(rtl_input_string(), testing::ExitedWithCode(1), "unterminated string");
+}
+
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// tab-width: 4
+// indent-tabs-mode: nil
+// End:
@@ -0,0 +1,163 @@
+//
+//
+//
+
+#include <gtest/gtest.h>
+
+#include "jit.h"
+#include "session.h"
+
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+
+#include <memory>
+
+using namespace llvm;
+
+//
+// int main() { rtl_output(7); return 42; }
+//
+TEST(jit, run_module)
+{
+    auto C = std::make_unique<LLVMContext>();
+    auto M = std::make_unique<Module>("run_module", *C);
+    IRBuilder<> B(*C);
+
+    FunctionType *OT = FunctionType::get(B.getInt32Ty(), {B.getInt32Ty()}, false);
+    Function *Output = Function::Create(OT, Function::ExternalLinkage, "rtl_output", M.get());
+
+    FunctionType *FT = FunctionType::get(B.getInt32Ty(), {}, false);
+    Function *F = Function::Create(FT, Function::ExternalLinkage, "main", M.get());
+    B.SetInsertPoint(BasicBlock::Create(*C, "entry", F));
+    B.CreateCall(Output, {B.getInt32(7)});
+    B.CreateRet(B.getInt32(42));
+
+    EXPECT_EQ(42, run_module(std::move(M), std::move(C)));
+}
+
+//
+// a library user: source text in, a module for its own JIT out
+//
+TEST(jit, compile_from_memory)
+{
+    CompilationSession session;
+    session.options().emit_mode = EMIT_MODULE;
+    ASSERT_EQ(0, session.compile(R"(/* in memory */
+program MEMORY:
+    declare (i, s) integer;
+    set s := 0;
+    for i := 1 to 10 do
+        set s := s + i;
+    end for;
+    output s;
+end program MEMORY;
+)"));
+
+    auto TSM = take_thread_safe_module(session);
+    ASSERT_TRUE(bool(TSM));
+    TSM.withModuleDo([](Module &M) { EXPECT_TRUE(M.getFunction("main")); });
+    EXPECT_EQ(0, run_module(std::move(TSM)));
+}
+
+//
+// a function that returns a structure keeps its arrays over the release of
+// its arena, which needs rtl_arena_release_keep in the JIT
+//
+TEST(jit, structure_result_kept)
+{
+    CompilationSession session;
+    session.options().emit_mode = EMIT_MODULE;
+    ASSERT_EQ(0, session.compile(R"(/* structure result */
+program KEEP:
+    type vec is structure field n is integer, field v is array [1000] of integer end structure;
+    declare t vec;
+    declare i integer;
+    function make (k integer) vec :
+        declare r vec;
+        declare a array [1000] of integer;
+        set a[1000] := k;
+        set r.n := k;
+        set r.v := a;
+        return r;
+    end function make;
+    for i := 1 to 3 do
+        set t := make(i);
+    end for;
+    output t.n;
+end program KEEP;
+)"));
+
+    testing::internal::CaptureStdout();
+    int rc = run_module(take_thread_safe_module(session));
+    std::string out = testing::internal::GetCapturedStdout();
+    EXPECT_EQ(0, rc);
+    EXPECT_EQ("3 \n", out);
+}
+
+TEST(jit, structure_strings_kept)
+{
+    CompilationSession session;
+    session.options().emit_mode = EMIT_MODULE;
+    ASSERT_EQ(0, session.compile(R"(/* structure result with a string */
+program KEEP:
+    type entry is structure field n is integer, field s is string end structure;
+    declare t entry;
+    declare i integer;
+    function make (k integer) entry :
+        declare r entry;
+        set r.n := k;
+        set r.s := "entry number " || character(48 + k) || " of a long list";
+        return r;
+    end function make;
+    for i := 1 to 3 do
+        set t := make(i);
+    end for;
+    output t.n, t.s;
+end program KEEP;
+)"));
+
+    testing::internal::CaptureStdout();
+    int rc = run_module(take_thread_safe_module(session));
+    std::string out = testing::internal::GetCapturedStdout();
+    EXPECT_EQ(0, rc);
+    EXPECT_EQ("3 entry number 3 of a long list \n", out);
+}
+
+//
+// a function that returns a string keeps it over the release of its arena
+//
+TEST(jit, string_result_kept)
+{
+    CompilationSession session;
+    session.options().emit_mode = EMIT_MODULE;
+    ASSERT_EQ(0, session.compile(R"(/* string result */
+program KEEPS:
+    declare s string;
+    declare i integer;
+    function label_of (k integer) string :
+        return "item number " || character(48 + k) || " of a long list";
+    end function label_of;
+    for i := 1 to 3 do
+        set s := label_of(i);
+    end for;
+    output s;
+end program KEEPS;
+)"));
+
+    testing::internal::CaptureStdout();
+    int rc = run_module(take_thread_safe_module(session));
+    std::string out = testing::internal::GetCapturedStdout();
+    EXPECT_EQ(0, rc);
+    EXPECT_EQ("item number 3 of a long list \n", out);
+}
+
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// tab-width: 4
+// indent-tabs-mode: nil
+// End:
@@ -0,0 +1,143 @@
+//
+//
+//
+
+#include <gtest/gtest.h>
+
+#include "optimizer.h"
+
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <memory>
+#include <string>
+
+using namespace llvm;
+
+static LLVMContext TheContext;
+
+//
+// int f() { int x; x = 42; return x; }
+//
+static Function *create_alloca_function(Module *M)
+{
+    IRBuilder<> B(TheContext);
+    FunctionType *FT = FunctionType::get(B.getInt32Ty(), {}, false);
+    Function *F = Function::Create(FT, Function::ExternalLinkage, "f", M);
+    B.SetInsertPoint(BasicBlock::Create(TheContext, "entry", F));
+    Value *x = B.CreateAlloca(B.getInt32Ty(), 0, "x");
+    B.CreateStore(B.getInt32(42), x);
+    B.CreateRet(B.CreateLoad(B.getInt32Ty(), x, "tmpvar"));
+    return F;
+}
+
+static size_t count_allocas(Function *F)
+{
+    size_t n = 0;
+    for (auto &I : instructions(F))
+        if (isa<AllocaInst>(I))
+            ++n;
+    return n;
+}
+
+TEST(optimizer, O0_keeps_allocas)
+{
+    auto M = std::make_unique<Module>("O0_keeps_allocas", TheContext);
+    set_module_target(M.get());
+    Function *F = create_alloca_function(M.get());
+
+    optimize_module(M.get(), 0);
+
+    EXPECT_EQ(1, count_allocas(F));
+}
+
+TEST(optimizer, O2_promotes_allocas)
+{
+    auto M = std::make_unique<Module>("O2_promotes_allocas", TheContext);
+    set_module_target(M.get());
+    Function *F = create_alloca_function(M.get());
+
+    optimize_module(M.get(), 2);
+
+    EXPECT_EQ(0, count_allocas(F));
+    auto ret = dyn_cast<ReturnInst>(F->getEntryBlock().getTerminator());
+    ASSERT_TRUE(ret);
+    auto rc = dyn_cast<ConstantInt>(ret->getReturnValue());
+    ASSERT_TRUE(rc);
+    EXPECT_EQ(42, rc->getSExtValue());
+}
+
+//
+// private int g() { return 42; }  int f() { return g(); }
+//
+static Function *create_call(Module *M)
+{
+    IRBuilder<> B(TheContext);
+    FunctionType *FT = FunctionType::get(B.getInt32Ty(), {}, false);
+    Function *G = Function::Create(FT, Function::PrivateLinkage, "g", M);
+    B.SetInsertPoint(BasicBlock::Create(TheContext, "entry", G));
+    B.CreateRet(B.getInt32(42));
+
+    Function *F = Function::Create(FT, Function::ExternalLinkage, "f", M);
+    B.SetInsertPoint(BasicBlock::Create(TheContext, "entry", F));
+    B.CreateRet(B.CreateCall(G, {}, "fcall"));
+    return F;
+}
+
+TEST(optimizer, O0_inlines_if_asked)
+{
+    auto M = std::make_unique<Module>("O0_inlines_if_asked", TheContext);
+    set_module_target(M.get());
+    Function *F = create_call(M.get());
+
+    std::string report;
+    raw_string_ostream out(report);
+    uint64_t inlined = 0;
+    ipo_options_t ipo;
+    ipo.inline_functions = true;
+    ipo.report = &out;
+    ipo.inlined = &inlined;
+    optimize_module(M.get(), 0, ipo);
+
+    EXPECT_EQ(1u, inlined);
+    EXPECT_NE(std::string::npos, out.str().find("'g' inlined into 'f'"));
+    EXPECT_FALSE(M->getFunction("g")); // no longer called
+    for (auto &I : instructions(F))
+        EXPECT_FALSE(isa<CallInst>(I));
+}
+
+// the report is of the default pipeline's inliner, which inlines the call once
+TEST(optimizer, O1_reports_default_inliner)
+{
+    auto M = std::make_unique<Module>("O1_reports_default_inliner", TheContext);
+    set_module_target(M.get());
+    Function *F = create_call(M.get());
+
+    std::string report;
+    raw_string_ostream out(report);
+    uint64_t inlined = 0;
+    ipo_options_t ipo;
+    ipo.report = &out;
+    ipo.inlined = &inlined;
+    optimize_module(M.get(), 1, ipo);
+
+    EXPECT_EQ(1u, inlined);
+    EXPECT_NE(std::string::npos, out.str().find("'g' inlined into 'f'"));
+    EXPECT_FALSE(M->getFunction("g"));
+    auto ret = dyn_cast<ReturnInst>(F->getEntryBlock().getTerminator());
+    ASSERT_TRUE(ret);
+    EXPECT_TRUE(isa<ConstantInt>(ret->getReturnValue()));
+}
+
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// tab-width: 4
+// indent-tabs-mode: nil
+// End:
@@ -0,0 +1,67 @@
+//
+//
+//
+
+#include <gtest/gtest.h>
+
+#include "mini_system.h"
+
+#include <climits>
+#include <cstdio>
+#include <random>
+#include <string>
+
+static std::string format_int(int d)
+{
+    char buf[RTL_FORMAT_SIZE];
+    return std::string(buf, rtl_format_int(buf, d));
+}
+
+static std::string format_real(double d)
+{
+    char buf[RTL_FORMAT_SIZE];
+    return std::string(buf, rtl_format_real(buf, d));
+}
+
+static std::string printf_g(double d)
+{
+    char buf[RTL_FORMAT_SIZE];
+    snprintf(buf, sizeof(buf), "%g", d);
+    return buf;
+}
+
+TEST(output, format_int)
+{
+    EXPECT_EQ("0", format_int(0));
+    EXPECT_EQ("7", format_int(7));
+    EXPECT_EQ("-42", format_int(-42));
+    EXPECT_EQ("2147483647", format_int(INT_MAX));
+    EXPECT_EQ("-2147483648", format_int(INT_MIN));
+}
+
+TEST(output, format_real_like_printf)
+{
+    for (double d : {0.0, -0.0, 1.0, -1.0, 0.1, 0.5, 2.5, 1e-4, 9.99999e-5, 0.000123456789,
+                     123456.0, 999999.4, 999999.5, 1e6, 1e100, 3.14159265358979, 1.0 / 3}) {
+        EXPECT_EQ(printf_g(d), format_real(d)) << d;
+    }
+
+    std::mt19937_64 gen(1);
+    std::uniform_real_distribution<double> mantissa(-10, 10);
+    std::uniform_int_distribution<int> exponent(-6, 8);
+    for (int i = 0; i != 200000; ++i) {
+        double d = mantissa(gen);
+        for (int e = exponent(gen); e > 0; --e)
+            d *= 10;
+        for (int e = exponent(gen); e < 0; ++e)
+            d /= 10;
+        ASSERT_EQ(printf_g(d), format_real(d)) << d;
+    }
+}
+
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// tab-width: 4
+// indent-tabs-mode: nil
+// End:
@@ -0,0 +1,198 @@
+//
+//
+//
+
+#include <gtest/gtest.h>
+
+#include "session.h"
+
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <string>
+
+using namespace llvm;
+
+// the number of errors; the text of the module, which has to be valid, if
+// there are none
+static int compile(char const *text, std::string *ir = 0)
+{
+    CompilationSession session;
+    session.options().emit_mode = EMIT_MODULE;
+    int errors = session.compile(StringRef(text));
+    if (!errors) {
+        auto M = session.take_module();
+        EXPECT_TRUE(M && !verifyModule(*M, &errs()));
+        if (M && ir) {
+            raw_string_ostream out(*ir);
+            M->print(out, 0);
+        }
+    }
+    return errors;
+}
+
+TEST(sema, integer_converted_to_real)
+{
+    std::string ir;
+    EXPECT_EQ(0, compile("program MIXED:\n"
+                         "    declare x real;\n"
+                         "    declare a array [3] of real;\n"
+                         "    declare i integer;\n"
+                         "    function half (r real) real :\n"
+                         "        return r / 2;\n"
+                         "    end function half;\n"
+                         "    set i := 3;\n"
+                         "    set x := i + 0.5;\n"
+                         "    set a[i - 1] := i;\n"
+                         "    output x * i, half(i), a[2], i mod 2;\n"
+                         "    if x > i then output x; fi;\n"
+                         "    for x := 0.5 by 0.5 to i do\n"
+                         "        output x;\n"
+                         "    end for;\n"
+                         "end program MIXED;\n",
+                         &ir));
+    EXPECT_NE(std::string::npos, ir.find("sitofp"));
+    EXPECT_NE(std::string::npos, ir.find("srem"));
+    EXPECT_NE(std::string::npos, ir.find("fcmp"));
+    EXPECT_NE(std::string::npos, ir.find("fcmp ole"));
+}
+
+TEST(sema, literals_folded)
+{
+    std::string ir;
+    EXPECT_EQ(0, compile("program FOLD:\n"
+                         "    declare i integer;\n"
+                         "    input i;\n"
+                         "    set i := (2 + 3) * 4 - 7 mod 4 - 7 / 4;\n"
+                         "    if 1 < 2 and 2.5 <> 3 xor false then output i; fi;\n"
+                         "    select i of\n"
+                         "        case 3 + 4: output 7;\n"
+                         "        case 2 * 4: output 8;\n"
+                         "        otherwise: output 0;\n"
+                         "    end select;\n"
+                         "end program FOLD;\n",
+                         &ir));
+    EXPECT_NE(std::string::npos, ir.find("store i32 16"));
+    EXPECT_EQ(std::string::npos, ir.find("mul i32"));
+    EXPECT_EQ(std::string::npos, ir.find("sdiv"));
+    EXPECT_EQ(std::string::npos, ir.find("srem"));
+    EXPECT_EQ(std::string::npos, ir.find("fcmp"));
+    EXPECT_NE(std::string::npos, ir.find("switch i32"));
+}
+
+TEST(sema, division_by_zero_left_to_run_time)
+{
+    EXPECT_EQ(0, compile("program ZERO:\n"
+                         "    declare i integer;\n"
+                         "    set i := 1 / 0;\n"
+                         "    set i := 1 mod 0;\n"
+                         "end program ZERO;\n"));
+}
+
+TEST(sema, type_errors)
+{
+    // operands
+    EXPECT_NE(0, compile("program E:\n"
+                         "    output \"a\" + 1;\n"
+                         "end program E;\n"));
+    EXPECT_NE(0, compile("program E:\n"
+                         "    declare s string;\n"
+                         "    set s := \"a\";\n"
+                         "    if s < \"b\" then output s; fi;\n"
+                         "end program E;\n"));
+    EXPECT_NE(0, compile("program E:\n"
+                         "    output 1 and true;\n"
+                         "end program E;\n"));
+    EXPECT_NE(0, compile("program E:\n"
+                         "    output 1.5 mod 2;\n"
+                         "end program E;\n"));
+    // subscript
+    EXPECT_NE(0, compile("program E:\n"
+                         "    declare a array [3] of integer;\n"
+                         "    set a[1.5] := 1;\n"
+                         "end program E;\n"));
+    // assignment
+    EXPECT_NE(0, compile("program E:\n"
+                         "    declare i integer;\n"
+                         "    set i := 1.5;\n"
+                         "end program E;\n"));
+    EXPECT_NE(0, compile("program E:\n"
+                         "    declare i integer;\n"
+                         "    declare x real;\n"
+                         "    set i := x := 1;\n"
+                         "end program E;\n"));
+    // argument
+    EXPECT_NE(0, compile("program E:\n"
+                         "    function twice (n integer) integer :\n"
+                         "        return 2 * n;\n"
+                         "    end function twice;\n"
+                         "    output twice(1.5);\n"
+                         "end program E;\n"));
+    // condition
+    EXPECT_NE(0, compile("program E:\n"
+                         "    if 1 then output 1; fi;\n"
+                         "end program E;\n"));
+}
+
+TEST(sema, aggregates_of_one_type)
+{
+    // arrays of one element type and rank, whatever their bounds
+    EXPECT_EQ(0, compile("program A:\n"
+                         "    type p is structure field n is integer end structure;\n"
+                         "    declare a array [3] of integer;\n"
+                         "    declare b array [5] of integer;\n"
+                         "    declare (x, y) p;\n"
+                         "    function make (k integer) p :\n"
+                         "        declare r p;\n"
+                         "        set r.n := k;\n"
+                         "        return r;\n"
+                         "    end function make;\n"
+                         "    set a := b;\n"
+                         "    set x := y := make(1);\n"
+                         "end program A;\n"));
+    // element type
+    EXPECT_NE(0, compile("program E:\n"
+                         "    declare a array [3] of integer;\n"
+                         "    declare b array [3] of real;\n"
+                         "    set a := b;\n"
+                         "end program E;\n"));
+    // rank
+    EXPECT_NE(0, compile("program E:\n"
+                         "    declare a array [3] of integer;\n"
+                         "    declare c array [3] of array [3] of integer;\n"
+                         "    set a := c;\n"
+                         "end program E;\n"));
+    // structures of other declarations, also as targets and results
+    EXPECT_NE(0, compile("program E:\n"
+                         "    type p is structure field n is integer end structure;\n"
+                         "    type q is structure field n is integer end structure;\n"
+                         "    declare x p;\n"
+                         "    declare y q;\n"
+                         "    set x := y;\n"
+                         "end program E;\n"));
+    EXPECT_NE(0, compile("program E:\n"
+                         "    type p is structure field n is integer end structure;\n"
+                         "    type q is structure field n is integer end structure;\n"
+                         "    declare (x, z) p;\n"
+                         "    declare y q;\n"
+                         "    set x := y := z;\n"
+                         "end program E;\n"));
+    EXPECT_NE(0, compile("program E:\n"
+                         "    type p is structure field n is integer end structure;\n"
+                         "    type q is structure field n is integer end structure;\n"
+                         "    declare x p;\n"
+                         "    function make (k integer) q :\n"
+                         "        declare r p;\n"
+                         "        return r;\n"
+                         "    end function make;\n"
+                         "    set x := make(1);\n"
+                         "end program E;\n"));
+}
+
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// tab-width: 4
+// indent-tabs-mode: nil
+// End:
@@ -0,0 +1,129 @@
+//
+//
+//
+
+#include <gtest/gtest.h>
+
+#include "session.h"
+#include "source.h"
+#include "TreeNode.h"
+
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Support/Process.h"
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <type_traits>
+
+namespace fs = std::filesystem;
+
+static fs::path write_source(char const *name, std::string const &text)
+{
+    auto path = fs::path("out") / "source" / name;
+    std::error_code ec;
+    fs::create_directories(path.parent_path(), ec);
+    std::ofstream(path, std::ios::binary) << text;
+    return path;
+}
+
+// a program of about size bytes
+static std::string program(size_t size)
+{
+    std::string text = "program BIG:\n    declare (counter, total) integer;\n    set total := 0;\n";
+    while (text.size() + 64 < size)
+        text += "    set counter := total + 1; set total := counter;\n";
+    text += "    output total;\nend program BIG;\n";
+    return text;
+}
+
+TEST(source, read_small_file)
+{
+    auto path = write_source("small.mini", "program SMALL:\nend program SMALL;\n");
+    SourceText source;
+    ASSERT_FALSE(source.load(path.string().c_str()));
+
+    EXPECT_FALSE(source.mapped());
+    EXPECT_EQ("program SMALL:\nend program SMALL;\n", source.text());
+    ASSERT_EQ(source.text().size() + 2, source.scan_size());
+    EXPECT_EQ(0, source.scan_data()[source.scan_size() - 2]);
+    EXPECT_EQ(0, source.scan_data()[source.scan_size() - 1]);
+}
+
+TEST(source, map_large_file)
+{
+    std::string text = program(100000);
+    size_t page = llvm::sys::Process::getPageSizeEstimate();
+    if (text.size() % page == 0 || page - text.size() % page < 2)
+        text += "\n\n\n";
+    auto path = write_source("large.mini", text);
+
+    SourceText source;
+    ASSERT_FALSE(source.load(path.string().c_str()));
+#ifndef _WIN32
+    EXPECT_TRUE(source.mapped());
+#endif
+    EXPECT_EQ(text, source.text());
+    EXPECT_EQ(0, source.scan_data()[text.size()]);
+    EXPECT_EQ(0, source.scan_data()[text.size() + 1]);
+
+    // written to by the scanner, copy-on-write: the file stays as it was
+    source.scan_data()[0] = 0;
+    SourceText again;
+    ASSERT_FALSE(again.load(path.string().c_str()));
+    EXPECT_EQ(text, again.text());
+}
+
+TEST(source, page_multiple_is_read)
+{
+    size_t page = llvm::sys::Process::getPageSizeEstimate();
+    std::string text = program(8 * page - 100);
+    text.append(8 * page - text.size(), '\n');
+    auto path = write_source("pages.mini", text);
+
+    SourceText source;
+    ASSERT_FALSE(source.load(path.string().c_str()));
+    EXPECT_FALSE(source.mapped()); // no room for the NULs in the last page
+    EXPECT_EQ(text, source.text());
+    EXPECT_EQ(0, source.scan_data()[text.size() + 1]);
+}
+
+TEST(source, missing_file)
+{
+    SourceText source;
+    EXPECT_TRUE(source.load("out/source/no such file.mini"));
+}
+
+TEST(source, compile_mapped)
+{
+    auto path = write_source("compile.mini", program(200000));
+    SourceText source;
+    ASSERT_FALSE(source.load(path.string().c_str()));
+
+    CompilationSession session;
+    session.options().emit_mode = EMIT_MODULE;
+    ASSERT_EQ(0, session.compile(source));
+    auto M = session.take_module();
+    ASSERT_TRUE(M);
+    EXPECT_EQ("BIG", M->getName());
+    EXPECT_FALSE(llvm::verifyModule(*M, &llvm::errs()));
+}
+
+TEST(source, tokens_are_views)
+{
+    // nothing for the arena to destroy
+    EXPECT_TRUE(std::is_trivially_destructible<TreeIdentNode>::value);
+    EXPECT_TRUE(std::is_trivially_destructible<TreeTextNode>::value);
+
+    char text[] = "total";
+    TreeIdentNode ident(std::string_view(text, 5));
+    EXPECT_EQ(text, ident.id.data());
+}
+
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// tab-width: 4
+// indent-tabs-mode: nil
+// End:
@@ -0,0 +1,136 @@
+//
+//
+//
+
+#include <gtest/gtest.h>
+
+#include "mini_system.h"
+
+#include <climits>
+#include <string>
+
+static std::string text(rtl_string_t const *s)
+{
+    return std::string(s->data, s->length);
+}
+
+TEST(string, character)
+{
+    rtl_string_t const *a = rtl_string_character('a');
+    EXPECT_EQ("a", text(a));
+    EXPECT_EQ(a, rtl_string_character('a')); // a static table
+    EXPECT_EQ(1, rtl_string_character(0)->length);
+}
+
+TEST(string, concat_short_inline)
+{
+    rtl_string_t const *s =
+        rtl_string_concat(3, rtl_string_character('a'), rtl_string_character('b'), rtl_string_character('c'));
+    EXPECT_EQ("abc", text(s));
+    EXPECT_EQ(s->small, s->data);
+    EXPECT_EQ(nullptr, s->buffer);
+}
+
+TEST(string, concat_null_and_empty)
+{
+    rtl_string_t const *a = rtl_string_character('a');
+    EXPECT_EQ(a, rtl_string_concat(2, a, nullptr));
+    EXPECT_EQ(0, rtl_string_concat(2, nullptr, nullptr)->length);
+    EXPECT_EQ(0, rtl_string_concat(0)->length);
+}
+
+TEST(string, append_in_place)
+{
+    rtl_string_t const *s = rtl_string_character('x');
+    rtl_string_stats_t before = *rtl_string_stats();
+    for (int i = 0; i != 10000; ++i)
+        s = rtl_string_concat(2, s, rtl_string_character('0' + i % 10));
+    rtl_string_stats_t const *after = rtl_string_stats();
+
+    ASSERT_EQ(10001, s->length);
+    EXPECT_EQ("x0123", text(s).substr(0, 5));
+    EXPECT_EQ("6789", text(s).substr(10001 - 4));
+    // buffers grow geometrically: few copies, and O(n) bytes in all
+    EXPECT_GT(20u, after->copies - before.copies);
+    EXPECT_GT(10000u - 20, after->appends - before.appends);
+    EXPECT_GT(10000u * 64, after->bytes - before.bytes);
+}
+
+TEST(string, shared_prefix_not_changed)
+{
+    rtl_string_t const *s = rtl_string_character('s');
+    for (int i = 0; i != 20; ++i)
+        s = rtl_string_concat(2, s, rtl_string_character('.'));
+
+    rtl_string_t const *t = rtl_string_concat(2, s, rtl_string_character('t'));
+    rtl_string_t const *u = rtl_string_concat(2, s, rtl_string_character('u'));
+    EXPECT_EQ(21, s->length);
+    EXPECT_EQ('t', text(t).back());
+    EXPECT_EQ('u', text(u).back());
+    EXPECT_EQ(text(s), text(t).substr(0, 21));
+}
+
+TEST(string, substr)
+{
+    rtl_string_t const *s = rtl_string_character('a');
+    for (char c = 'b'; c <= 'z'; ++c)
+        s = rtl_string_concat(2, s, rtl_string_character(c));
+
+    EXPECT_EQ("bcd", text(rtl_string_substr(s, 2, 3)));
+    EXPECT_EQ("ab", text(rtl_string_substr(s, 0, 3))); // from position 1
+    EXPECT_EQ("yz", text(rtl_string_substr(s, 25, 10)));
+    EXPECT_EQ(0, rtl_string_substr(s, 27, 1)->length);
+    EXPECT_EQ(0, rtl_string_substr(s, 1, -1)->length);
+    EXPECT_EQ(s, rtl_string_substr(s, 1, 26));
+    EXPECT_EQ(0, rtl_string_substr(s, INT_MIN, INT_MAX)->length); // 1 - start overflows int
+    EXPECT_EQ("abc", text(rtl_string_substr(s, -INT_MAX + 4, INT_MAX)));
+
+    size_t views = rtl_string_stats()->views;
+    rtl_string_t const *long_part = rtl_string_substr(s, 3, 20);
+    EXPECT_EQ(s->data + 2, long_part->data); // no copy
+    EXPECT_EQ(views + 1, rtl_string_stats()->views);
+    rtl_string_t const *short_part = rtl_string_substr(s, 3, 4);
+    EXPECT_EQ(short_part->small, short_part->data);
+    EXPECT_EQ("cdef", text(short_part));
+}
+
+TEST(string, released_with_arena)
+{
+    void *mark = rtl_arena_mark();
+    rtl_string_t const *s = rtl_string_make("a string longer than inline", 27);
+    rtl_arena_release(mark);
+
+    EXPECT_EQ(static_cast<void const *>(s), rtl_arena_allocate_words(1)); // reused
+    rtl_arena_release(mark);
+}
+
+TEST(string, keep_moves_down)
+{
+    void *mark = rtl_arena_mark();
+    rtl_string_make("garbage, garbage, garbage", 25);
+    rtl_string_t const *s = rtl_string_make("a string longer than inline", 27);
+    rtl_string_t const *view = rtl_string_substr(s, 3, 20);
+
+    rtl_string_t const *kept = rtl_string_keep(mark, view);
+    EXPECT_EQ("string longer than i", text(kept));
+    EXPECT_LT(static_cast<void const *>(kept), static_cast<void const *>(view));
+    EXPECT_EQ(mark, static_cast<void const *>(kept->buffer)); // allocated before the header
+    rtl_arena_release(mark);
+
+    s = rtl_string_make("a string longer than inline", 27);
+    rtl_string_t const *small = rtl_string_substr(s, 3, 6);
+    kept = rtl_string_keep(mark, small);
+    EXPECT_EQ("string", text(kept));
+    EXPECT_EQ(kept->small, kept->data);
+    rtl_arena_release(mark);
+
+    rtl_string_t const *literal = rtl_string_character('a');
+    EXPECT_EQ(literal, rtl_string_keep(mark, literal));
+}
+
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// tab-width: 4
+// indent-tabs-mode: nil
+// End:
@@ -0,0 +1,176 @@
+//
+//
+//
+
+#include <gtest/gtest.h>
+
+#include "symbol_table.h"
+#include "session.h"
+
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+
+#include <string>
+
+using namespace llvm;
+
+TEST(symbol_interner, same_name_same_id)
+{
+    symbol_interner names;
+    EXPECT_EQ(no_symbol, names.find("total"));
+
+    std::string text = "total";
+    symbol_id_t id = names.intern(text);
+    EXPECT_NE(no_symbol, id);
+    text = "other";
+    EXPECT_EQ(id, names.intern("total"));
+    EXPECT_EQ(id, names.find("total"));
+    EXPECT_EQ("total", names.name(id)); // a copy, not the view interned
+    EXPECT_NE(id, names.intern("other"));
+}
+
+TEST(symbol_interner, grows)
+{
+    symbol_interner names;
+    std::vector<symbol_id_t> ids;
+    for (int i = 0; i != 10000; ++i)
+        ids.push_back(names.intern("v" + std::to_string(i)));
+    for (int i = 0; i != 10000; ++i) {
+        auto name = "v" + std::to_string(i);
+        ASSERT_EQ(ids[i], names.find(name));
+        ASSERT_EQ(name, names.name(ids[i]));
+    }
+    EXPECT_EQ(10001u, names.size());
+}
+
+TEST(symbol_table, shadowing)
+{
+    symbol_table table;
+    symbol_id_t x = table.names.intern("x");
+
+    table.open_scope(1);
+    symbol_t outer(SYMBOL_VARIABLE, x);
+    symbol_t *bound = table.insert(outer);
+    ASSERT_TRUE(bound);
+    EXPECT_FALSE(table.insert(outer));
+
+    // a function of the same name
+    symbol_t function(SYMBOL_FUNCTION, x);
+    ASSERT_TRUE(table.insert(function));
+
+    table.open_scope(2);
+    EXPECT_EQ(1u, table.find(x, SYMBOL_VARIABLE)->level);
+    symbol_t inner(SYMBOL_VARIABLE, x);
+    symbol_t *hiding = table.insert(inner);
+    ASSERT_TRUE(hiding);
+    EXPECT_EQ(hiding, table.find(x, SYMBOL_VARIABLE));
+    EXPECT_EQ(2u, table.find(x, SYMBOL_VARIABLE)->level);
+    EXPECT_TRUE(table.find(x, SYMBOL_FUNCTION));
+    table.close_scope();
+
+    EXPECT_EQ(bound, table.find(x, SYMBOL_VARIABLE));
+    table.close_scope();
+    EXPECT_FALSE(table.find(x, SYMBOL_VARIABLE));
+    EXPECT_EQ(0u, table.scope_count());
+}
+
+TEST(symbol_table, fields_of_structure)
+{
+    LLVMContext context;
+    auto first = StructType::create(context, "first");
+    auto second = StructType::create(context, "second");
+
+    symbol_table table;
+    symbol_id_t y = table.names.intern("y");
+    table.open_scope(1);
+
+    symbol_t field(SYMBOL_FIELD, y);
+    field.type = first;
+    field.field = 1;
+    ASSERT_TRUE(table.insert(field));
+    EXPECT_FALSE(table.insert(field));
+    field.type = second;
+    field.field = 0;
+    ASSERT_TRUE(table.insert(field));
+
+    EXPECT_EQ(1u, table.find(y, SYMBOL_FIELD, first)->field);
+    EXPECT_EQ(0u, table.find(y, SYMBOL_FIELD, second)->field);
+    EXPECT_FALSE(table.find(y, SYMBOL_VARIABLE));
+}
+
+TEST(symbol_table, erase_label)
+{
+    symbol_table table;
+    symbol_id_t l = table.names.intern("l");
+    table.open_scope(1);
+    ASSERT_TRUE(table.insert(symbol_t(SYMBOL_LABEL, l)));
+    table.erase(table.find(l, SYMBOL_LABEL));
+    EXPECT_FALSE(table.find(l, SYMBOL_LABEL));
+    EXPECT_TRUE(table.insert(symbol_t(SYMBOL_LABEL, l)));
+}
+
+// the number of errors, the module has to be valid if there are none
+static int compile(char const *text)
+{
+    CompilationSession session;
+    session.options().emit_mode = EMIT_MODULE;
+    int errors = session.compile(StringRef(text));
+    if (!errors) {
+        auto M = session.take_module();
+        EXPECT_TRUE(M && !verifyModule(*M, &errs()));
+    }
+    return errors;
+}
+
+TEST(symbol_table, nested_function_uses_outer_variable)
+{
+    EXPECT_EQ(0, compile("program OUTER:\n"
+                         "    declare total integer;\n"
+                         "    function add (n integer) integer :\n"
+                         "        function twice (k integer) integer :\n"
+                         "            set total := total + k;\n"
+                         "            return n + k;\n"
+                         "        end function twice;\n"
+                         "        return twice(n);\n"
+                         "    end function add;\n"
+                         "    set total := 0;\n"
+                         "    output add(1), total;\n"
+                         "end program OUTER;\n"));
+}
+
+TEST(symbol_table, named_types)
+{
+    EXPECT_EQ(0, compile("program TYPES:\n"
+                         "    type pair is structure field a is integer, field b is real end structure;\n"
+                         "    type other is structure field b is integer end structure;\n"
+                         "    type same is pair;\n"
+                         "    declare (p, q) same;\n"
+                         "    declare o other;\n"
+                         "    set p.b := 1.5;\n"
+                         "    set o.b := 2;\n"
+                         "    output p.b, o.b;\n"
+                         "end program TYPES;\n"));
+    EXPECT_NE(0, compile("program TYPES:\n"
+                         "    declare p nothing;\n"
+                         "end program TYPES;\n"));
+}
+
+TEST(symbol_table, declared_twice)
+{
+    EXPECT_NE(0, compile("program TWICE:\n"
+                         "    declare x integer;\n"
+                         "    declare x real;\n"
+                         "end program TWICE;\n"));
+    EXPECT_NE(0, compile("program FIELDS:\n"
+                         "    declare p structure field a is integer end structure;\n"
+                         "    set p.b := 1;\n"
+                         "end program FIELDS;\n"));
+}
+
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// tab-width: 4
+// indent-tabs-mode: nil
+// End:
@@ -6,6 +6,7 @@
 
 #include "symbol_type_table.h"
 #include "parser_bits.h"
+#include "session.h"
 
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/DerivedTypes.h>
@@ -15,8 +16,11 @@
 
 using namespace llvm;
 
-extern LLVMContext TheContext;
-extern IRBuilder<> Builder;
+// CreateStructType and friends generate into the current session
+static CompilationSession session;
+static CompilationSession::Scope scope(session);
+static LLVMContext &TheContext = session.context();
+static IRBuilder<> &Builder = session.builder();
 
 TEST(symbol_type_table, t1)
 {
@@ -6,6 +6,7 @@
 
 #include "parser.h"
 #include "parser_bits.h"
+#include "session.h"
 #include "TreeNode.h"
 #include "llvm_helper.h"
 
@@ -13,7 +14,9 @@
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/ADT/APFloat.h"
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/Analysis/ValueTracking.h"
 #include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/CFG.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/Argument.h"
@@ -33,17 +36,19 @@
 #include <typeinfo>
 #include <filesystem>
 #include <fstream>
+#include <thread>
 
 namespace fs = std::filesystem;
 
 using namespace llvm;
 
-extern LLVMContext TheContext;
-extern IRBuilder<> Builder;
-
 class CompilerTestBase : public ::testing::Test {
 public:
+    CompilationSession session;
+    CompilationSession::Scope scope {session};
+
     LLVMContext &C;
+    IRBuilder<> &Builder;
 
     Module *TheModule;
     Function *F;
@@ -51,7 +56,8 @@ public:
     bool verbose;
 
     CompilerTestBase()
-        : C(TheContext)
+        : C(session.context())
+        , Builder(session.builder())
         , verbose {false}
     {
         static bool once;
@@ -142,6 +148,18 @@ TEST_F(T2, CreateArrayType)
     type->dump();
 }
 
+TEST_F(T2, CreateArrayType_per_element_type)
+{
+    auto ints = cast<StructType>(CreateArrayType(Type::getInt32Ty(C), 1));
+    auto reals = cast<StructType>(CreateArrayType(Type::getDoubleTy(C), 1));
+    ASSERT_NE(ints, reals);
+    ASSERT_NE(ints, CreateArrayType(Type::getInt32Ty(C), 2));
+    ASSERT_EQ(ints, CreateArrayType(Type::getInt32Ty(C), 1));
+
+    ASSERT_EQ(Type::getInt32Ty(C), array_get_elem_type(ints));
+    ASSERT_EQ(Type::getDoubleTy(C), array_get_elem_type(reals));
+}
+
 TEST_F(T2, get_current_function)
 {
     Function *actual = get_current_function();
@@ -232,8 +250,8 @@ TEST_F(T2, node_to_type_structure)
     // 1. construct TreeNode
     // [STRUCTURE,COMMA(FIELD(first T_REAL(<null>)) FIELD(second T_REAL(<null>))),<null>]
 
-    auto *_1 = make_binary(new TreeIdentNode("first"), base_type(T_REAL), FIELD);
-    auto *_3 = make_binary(new TreeIdentNode("second"), base_type(T_REAL), FIELD);
+    auto *_1 = make_binary(ast_arena().make<TreeIdentNode>("first"), base_type(T_REAL), FIELD);
+    auto *_3 = make_binary(ast_arena().make<TreeIdentNode>("second"), base_type(T_REAL), FIELD);
     auto *_2 = make_binary(_1, _3, COMMA);
     auto *s_node = make_binary(_2, 0, STRUCTURE);
 
@@ -290,10 +308,6 @@ TEST_F(T2, create_nested_function)
 }
 
 #include "parser.h"
-#include "parser_bits.h"
-
-extern int yyparse();
-extern int yylineno;
 
 class CompilerF : public CompilerTestBase {
 protected:
@@ -310,6 +324,33 @@ protected:
         ss << text;
         return ss.good();
     }
+
+    // compile sample into a module, without printing it
+    std::unique_ptr<Module> compile_sample(char const *sample)
+    {
+#ifdef YYDEBUG
+        extern int yydebug;
+#endif
+        auto sample_mini = create_workspace() / "sample.mini";
+        if (!save_as_text(sample, sample_mini))
+            return 0;
+
+#ifndef NDEBUG
+        yydebug = 0;
+        session.options().verbose = false;
+#endif
+        FILE *in = fopen(sample_mini.string().c_str(), "r");
+        if (!in)
+            return 0;
+
+        session.options().emit_mode = EMIT_JIT; // keep the module, do not print it
+        int rc = session.compile(in);
+        fclose(in);
+        if (rc)
+            return 0;
+
+        return session.take_module();
+    }
 };
 
 TEST_F(CompilerF, function_abs)
@@ -340,12 +381,13 @@ end program FUNC;
 
 #ifndef NDEBUG
     yydebug = 0;
-    flag_verbose = false;
+    session.options().verbose = false;
 #endif
-    ASSERT_TRUE(freopen(sample_mini.string().c_str(), "r", stdin));
+    FILE *in = fopen(sample_mini.string().c_str(), "r");
+    ASSERT_TRUE(in);
 
-    init_compiler();
-    int rc = yyparse();
+    int rc = session.compile(in);
+    fclose(in);
 
     ASSERT_EQ(0, rc);
 }
@@ -370,16 +412,708 @@ end program hello_world;
 
 #ifndef NDEBUG
     yydebug = 0;
-    flag_verbose = false;
+    session.options().verbose = false;
 #endif
-    ASSERT_TRUE(freopen(sample_mini.string().c_str(), "r", stdin));
+    FILE *in = fopen(sample_mini.string().c_str(), "r");
+    ASSERT_TRUE(in);
 
-    init_compiler();
-    int rc = yyparse();
+    int rc = session.compile(in);
+    fclose(in);
 
     ASSERT_EQ(0, rc);
 }
 
+static size_t count_calls(Function *F, char const *callee)
+{
+    size_t n = 0;
+    for (auto &BB : *F)
+        for (auto &I : BB)
+            if (auto call = dyn_cast<CallInst>(&I))
+                if (call->getCalledFunction() && call->getCalledFunction()->getName() == callee)
+                    ++n;
+    return n;
+}
+
+//
+// a[i] must not reload the descriptor of a locally declared array
+//
+TEST_F(CompilerF, array_descriptor_cached)
+{
+    auto M = compile_sample(R"(/* array access */
+program ARR:
+    declare a array [10] of integer;
+    set a[3] := 5;
+    output a[3];
+end program ARR;
+)");
+    ASSERT_TRUE(M);
+    Function *main = M->getFunction("main");
+    ASSERT_TRUE(main);
+
+    size_t loads = 0;
+    for (auto &BB : *main)
+        for (auto &I : BB)
+            if (isa<LoadInst>(I))
+                ++loads;
+    EXPECT_EQ(1, loads); // a[3] itself
+}
+
+//
+// a loop that stores an array whole reloads its descriptor on every
+// iteration, also for the uses before the store; one that does not, and a
+// labeled block that is not repeated, keep the cached fields
+//
+TEST_F(CompilerF, array_descriptor_reloaded_in_loop)
+{
+    auto M = compile_sample(R"(/* array assigned in a loop */
+program ARR:
+    declare (a, b, c) array [10] of integer;
+    declare i integer;
+    for i := 1 to 3 do
+        output a[i];
+    end for;
+    for i := 1 to 3 do
+        output a[1];
+        set b[1] := i;
+        set a := b;
+    end for;
+    L: begin
+        output c[1];
+        set c := b;
+    end L;
+end program ARR;
+)");
+    ASSERT_TRUE(M);
+    Function *main = M->getFunction("main");
+    ASSERT_TRUE(main);
+
+    std::vector<std::string> reloaded; // in the blocks of
+    for (auto &BB : *main)
+        for (auto &I : BB)
+            if (I.getName().starts_with("array_start"))
+                reloaded.push_back(BB.getName().str());
+    ASSERT_EQ(1u, reloaded.size()); // by the second loop
+    EXPECT_EQ("for_cond", StringRef(reloaded[0]).rtrim("0123456789"));
+}
+
+//
+// small arrays of constant shape are not allocated by the run-time library
+//
+TEST_F(CompilerF, array_constant_shape_inline)
+{
+    auto M = compile_sample(R"(/* constant shapes */
+program ARR:
+    declare a array [2] of array [2] of integer;
+    declare b array [100] of array [100] of real;
+    set a[1][2] := 5;
+    set b[1][2] := 5.0;
+    output a[1][2], b[1][2];
+end program ARR;
+)");
+    ASSERT_TRUE(M);
+    Function *main = M->getFunction("main");
+    ASSERT_TRUE(main);
+
+    EXPECT_EQ(1, count_calls(main, "rtl_allocate_array")); // b only
+
+    size_t storage = 0;
+    for (auto &I : main->getEntryBlock())
+        if (auto AI = dyn_cast<AllocaInst>(&I))
+            if (AI->getAllocatedType() == ArrayType::get(Type::getInt32Ty(C), 4))
+                ++storage;
+    EXPECT_EQ(1, storage);
+}
+
+//
+// an array that a function may store outside its frame, into a parameter or
+// a variable of the program, is not kept in the frame
+//
+TEST_F(CompilerF, array_inline_not_stored_outside)
+{
+    auto M = compile_sample(R"(/* arrays stored outside */
+program ARR:
+    declare (a, g) array [10] of integer;
+    declare r integer;
+    function local (k integer) integer :
+        declare c array [10] of integer;
+        declare d array [10] of integer;
+        set c[1] := k;
+        set d := c;
+        return d[1];
+    end function local;
+    function param (x array [10] of integer, k integer) integer :
+        declare c array [10] of integer;
+        set c[1] := k;
+        set x := c;
+        return k;
+    end function param;
+    function global (k integer) integer :
+        declare c array [10] of integer;
+        set c[1] := k;
+        set g := c;
+        return k;
+    end function global;
+    function caller (k integer) integer :
+        declare c array [10] of integer;
+        return param(c, k);
+    end function caller;
+    set r := local(1) + param(a, 2) + global(3) + caller(4);
+end program ARR;
+)");
+    ASSERT_TRUE(M);
+
+    EXPECT_EQ(0, count_calls(M->getFunction("local"), "rtl_allocate_array"));
+    EXPECT_EQ(1, count_calls(M->getFunction("param"), "rtl_allocate_array"));
+    EXPECT_EQ(1, count_calls(M->getFunction("global"), "rtl_allocate_array"));
+    EXPECT_EQ(1, count_calls(M->getFunction("caller"), "rtl_allocate_array"));
+    EXPECT_EQ(0, count_calls(M->getFunction("main"), "rtl_allocate_array"));
+}
+
+//
+// an array declared in a loop body is released at the end of every iteration
+//
+TEST_F(CompilerF, array_arena_released)
+{
+    auto M = compile_sample(R"(/* arrays in a loop */
+program ARR:
+    declare (i, n) integer;
+    set n := 1000;
+    for i := 1 to 10 do
+        declare a array [n] of integer;
+        set a[1] := i;
+    end for;
+end program ARR;
+)");
+    ASSERT_TRUE(M);
+    Function *main = M->getFunction("main");
+    ASSERT_TRUE(main);
+
+    EXPECT_EQ(2, count_calls(main, "rtl_arena_mark"));    // main, loop body
+    EXPECT_EQ(2, count_calls(main, "rtl_arena_release")); // loop body, return
+}
+
+//
+// repeat and repent release the arrays of the segments they leave
+//
+TEST_F(CompilerF, array_arena_released_on_repeat)
+{
+    auto M = compile_sample(R"(/* arrays left by repeat */
+program ARR:
+    declare (i, j, n) integer;
+    set n := 1000;
+    L: for i := 1 to 10 do
+        declare a array [n] of integer;
+        for j := 1 to 2 do
+            declare b array [n] of integer;
+            set b[j] := a[j];
+            if b[j] = 0 then repeat L; fi;
+        end for;
+        output i;
+    end for;
+    M: begin
+        declare c array [n] of integer;
+        repent M;
+    end;
+end program ARR;
+)");
+    ASSERT_TRUE(M);
+    Function *main = M->getFunction("main");
+    ASSERT_TRUE(main);
+
+    EXPECT_EQ(4, count_calls(main, "rtl_arena_mark"));
+    // the loop bodies, repeat L, the end of M, repent M, return
+    EXPECT_EQ(6, count_calls(main, "rtl_arena_release"));
+}
+
+//
+// a function that returns a structure keeps only the arrays of the structure
+//
+TEST_F(CompilerF, array_arena_released_but_result)
+{
+    auto M = compile_sample(R"(/* structure result */
+program ARR:
+    type vec is structure field n is integer, field v is array [1000] of integer end structure;
+    declare t vec;
+    function make (k integer) vec :
+        declare r vec;
+        declare a array [1000] of integer;
+        declare junk array [5000] of integer;
+        set a[1] := k;
+        set r.n := k;
+        set r.v := a;
+        return r;
+    end function make;
+    set t := make(1);
+end program ARR;
+)");
+    ASSERT_TRUE(M);
+    Function *make = M->getFunction("make");
+    ASSERT_TRUE(make);
+
+    EXPECT_EQ(0, count_calls(make, "rtl_arena_release"));
+    EXPECT_EQ(2, count_calls(make, "rtl_arena_release_keep")); // return r, the implicit one
+}
+
+//
+// a function that returns a structure holding strings keeps the strings and
+// arrays the structure refers to
+//
+TEST_F(CompilerF, arena_released_but_result_strings)
+{
+    auto M = compile_sample(R"(/* structure result with strings */
+program STR:
+    type entry is structure field k is integer, field s is string, field v is array [3] of integer end structure;
+    declare (t, u) entry;
+    declare i integer;
+    function make (k integer) entry :
+        declare r entry;
+        declare a array [3] of integer;
+        set a[1] := k;
+        set r.k := k;
+        set r.s := "entry " || character(48 + k);
+        set r.v := a;
+        return r;
+    end function make;
+    for i := 1 to 10 do
+        set t := make(i);
+    end for;
+    set u := t;
+end program STR;
+)");
+    ASSERT_TRUE(M);
+    Function *make = M->getFunction("make");
+    ASSERT_TRUE(make);
+
+    EXPECT_EQ(1, count_calls(make, "rtl_arena_mark"));
+    EXPECT_EQ(0, count_calls(make, "rtl_arena_release"));
+    EXPECT_EQ(2, count_calls(make, "rtl_arena_keep_value")); // return r, the implicit one
+}
+
+//
+// strings are released with the segment that made them, unless they are
+// stored; a function keeps the string it returns
+//
+TEST_F(CompilerF, string_arena_released)
+{
+    auto M = compile_sample(R"(/* strings in a loop */
+program STR:
+    declare (i, n) integer;
+    declare s string;
+    function label_of (k integer) string :
+        output "name" || character(k);
+        return "k = " || character(k);
+    end function label_of;
+    for i := 1 to 10 do
+        output "line " || character(48 + i);
+    end for;
+    for i := 1 to 10 do
+        set s := s || character(48 + i);
+    end for;
+    set s := label_of(65);
+end program STR;
+)");
+    ASSERT_TRUE(M);
+    Function *main = M->getFunction("main");
+    ASSERT_TRUE(main);
+    Function *label_of = M->getFunction("label_of");
+    ASSERT_TRUE(label_of);
+
+    EXPECT_EQ(2, count_calls(main, "rtl_arena_mark"));    // main, first loop body
+    EXPECT_EQ(2, count_calls(main, "rtl_arena_release")); // first loop body, return
+    EXPECT_EQ(1, count_calls(label_of, "rtl_arena_mark"));
+    EXPECT_EQ(0, count_calls(label_of, "rtl_arena_release"));
+    EXPECT_EQ(2, count_calls(label_of, "rtl_string_keep")); // return, the implicit one
+}
+
+//
+// output a, b, c is a single run-time library call
+//
+TEST_F(CompilerF, output_list_batched)
+{
+    auto M = compile_sample(R"(/* output list */
+program OUT:
+    output 1, 2.5, "three", true;
+end program OUT;
+)");
+    ASSERT_TRUE(M);
+    Function *main = M->getFunction("main");
+    ASSERT_TRUE(main);
+
+    EXPECT_EQ(1, count_calls(main, "rtl_output_list"));
+    EXPECT_EQ(0, count_calls(main, "rtl_output"));
+    EXPECT_EQ(1, count_calls(main, "rtl_output_flush"));
+}
+
+//
+// separate sessions compile on separate threads without sharing state
+//
+TEST_F(CompilerF, sessions_concurrent)
+{
+    auto sample_mini = create_workspace() / "concurrent.mini";
+    ASSERT_TRUE(save_as_text(R"(/* concurrent */
+program CONCURRENT:
+    declare a array [10] of integer;
+    declare i integer;
+    for i := 1 to 10 do
+        set a[i] := i * i;
+    end for;
+    output a[10];
+end program CONCURRENT;
+)", sample_mini));
+
+    int const n = 4;
+    int rc[n];
+    bool verified[n];
+    std::vector<std::thread> workers;
+
+    for (int i = 0; i != n; ++i)
+        workers.emplace_back([&, i]() {
+            CompilationSession own;
+            own.options().emit_mode = EMIT_JIT;
+            rc[i] = -1;
+            verified[i] = false;
+            if (FILE *in = fopen(sample_mini.string().c_str(), "r")) {
+                rc[i] = own.compile(in);
+                fclose(in);
+                auto M = own.take_module();
+                verified[i] = M && !verifyModule(*M, &errs());
+            }
+        });
+    for (auto &w : workers)
+        w.join();
+
+    for (int i = 0; i != n; ++i) {
+        EXPECT_EQ(0, rc[i]) << i;
+        EXPECT_TRUE(verified[i]) << i;
+    }
+}
+
+//
+// -stats and -time: counters of the generated module, times of the phases
+//
+TEST_F(CompilerF, stats_collected)
+{
+    session.options().stats = true;
+    session.options().time_report = true;
+    auto M = compile_sample(R"(/* stats */
+program STATS:
+    declare (i, s) integer;
+    set s := 0;
+    for i := 1 to 10 do
+        set s := s + i;
+    end for;
+    output s;
+end program STATS;
+)");
+    ASSERT_TRUE(M);
+
+    compile_stats_t const &stats = session.stats();
+    EXPECT_LT(0u, stats.tree_nodes);
+    EXPECT_EQ(1u, stats.functions);
+    EXPECT_LT(1u, stats.basic_blocks);
+    EXPECT_LT(stats.basic_blocks, stats.instructions);
+    EXPECT_EQ(2u, stats.allocas);
+    EXPECT_LT(0u, stats.rtl_calls);
+    EXPECT_LT(0, stats.phases[PHASE_PARSE].wall_ms);
+    EXPECT_EQ(0, stats.phases[PHASE_EMIT].wall_ms);
+
+    char *text = 0;
+    size_t size = 0;
+    FILE *out = open_memstream(&text, &size);
+    print_stats(out, stats, true, true, true);
+    fclose(out);
+    std::string json(text, size);
+    free(text);
+    EXPECT_EQ('{', json.front());
+    EXPECT_NE(std::string::npos, json.find("\"parse\": {\"wall_ms\": "));
+    EXPECT_NE(std::string::npos, json.find("\"functions\": 1,"));
+}
+
+//
+// -fcheck-bounds: a for loop within the constant bounds needs no check, one
+// with a run-time limit is guarded once per access, a plain index is checked
+//
+TEST_F(CompilerF, bounds_checks_elided)
+{
+    session.options().check_bounds = true;
+    session.options().stats = true;
+    auto M = compile_sample(R"(/* bounds */
+program BOUNDS:
+    declare (i, n, s) integer;
+    declare a array [10] of integer;
+    set n := 10;
+    set s := 0;
+    for i := 1 to 10 do
+        set a[i] := i;
+    end for;
+    for i := 1 to n do
+        set s := s + a[i];
+    end for;
+    output a[n];
+end program BOUNDS;
+)");
+    ASSERT_TRUE(M);
+    Function *main = M->getFunction("main");
+    ASSERT_TRUE(main);
+
+    compile_stats_t const &stats = session.stats();
+    EXPECT_EQ(3u, stats.bounds_checks);
+    EXPECT_EQ(1u, stats.bounds_checks_elided);
+    EXPECT_EQ(2u, count_calls(main, "rtl_bounds_error"));
+    EXPECT_TRUE(M->getFunction("rtl_bounds_error")->doesNotReturn());
+}
+
+//
+// an index that the body assigns after the access is checked: the range of
+// the loop implies nothing
+//
+TEST_F(CompilerF, bounds_checked_index_assigned_later)
+{
+    session.options().check_bounds = true;
+    session.options().stats = true;
+    auto M = compile_sample(R"(/* bounds */
+program BOUNDS:
+    declare i integer;
+    declare a array [10] of integer;
+    for i := 1 to 10 do
+        output a[i];
+        set i := i - 20;
+    end for;
+end program BOUNDS;
+)");
+    ASSERT_TRUE(M);
+    Function *main = M->getFunction("main");
+    ASSERT_TRUE(main);
+
+    EXPECT_EQ(0u, session.stats().bounds_checks_elided);
+    EXPECT_EQ(1u, count_calls(main, "rtl_bounds_error"));
+
+    size_t guards = 0;
+    for (auto &BB : *main)
+        if (auto br = dyn_cast<BranchInst>(BB.getTerminator()))
+            if (br->isConditional())
+                if (auto C = dyn_cast<ConstantInt>(br->getCondition()))
+                    guards += C->isZero();
+    EXPECT_EQ(1u, guards); // never skips the check
+}
+
+//
+// for loops are lowered to canonical loops: one latch carrying !llvm.loop,
+// and the limit evaluated before the loop unless the body changes it. Only
+// a loop whose index cannot wrap, as its limit is a constant, must progress
+//
+TEST_F(CompilerF, for_loop_canonical)
+{
+    auto M = compile_sample(R"(/* loops */
+program LOOPS:
+    declare (i, n, s) integer;
+    set n := 10;
+    set s := 0;
+    for i := 1 to 10 do
+        set s := s + i;
+    end for;
+    for i := 1 to n do
+        set n := n - 1;
+    end for;
+    for i := 1 to n do
+        set s := s + i;
+    end for;
+    output s, n;
+end program LOOPS;
+)");
+    ASSERT_TRUE(M);
+    Function *main = M->getFunction("main");
+    ASSERT_TRUE(main);
+
+    std::vector<Instruction *> latches;
+    size_t phis = 0;
+    for (auto &BB : *main)
+        for (auto &I : BB) {
+            if (I.getMetadata(LLVMContext::MD_loop))
+                latches.push_back(&I);
+            phis += isa<PHINode>(I);
+        }
+    ASSERT_EQ(3u, latches.size());
+    EXPECT_EQ(1u, phis); // the limit of the second loop
+
+    auto mustprogress = [](Instruction *latch) {
+        MDNode *id = latch->getMetadata(LLVMContext::MD_loop);
+        return id->getNumOperands() == 2; // self reference, llvm.loop.mustprogress
+    };
+    auto nsw = [](Instruction *latch) {
+        for (auto &I : *latch->getParent())
+            if (I.getName().starts_with("increment"))
+                return I.hasNoSignedWrap();
+        return false;
+    };
+    EXPECT_TRUE(mustprogress(latches[0]));
+    EXPECT_TRUE(nsw(latches[0]));
+    EXPECT_FALSE(mustprogress(latches[1]));
+    EXPECT_FALSE(mustprogress(latches[2])); // n may be INT32_MAX
+    EXPECT_FALSE(nsw(latches[2]));
+
+    for (auto latch : latches) {
+        BasicBlock *header = cast<BranchInst>(latch)->getSuccessor(0);
+        EXPECT_EQ(2u, pred_size(header)) << header->getName().str();
+    }
+}
+
+//
+// select with integer constant cases becomes a switch, with the first of
+// two equal cases winning; other selectors a chain of comparisons
+//
+TEST_F(CompilerF, select_switch)
+{
+    session.options().stats = true;
+    auto M = compile_sample(R"(/* select */
+program SELECT:
+    declare (state, k) integer;
+    set state := 0;
+    set k := 2;
+    select state of
+    case 0: set state := 1;
+    case 1 2: set state := 3;
+    case 2: set state := 4;
+    case -1: set state := 5;
+    otherwise: set state := 0;
+    end select;
+    select state of
+    case k: output k;
+    case 1: output 1;
+    end select;
+end program SELECT;
+)");
+    ASSERT_TRUE(M);
+    Function *main = M->getFunction("main");
+    ASSERT_TRUE(main);
+
+    std::vector<SwitchInst *> switches;
+    for (auto &BB : *main)
+        if (auto sw = dyn_cast<SwitchInst>(BB.getTerminator()))
+            switches.push_back(sw);
+    ASSERT_EQ(1u, switches.size());
+    SwitchInst *sw = switches[0];
+    EXPECT_EQ(4u, sw->getNumCases());
+    EXPECT_EQ("otherwise", sw->getDefaultDest()->getName());
+    EXPECT_EQ(sw->findCaseValue(ConstantInt::get(Type::getInt32Ty(M->getContext()), 1))->getCaseSuccessor(),
+              sw->findCaseValue(ConstantInt::get(Type::getInt32Ty(M->getContext()), 2))->getCaseSuccessor());
+
+    EXPECT_EQ(1u, session.stats().select_switches);
+    EXPECT_EQ(1u, session.stats().select_chains);
+}
+
+//
+// a || b || c is a single concatenation; length() reads the header
+//
+TEST_F(CompilerF, string_concat_flattened)
+{
+    auto M = compile_sample(R"(/* strings */
+program STRINGS:
+    declare (s, t) string;
+    set s := "abc";
+    set t := s || "-" || s || character(33);
+    output t, length(t), substr(t, 2, 3);
+end program STRINGS;
+)");
+    ASSERT_TRUE(M);
+    Function *main = M->getFunction("main");
+    ASSERT_TRUE(main);
+
+    EXPECT_EQ(1u, count_calls(main, "rtl_string_concat"));
+    EXPECT_EQ(1u, count_calls(main, "rtl_string_substr"));
+    for (auto &BB : *main)
+        for (auto &I : BB)
+            if (auto call = dyn_cast<CallInst>(&I))
+                if (call->getCalledFunction()->getName() == "rtl_string_concat") {
+                    ASSERT_EQ(5u, call->arg_size());
+                    EXPECT_EQ(4, cast<ConstantInt>(call->getArgOperand(0))->getSExtValue());
+                }
+}
+
+//
+// an input list is one run-time call with a pointer per target
+//
+TEST_F(CompilerF, input_list_batched)
+{
+    auto M = compile_sample(R"(/* input */
+program INPUT:
+    declare (i, n) integer;
+    declare x real;
+    declare a array [10] of integer;
+    input n, x;
+    for i := 1 to n do
+        input a[i];
+    end for;
+end program INPUT;
+)");
+    ASSERT_TRUE(M);
+    Function *main = M->getFunction("main");
+    ASSERT_TRUE(main);
+
+    EXPECT_EQ(2u, count_calls(main, "rtl_input_list"));
+    for (auto &BB : *main)
+        for (auto &I : BB)
+            if (auto call = dyn_cast<CallInst>(&I))
+                if (call->getCalledFunction()->getName() == "rtl_input_list" && call->arg_size() == 3) {
+                    for (unsigned i = 1; i != 3; ++i)
+                        EXPECT_TRUE(isa<AllocaInst>(call->getArgOperand(i)));
+                }
+}
+
+//
+// arrays and name parameters are passed as pointers to the actual
+// arguments, readonly unless assigned, noalias unless passed twice
+//
+TEST_F(CompilerF, reference_parameters)
+{
+    auto M = compile_sample(R"(/* references */
+program REFS:
+    declare a array [1:5] of integer;
+    declare (i, k) integer;
+
+    function sum (v array [1:5] of integer) integer :
+        declare (s, j) integer;
+        set s := 0;
+        for j := 1 to 5 do
+            set s := s + v[j];
+        end for;
+        return s;
+    end function sum;
+
+    function add (x integer name, y integer name) integer :
+        set x := x + y;
+        return x;
+    end function add;
+
+    for i := 1 to 5 do
+        set a[i] := i;
+    end for;
+    set k := 1;
+    output sum(a), add(k, a[2]), add(k, k), add(k, 2), k;
+end program REFS;
+)");
+    ASSERT_TRUE(M);
+    Function *sum = M->getFunction("sum");
+    Function *add = M->getFunction("add");
+    ASSERT_TRUE(sum && add);
+
+    Argument *v = sum->getArg(0);
+    EXPECT_TRUE(v->getType()->isPointerTy());
+    EXPECT_TRUE(v->onlyReadsMemory());
+    EXPECT_TRUE(v->hasNoAliasAttr());
+    EXPECT_TRUE(v->hasNoCaptureAttr());
+
+    EXPECT_FALSE(add->getArg(0)->onlyReadsMemory());
+    EXPECT_TRUE(add->getArg(1)->onlyReadsMemory());
+    EXPECT_FALSE(add->getArg(0)->hasNoAliasAttr()); // add(k, k)
+
+    for (User *user : add->users()) {
+        auto call = cast<CallInst>(user);
+        for (unsigned i = 0; i != 2; ++i)
+            EXPECT_TRUE(isa<AllocaInst>(getUnderlyingObject(call->getArgOperand(i))));
+    }
+}
+
 // Local Variables:
 // mode: c++
 // c-basic-offset: 4
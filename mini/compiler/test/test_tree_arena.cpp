@@ -0,0 +1,62 @@
+//
+//
+//
+
+#include <gtest/gtest.h>
+
+#include "TreeNode.h"
+#include "parser.h"
+
+#include "llvm/Support/Casting.h"
+
+#include <cstdint>
+
+using namespace llvm;
+
+TEST(tree_arena, make)
+{
+    TreeArena arena;
+
+    auto id = arena.make<TreeIdentNode>("x");
+    auto num = arena.make<TreeNumericalNode>(42);
+    auto sum = arena.make<TreeBinaryNode>(id, num, PLUS);
+
+    EXPECT_EQ(TREE_BINARY, sum->kind);
+    EXPECT_EQ("x", sum->left->show());
+    EXPECT_EQ(42, cast<TreeNumericalNode>(sum->right)->num);
+    EXPECT_EQ(0, reinterpret_cast<uintptr_t>(sum) % alignof(TreeBinaryNode));
+    EXPECT_LT(0, arena.bytes_allocated());
+
+    arena.release();
+    EXPECT_EQ(0, arena.bytes_allocated());
+}
+
+TEST(tree_arena, dispatch_by_kind)
+{
+    TreeArena arena;
+    TreeNode *node = arena.make<TreeDNumericalNode>(2.5);
+
+    EXPECT_TRUE(isa<TreeDNumericalNode>(node));
+    EXPECT_FALSE(isa<TreeNumericalNode>(node));
+    EXPECT_EQ(nullptr, dyn_cast_or_null<TreeIdentNode>(node));
+    EXPECT_EQ(nullptr, dyn_cast_or_null<TreeIdentNode>((TreeNode *)0));
+}
+
+TEST(tree_arena, many_chunks)
+{
+    TreeArena arena;
+
+    std::string text(100000, 'a');
+    auto big = arena.make<TreeTextNode>(text.data(), text.size());
+    for (int i = 0; i != 10000; ++i)
+        arena.make<TreeUnaryNode>(big, MINUS);
+
+    EXPECT_EQ(text, big->show());
+}
+
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// tab-width: 4
+// indent-tabs-mode: nil
+// End:
@@ -1,8 +1,125 @@
 #ifndef __MINI_SYSTEM_H
 #define __MINI_SYSTEM_H
 
+#include <stddef.h>
+#include <stdint.h>
 
+//
+// EASY run-time library entry points
+//
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int rtl_output(int d);
+int rtl_output_real(double d);
+int rtl_output_str(char *s);
+int rtl_output_bool(char d);
+int rtl_output_nl(char *s);
+int32_t rtl_fix(double x);
+int rtl_output_list(char const *types, ...);
+int *rtl_allocate_array(int s, int n);
+void rtl_bounds_error(int index, int low, int up);
+
+//
+// buffered output (rtl_output_buffer.c)
+//
+
+#define RTL_FORMAT_SIZE 32 // longest text of a formatted number
+
+void rtl_output_write(char const *s, size_t n);
+void rtl_output_flush(void);
+size_t rtl_format_int(char *buf, int d);
+size_t rtl_format_real(char *buf, double d);
+
+//
+// array storage arena (rtl_arena.c)
+//
+
+#define RTL_ARENA_ALIGN 64
+
+typedef struct rtl_arena_stats {
+    size_t allocations; // number of rtl_arena_allocate() calls
+    size_t bytes;       // total bytes handed out, after alignment
+    size_t peak_bytes;  // largest amount live at once
+    size_t chunks;      // chunks obtained from the system
+    size_t releases;    // number of rtl_arena_release() calls
+} rtl_arena_stats_t;
+
+void *rtl_arena_allocate(size_t n);
+void *rtl_arena_allocate_words(size_t n); // aligned to a pointer only
+void *rtl_arena_mark(void);
+void rtl_arena_release(void *mark);
+
+// storage to keep over a release: *ref points to it, and to where it is
+// afterwards
+typedef struct rtl_arena_keep {
+    void **ref;
+    size_t size;
+} rtl_arena_keep_t;
+
+void rtl_arena_release_keep(void *mark, rtl_arena_keep_t *keep, int n);
+
+// where a value holds arena storage: a string, or an array whose elements
+// may hold some themselves, as described by element
+typedef struct rtl_arena_layout {
+    int32_t offset;       // of the string or the array descriptor in the value
+    int32_t data_offset;  // of the address in the array descriptor, 0 for a string
+    int32_t element_size; // of the array
+    int32_t elements;     // entries of element, 0 if an element holds none
+    struct rtl_arena_layout const *element;
+} rtl_arena_layout_t;
 
+void rtl_arena_keep_value(void *mark, void *value, rtl_arena_layout_t const *layout, int n);
+rtl_arena_stats_t const *rtl_arena_stats(void);
+
+//
+// strings (rtl_string.c)
+//
+
+#define RTL_STRING_SSO 16 // characters a string header holds itself
+
+typedef struct rtl_string_buffer rtl_string_buffer_t;
+
+typedef struct rtl_string {
+    int32_t length;
+    char const *data;            // the characters, not NUL-terminated
+    rtl_string_buffer_t *buffer; // that data points into, or 0
+    char small[RTL_STRING_SSO];  // the characters of a short string
+} rtl_string_t;
+
+typedef struct rtl_string_stats {
+    size_t strings;  // headers allocated
+    size_t appends;  // concatenations that extended a buffer in place
+    size_t copies;   // concatenations that copied into a new buffer
+    size_t views;    // substrings sharing the characters of their string
+    size_t bytes;    // arena bytes taken, headers and buffers
+} rtl_string_stats_t;
+
+rtl_string_t const *rtl_string_concat(int n, ...);
+rtl_string_t const *rtl_string_substr(rtl_string_t const *s, int start, int n);
+rtl_string_t const *rtl_string_character(int c);
+rtl_string_t const *rtl_string_make(char const *chars, size_t n);
+rtl_string_t const *rtl_string_keep(void *mark, rtl_string_t const *s);
+int rtl_output_string(rtl_string_t const *s);
+rtl_string_stats_t const *rtl_string_stats(void);
+
+//
+// input (rtl_input.c)
+//
+
+#define RTL_INPUT_BUFFER_SIZE (1 << 20)
+#define RTL_INPUT_MAX_ITEM 4096 // longest real number in bytes
+
+int rtl_input_list(char const *types, ...);
+int32_t rtl_input_int(void);
+double rtl_input_real(void);
+rtl_string_t const *rtl_input_string(void);
+void rtl_input_from(char const *text, size_t n);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif
@@ -2,22 +2,23 @@
 //
 //
 
-#include <stdlib.h>
+#include <string.h>
 #include <assert.h>
-#include <stdio.h>
 
+#include "mini_system.h"
+
+//
+// Zero-filled storage for n elements of s bytes from the arena; it lives
+// until the enclosing scope of the declaration releases its mark.
+//
 int *
 rtl_allocate_array(int s, int n)
 {
-    fprintf(stderr, "rtl_allocate_array(%d, %d)\n", s, n);
     assert(s > 0 && n > 0);
-  
-    int *vec = (int *)calloc(s, n);
-#if !NDEBUG
-    for(int i = 0 ; i != (s*n)/sizeof(int) ; ++i) {
-        vec[i] = i+1;
-    }
-#endif
+
+    size_t size = (size_t)s * (size_t)n;
+    int *vec = (int *)rtl_arena_allocate(size);
+    memset(vec, 0, size);
     return vec;
 }
 
@@ -0,0 +1,407 @@
+//
+// rtl_arena.c - Per-thread arena for array storage
+//
+// Memory is handed out from a stack of chunks. Generated code takes a mark
+// with rtl_arena_mark() on entry to a function or segment that allocates
+// arrays or strings and gives everything allocated since back with
+// rtl_arena_release() on exit. An array is aligned to RTL_ARENA_ALIGN
+// bytes, string storage (rtl_string.c) to the size of a pointer. The result
+// of a function is kept over the release with rtl_arena_release_keep(), or
+// rtl_arena_keep_value() if the storage it refers to refers to more.
+//
+// Statistics are collected always and printed to stderr at exit if the
+// environment variable MINI_RTL_STATS is set.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "mini_system.h"
+
+#define RTL_CHUNK_SIZE (64 * 1024)
+
+typedef struct rtl_chunk {
+    struct rtl_chunk *prev;
+    size_t size; // bytes available after the header
+    size_t used;
+} rtl_chunk_t;
+
+// the header occupies one alignment unit, data starts right after it
+#define RTL_CHUNK_HEADER RTL_ARENA_ALIGN
+#define chunk_data(c) ((char *)(c) + RTL_CHUNK_HEADER)
+
+typedef struct rtl_arena {
+    rtl_chunk_t *top;
+    rtl_chunk_t *spare; // a released chunk of the default size, kept for reuse
+    size_t live;
+    rtl_arena_stats_t stats;
+} rtl_arena_t;
+
+static _Thread_local rtl_arena_t arena;
+
+// the smallest alignment, of string headers and buffers
+#define RTL_ARENA_WORD sizeof(void *)
+
+static size_t round_up(size_t n, size_t align)
+{
+    return (n + align - 1) & ~(align - 1);
+}
+
+static void print_stats(void)
+{
+    rtl_arena_stats_t const *s = &arena.stats;
+
+    fprintf(stderr,
+            "rtl_arena: %zu allocations, %zu bytes allocated, %zu bytes peak, "
+            "%zu chunks, %zu releases\n",
+            s->allocations, s->bytes, s->peak_bytes, s->chunks, s->releases);
+}
+
+static void init_stats(void)
+{
+    static int once = 0;
+
+    if (!once) {
+        once = 1;
+        if (getenv("MINI_RTL_STATS"))
+            atexit(print_stats);
+    }
+}
+
+static rtl_chunk_t *push_chunk(size_t n)
+{
+    rtl_chunk_t *c = 0;
+
+    if (n <= RTL_CHUNK_SIZE && arena.spare) {
+        c = arena.spare;
+        arena.spare = 0;
+    } else {
+        size_t size = n > RTL_CHUNK_SIZE ? round_up(n, RTL_ARENA_ALIGN) : RTL_CHUNK_SIZE;
+        c = (rtl_chunk_t *)aligned_alloc(RTL_ARENA_ALIGN, RTL_CHUNK_HEADER + size);
+        if (!c) {
+            fprintf(stderr, "rtl_arena: out of memory (%zu bytes)\n", size);
+            abort();
+        }
+        c->size = size;
+        ++arena.stats.chunks;
+        init_stats();
+    }
+    c->used = 0;
+    c->prev = arena.top;
+    arena.top = c;
+    return c;
+}
+
+static void pop_chunk(void)
+{
+    rtl_chunk_t *c = arena.top;
+
+    arena.top = c->prev;
+    arena.live -= c->used;
+    if (c->size == RTL_CHUNK_SIZE && !arena.spare)
+        arena.spare = c;
+    else
+        free(c);
+}
+
+// n bytes at a multiple of align
+static void *allocate(size_t n, size_t align)
+{
+    rtl_chunk_t *c = arena.top;
+
+    n = round_up(n ? n : 1, RTL_ARENA_WORD);
+    size_t at = c ? round_up(c->used, align) : 0;
+    if (!c || at > c->size || c->size - at < n) {
+        c = push_chunk(n);
+        at = 0;
+    }
+
+    void *p = chunk_data(c) + at;
+    size_t taken = at + n - c->used; // with the padding
+    c->used += taken;
+    arena.live += taken;
+
+    ++arena.stats.allocations;
+    arena.stats.bytes += taken;
+    if (arena.live > arena.stats.peak_bytes)
+        arena.stats.peak_bytes = arena.live;
+    return p;
+}
+
+void *rtl_arena_allocate(size_t n)
+{
+    return allocate(n, RTL_ARENA_ALIGN);
+}
+
+void *rtl_arena_allocate_words(size_t n)
+{
+    return allocate(n, RTL_ARENA_WORD);
+}
+
+void *rtl_arena_mark(void)
+{
+    rtl_chunk_t *c = arena.top;
+
+    if (!c)
+        c = push_chunk(0);
+    return chunk_data(c) + c->used;
+}
+
+void rtl_arena_release(void *mark)
+{
+    char *m = (char *)mark;
+
+    if (!m)
+        return;
+
+    ++arena.stats.releases;
+    while (arena.top && !(chunk_data(arena.top) <= m && m <= chunk_data(arena.top) + arena.top->size))
+        pop_chunk();
+
+    if (arena.top) {
+        size_t used = m - chunk_data(arena.top);
+        arena.live -= arena.top->used - used;
+        arena.top->used = used;
+    }
+}
+
+// the size bytes at p were allocated since mark was taken
+static int allocated_since(char const *m, char const *p, size_t size)
+{
+    for (rtl_chunk_t *c = arena.top; c; c = c->prev) {
+        char const *data = chunk_data(c);
+        int has_mark = data <= m && m <= data + c->size;
+
+        if (data <= p && size <= c->used && p <= data + c->used - size)
+            return !has_mark || p >= m;
+        if (has_mark)
+            return 0;
+    }
+    return 0;
+}
+
+// the alignment a piece at p keeps when it moves
+static size_t alignment_of(void const *p)
+{
+    return (uintptr_t)p % RTL_ARENA_ALIGN ? RTL_ARENA_WORD : RTL_ARENA_ALIGN;
+}
+
+//
+// Release everything allocated since mark but the n pieces of storage in
+// keep, which move down to the mark. A piece that was not allocated since
+// the mark stays where it is. Pieces that are one are kept once.
+//
+// Taken by address, each piece lands at or below where it was, as long as
+// the mark is in the top chunk: the ones before it were as large and its
+// alignment was as strict. Else they are copied out and back.
+//
+void rtl_arena_release_keep(void *mark, rtl_arena_keep_t *keep, int n)
+{
+    char *m = (char *)mark;
+    size_t total = 0;
+    int kept = 0;
+
+    if (!m)
+        return;
+
+    // the pieces to move first, by address
+    for (int i = 0; i != n; ++i) {
+        if (!keep[i].size || !allocated_since(m, (char *)*keep[i].ref, keep[i].size))
+            continue;
+        rtl_arena_keep_t k = keep[i];
+        int j = kept++;
+        for (; j && *keep[j - 1].ref > *k.ref; --j)
+            keep[j] = keep[j - 1];
+        keep[j] = k;
+        total += round_up(k.size, RTL_ARENA_WORD);
+    }
+
+    char *saved = 0;
+    rtl_chunk_t *c = arena.top;
+    if (kept && !(c && chunk_data(c) <= m && m <= chunk_data(c) + c->size)) {
+        saved = (char *)malloc(total);
+        if (!saved) {
+            fprintf(stderr, "rtl_arena: out of memory (%zu bytes)\n", total);
+            abort();
+        }
+        char *out = saved;
+        for (int i = 0; i != kept; ++i) {
+            if (i && *keep[i].ref == *keep[i - 1].ref)
+                continue;
+            memcpy(out, *keep[i].ref, keep[i].size);
+            out += round_up(keep[i].size, RTL_ARENA_WORD);
+        }
+    }
+
+    rtl_arena_release(mark);
+
+    char *from = saved;
+    void *last = 0, *moved = 0;
+    for (int i = 0; i != kept; ++i) {
+        void *p = *keep[i].ref;
+        if (p != last) {
+            last = p;
+            moved = allocate(keep[i].size, alignment_of(p));
+            if (saved) {
+                memcpy(moved, from, keep[i].size);
+                from += round_up(keep[i].size, RTL_ARENA_WORD);
+            } else {
+                memmove(moved, p, keep[i].size);
+            }
+        }
+        *keep[i].ref = moved;
+    }
+    free(saved);
+}
+
+//
+// The storage a value refers to, copied out of the arena over the release
+// in rtl_arena_keep_value(): a piece for each array or string allocated
+// since the mark, and the references to it that are set to where it moves.
+//
+typedef struct kept_piece {
+    void const *at;
+    size_t size;
+    char *saved;   // the elements of an array, the characters of a string
+    int string;
+    void *moved;
+} kept_piece_t;
+
+typedef struct kept_ref {
+    void **ref;
+    size_t piece;
+} kept_ref_t;
+
+typedef struct kept_value {
+    char const *mark;
+    kept_piece_t *pieces;
+    size_t npieces, piece_room;
+    kept_ref_t *refs;
+    size_t nrefs, ref_room;
+} kept_value_t;
+
+static void *checked(void *p, size_t size)
+{
+    if (!p) {
+        fprintf(stderr, "rtl_arena: out of memory (%zu bytes)\n", size);
+        abort();
+    }
+    return p;
+}
+
+static void *grow(void *p, size_t *room, size_t size)
+{
+    *room = *room ? 2 * *room : 16;
+    return checked(realloc(p, *room * size), *room * size);
+}
+
+static void save_pieces(kept_value_t *k, char *value, rtl_arena_layout_t const *layout, int n);
+
+// *ref, a string or the size bytes of an array described by entry
+static void save_piece(kept_value_t *k, void **ref, size_t size, rtl_arena_layout_t const *entry)
+{
+    size_t i = 0;
+    while (i != k->npieces && k->pieces[i].at != *ref)
+        ++i;
+
+    if (i == k->npieces) {
+        int string = !entry->data_offset;
+        char const *from = (char const *)*ref;
+        if (string) {
+            rtl_string_t const *s = (rtl_string_t const *)*ref;
+            from = s->data;
+            size = s->length;
+        }
+        char *saved = (char *)checked(malloc(size ? size : 1), size);
+        memcpy(saved, from, size);
+
+        if (k->npieces == k->piece_room)
+            k->pieces = (kept_piece_t *)grow(k->pieces, &k->piece_room, sizeof(kept_piece_t));
+        kept_piece_t piece = {*ref, size, saved, string, 0};
+        k->pieces[k->npieces++] = piece;
+
+        // the copies of the elements refer to the pieces they hold
+        if (!string && entry->elements)
+            for (size_t at = 0; at + entry->element_size <= size; at += entry->element_size)
+                save_pieces(k, saved + at, entry->element, entry->elements);
+    }
+
+    if (k->nrefs == k->ref_room)
+        k->refs = (kept_ref_t *)grow(k->refs, &k->ref_room, sizeof(kept_ref_t));
+    kept_ref_t r = {ref, i};
+    k->refs[k->nrefs++] = r;
+}
+
+static void save_pieces(kept_value_t *k, char *value, rtl_arena_layout_t const *layout, int n)
+{
+    for (int i = 0; i != n; ++i) {
+        rtl_arena_layout_t const *entry = &layout[i];
+        char *at = value + entry->offset;
+
+        if (!entry->data_offset) {
+            void **ref = (void **)at;
+            if (*ref && allocated_since(k->mark, (char const *)*ref, sizeof(rtl_string_t)))
+                save_piece(k, ref, 0, entry);
+            continue;
+        }
+
+        // the elements: (up - low) * stride of the first dimension
+        int32_t const *dims = (int32_t const *)at;
+        int64_t count = (int64_t)(dims[1] - dims[0]) * dims[2];
+        void **ref = (void **)(at + entry->data_offset);
+        if (count > 0 && *ref) {
+            size_t size = (size_t)count * entry->element_size;
+            if (allocated_since(k->mark, (char const *)*ref, size))
+                save_piece(k, ref, size, entry);
+        }
+    }
+}
+
+//
+// Release everything allocated since mark but the storage the value at
+// value refers to, as the n entries of layout describe: its strings and
+// arrays, the strings and arrays their elements refer to, and so on. They
+// are copied out and back, a piece referred to more than once stays one.
+//
+void rtl_arena_keep_value(void *mark, void *value, rtl_arena_layout_t const *layout, int n)
+{
+    kept_value_t k = {(char const *)mark, 0, 0, 0, 0, 0, 0};
+
+    if (!mark)
+        return;
+
+    save_pieces(&k, (char *)value, layout, n);
+    rtl_arena_release(mark);
+
+    for (size_t i = 0; i != k.npieces; ++i) {
+        kept_piece_t *piece = &k.pieces[i];
+        if (piece->string)
+            piece->moved = (void *)rtl_string_make(piece->saved, piece->size);
+        else
+            piece->moved = allocate(piece->size, alignment_of(piece->at));
+    }
+    for (size_t i = 0; i != k.nrefs; ++i)
+        *k.refs[i].ref = k.pieces[k.refs[i].piece].moved;
+    for (size_t i = 0; i != k.npieces; ++i) {
+        kept_piece_t *piece = &k.pieces[i];
+        if (!piece->string)
+            memcpy(piece->moved, piece->saved, piece->size);
+        free(piece->saved);
+    }
+    free(k.pieces);
+    free(k.refs);
+}
+
+rtl_arena_stats_t const *rtl_arena_stats(void)
+{
+    return &arena.stats;
+}
+
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// tab-width: 4
+// indent-tabs-mode: nil
+// End:
@@ -0,0 +1,23 @@
+//
+// rtl_bounds_error.c - Failed array bounds check (compiler -fcheck-bounds)
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "mini_system.h"
+
+// What was output so far is written out before the program stops.
+void rtl_bounds_error(int index, int low, int up)
+{
+    rtl_output_flush();
+    fprintf(stderr, "array index %d out of bounds %d..%d\n", index, low, up);
+    exit(1);
+}
+
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// tab-width: 4
+// indent-tabs-mode: nil
+// End:
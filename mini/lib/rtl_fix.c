@@ -4,6 +4,8 @@
 
 #include <stdint.h>
 
+#include "mini_system.h"
+
 int32_t rtl_fix(double x)
 {
   return (int)x;
@@ -0,0 +1,412 @@
+//
+// rtl_input.c - The input statement: numbers, booleans and strings from stdin
+//
+// stdin is read with read(2) as it comes, or mapped as a whole if it is a
+// regular file, and items are parsed straight out of that memory. Input is
+// read only when there is no item left, or the one at hand may go on, so an
+// item typed at a terminal, or written to a pipe that stays open, is taken
+// as soon as a separator ends it. An item is read on, into a larger buffer
+// if need be, until it is whole. Items are separated by white space or
+// commas. Integers and reals are converted here, not with scanf: a real of
+// at most 19 significant digits and a power of ten up to 22 is exact in one
+// multiplication or division; only longer ones go through strtod.
+//
+// A missing or malformed item ends the program with a message, after the
+// output so far has been written out.
+//
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if __has_include(<unistd.h>)
+#    include <unistd.h>
+#    define RTL_INPUT_READ 1
+#endif
+#if __has_include(<sys/mman.h>)
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    define RTL_INPUT_MMAP 1
+#endif
+
+#include "mini_system.h"
+
+typedef struct rtl_input {
+    char const *next;
+    char const *end;
+    char *buffer; // for read(), 0 if the input is mapped or given
+    size_t size;  // of buffer
+    int eof;      // nothing more than what is in [next, end)
+    int started;
+    long items;   // read so far, for messages
+} rtl_input_t;
+
+static rtl_input_t in;
+
+static void input_error(char const *what)
+{
+    rtl_output_flush();
+    fprintf(stderr, "input item %ld: %s\n", in.items + 1, what);
+    exit(1);
+}
+
+static void start(void)
+{
+    in.started = 1;
+#ifdef RTL_INPUT_MMAP
+    struct stat st;
+    if (fstat(0, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *p = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, 0, 0);
+        if (p != MAP_FAILED) {
+            posix_madvise(p, st.st_size, POSIX_MADV_SEQUENTIAL);
+            in.next = (char const *)p;
+            in.end = in.next + st.st_size;
+            in.eof = 1;
+            return;
+        }
+    }
+#endif
+    in.buffer = (char *)malloc(RTL_INPUT_BUFFER_SIZE);
+    if (!in.buffer)
+        input_error("out of memory");
+    in.size = RTL_INPUT_BUFFER_SIZE;
+    in.next = in.end = in.buffer;
+}
+
+// [next, end) moved to the start of the buffer
+static void shift(void)
+{
+    size_t left = in.end - in.next;
+    memmove(in.buffer, in.next, left);
+    in.next = in.buffer;
+    in.end = in.buffer + left;
+}
+
+//
+// What input there is, up to the room after end, waiting only if there is
+// none; false at the end of the input. The output so far is written out
+// first, so that a prompt is visible before the program waits.
+//
+static int read_some(void)
+{
+    char *at = in.buffer + (in.end - in.buffer);
+    size_t room = in.size - (in.end - in.buffer);
+
+    rtl_output_flush();
+#ifdef RTL_INPUT_READ
+    ssize_t n;
+    do
+        n = read(0, at, room);
+    while (n < 0 && errno == EINTR);
+    if (n < 0)
+        input_error(strerror(errno));
+#else
+    // a line at a time, where there is no read(2)
+    size_t n = fgets(at, room < INT32_MAX ? (int)room : INT32_MAX, stdin) ? strlen(at) : 0;
+#endif
+    in.end += n;
+    if (n == 0)
+        in.eof = 1;
+    return n != 0;
+}
+
+// some input in [next, end), unless at the end of the input
+static void fill(void)
+{
+    if (!in.started)
+        start();
+    if (in.eof || in.next != in.end)
+        return;
+
+    shift();
+    read_some();
+}
+
+//
+// More input after [next, end), which stays in the buffer; the buffer
+// grows if it holds nothing else. False at the end of the input.
+//
+static int more(void)
+{
+    if (in.eof)
+        return 0;
+
+    shift();
+    size_t used = in.end - in.buffer;
+    if (in.size - used < 2) { // fgets() needs room for a NUL
+        char *buffer = (char *)realloc(in.buffer, 2 * in.size);
+        if (!buffer)
+            input_error("item too long, out of memory");
+        in.next = buffer;
+        in.end = buffer + used;
+        in.buffer = buffer;
+        in.size *= 2;
+    }
+    return read_some();
+}
+
+static int separator(char c)
+{
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == ',' || c == '\f' || c == '\v';
+}
+
+// the start of the next item, 0 at the end of the input
+static char const *next_item(void)
+{
+    for (;;) {
+        fill();
+        while (in.next != in.end && separator(*in.next))
+            ++in.next;
+        if (in.next != in.end)
+            return in.next;
+        if (in.eof)
+            return 0;
+    }
+}
+
+// the end of the item at next, which is read on until it is whole
+static char const *item_end(void)
+{
+    size_t n = 0;
+    for (;;) {
+        while (in.next + n != in.end && !separator(in.next[n]))
+            ++n;
+        if (in.next + n != in.end || !more())
+            return in.next + n;
+    }
+}
+
+int32_t rtl_input_int(void)
+{
+    if (!next_item())
+        input_error("end of input, expected an integer");
+
+    char const *end = item_end();
+    char const *p = in.next;
+    int negative = *p == '-';
+    if (*p == '-' || *p == '+')
+        ++p;
+    if (p == end)
+        input_error("expected an integer");
+
+    uint32_t value = 0;
+    for (; p != end; ++p) {
+        unsigned digit = (unsigned char)*p - '0';
+        if (digit > 9)
+            input_error("expected an integer");
+        if (value > (UINT32_C(0x80000000) - digit) / 10)
+            input_error("integer out of range");
+        value = value * 10 + digit;
+    }
+    if (!negative && value > INT32_MAX)
+        input_error("integer out of range");
+
+    in.next = end;
+    ++in.items;
+    return negative ? (int32_t)(0 - value) : (int32_t)value;
+}
+
+static const double exact_powers[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                                      1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                                      1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+// strtod() on a NUL-terminated copy of the item
+static double slow_real(char const *p, char const *end)
+{
+    char text[RTL_INPUT_MAX_ITEM + 1];
+    size_t n = end - p;
+    if (n > RTL_INPUT_MAX_ITEM)
+        input_error("expected a real");
+    memcpy(text, p, n);
+    text[n] = 0;
+
+    char *stop;
+    double value = strtod(text, &stop);
+    if (stop != text + n)
+        input_error("expected a real");
+    return value;
+}
+
+double rtl_input_real(void)
+{
+    if (!next_item())
+        input_error("end of input, expected a real");
+
+    char const *end = item_end();
+    char const *p = in.next;
+    int negative = *p == '-';
+    if (*p == '-' || *p == '+')
+        ++p;
+    char const *start = p; // of the magnitude
+
+    uint64_t mantissa = 0;
+    int digits = 0;    // significant digits in mantissa
+    int exponent = 0;  // of ten
+    int seen = 0;      // any digit at all
+    int overflow = 0;  // more digits than mantissa holds
+    for (int fraction = 0; p != end; ++p) {
+        if (*p == '.' && !fraction) {
+            fraction = 1;
+            continue;
+        }
+        unsigned digit = (unsigned char)*p - '0';
+        if (digit > 9)
+            break;
+        seen = 1;
+        if (digits < 19) {
+            if (mantissa || digit)
+                ++digits;
+            mantissa = mantissa * 10 + digit;
+            exponent -= fraction;
+        } else {
+            overflow = 1;
+        }
+    }
+    if (!seen)
+        input_error("expected a real");
+    if (p != end) {
+        if (*p != 'e' && *p != 'E')
+            input_error("expected a real");
+        ++p;
+        int exponent_negative = *p == '-';
+        if (*p == '-' || *p == '+')
+            ++p;
+        int e = 0;
+        if (p == end)
+            input_error("expected a real");
+        for (; p != end; ++p) {
+            unsigned digit = (unsigned char)*p - '0';
+            if (digit > 9)
+                input_error("expected a real");
+            if (e < 10000)
+                e = e * 10 + digit;
+        }
+        exponent += exponent_negative ? -e : e;
+    }
+
+    double value;
+    if (!overflow && mantissa < (UINT64_C(1) << 53) && exponent >= -22 && exponent <= 22)
+        value = exponent < 0 ? (double)mantissa / exact_powers[-exponent]
+                             : (double)mantissa * exact_powers[exponent];
+    else
+        value = slow_real(start, end);
+
+    in.next = end;
+    ++in.items;
+    return negative ? -value : value; // -0 too
+}
+
+//
+// A word, or the characters between double quotes
+//
+rtl_string_t const *rtl_input_string(void)
+{
+    char const *p = next_item();
+    if (!p)
+        input_error("end of input, expected a string");
+
+    char const *end;
+    if (*p == '"') {
+        size_t n = 1;
+        while (!(end = memchr(in.next + n, '"', in.end - in.next - n))) {
+            n = in.end - in.next;
+            if (!more())
+                input_error("unterminated string");
+        }
+        p = in.next + 1;
+        in.next = end + 1;
+    } else {
+        end = item_end();
+        p = in.next;
+        in.next = end;
+    }
+    ++in.items;
+    return rtl_string_make(p, end - p);
+}
+
+// the n characters at p are word, ignoring case
+static int is_word(char const *p, size_t n, char const *word)
+{
+    if (strlen(word) != n)
+        return 0;
+    for (; n; --n, ++p, ++word)
+        if ((*p | 0x20) != *word)
+            return 0;
+    return 1;
+}
+
+static char input_bool(void)
+{
+    if (!next_item())
+        input_error("end of input, expected a boolean");
+
+    char const *end = item_end();
+    char const *p = in.next;
+    size_t n = end - p;
+    char value = 0;
+    if (is_word(p, n, "true") || (n == 1 && *p == '1'))
+        value = 1;
+    else if (is_word(p, n, "false") || (n == 1 && *p == '0'))
+        value = 0;
+    else
+        input_error("expected a boolean");
+
+    in.next = end;
+    ++in.items;
+    return value;
+}
+
+//
+// All targets of one input statement. types holds one letter per argument,
+// each a pointer to the target: 'i' integer, 'r' real, 's' string, 'b'
+// boolean (one byte).
+//
+int rtl_input_list(char const *types, ...)
+{
+    va_list ap;
+
+    va_start(ap, types);
+    for (; *types; ++types) {
+        switch (*types) {
+        case 'i':
+            *va_arg(ap, int32_t *) = rtl_input_int();
+            break;
+        case 'r':
+            *va_arg(ap, double *) = rtl_input_real();
+            break;
+        case 's':
+            *va_arg(ap, rtl_string_t const **) = rtl_input_string();
+            break;
+        case 'b':
+            *va_arg(ap, char *) = input_bool();
+            break;
+        }
+    }
+    va_end(ap);
+
+    return 0;
+}
+
+//
+// Read from text instead of stdin, e.g. in tests; from stdin again if text
+// is 0
+//
+void rtl_input_from(char const *text, size_t n)
+{
+    free(in.buffer);
+    memset(&in, 0, sizeof in);
+    if (!text)
+        return;
+    in.started = in.eof = 1;
+    in.next = text;
+    in.end = text + n;
+}
+
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// tab-width: 4
+// indent-tabs-mode: nil
+// End:
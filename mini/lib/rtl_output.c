@@ -2,11 +2,14 @@
 //
 //
 
-#include <stdio.h>
+#include "mini_system.h"
 
 int rtl_output(int d)
 {
-    printf("%d ", d);
+    char buf[16];
+    size_t n = rtl_format_int(buf, d);
+    buf[n++] = ' ';
+    rtl_output_write(buf, n);
 
     return 0;
 }
@@ -2,11 +2,14 @@
 //
 //
 
-#include <stdio.h>
+#include "mini_system.h"
 
 int rtl_output_bool(char d)
 {
-  printf("%s ", (d?"true":"false"));
+  if (d)
+      rtl_output_write("true ", 5);
+  else
+      rtl_output_write("false ", 6);
 
   return 0;
 }
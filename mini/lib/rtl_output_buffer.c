@@ -0,0 +1,140 @@
+//
+// rtl_output_buffer.c - Buffered standard output for the rtl_output* family
+//
+// Output goes to a per-thread buffer that is written to stdout when it is
+// full, when rtl_output_flush() is called (generated code does so before
+// main returns) and at exit. Numbers are formatted by hand; only values
+// that %g would print in exponent form, or that round too close to a half,
+// go through snprintf().
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "mini_system.h"
+
+#define RTL_OUTPUT_BUFFER_SIZE (16 * 1024)
+
+typedef struct rtl_output_buffer {
+    size_t used;
+    char data[RTL_OUTPUT_BUFFER_SIZE];
+} rtl_output_buffer_t;
+
+static _Thread_local rtl_output_buffer_t out;
+
+void rtl_output_flush(void)
+{
+    if (out.used) {
+        fwrite(out.data, 1, out.used, stdout);
+        out.used = 0;
+    }
+    fflush(stdout);
+}
+
+void rtl_output_write(char const *s, size_t n)
+{
+    static int once = 0;
+
+    if (!once) {
+        once = 1;
+        atexit(rtl_output_flush);
+    }
+
+    if (RTL_OUTPUT_BUFFER_SIZE - out.used < n) {
+        rtl_output_flush();
+        if (n > RTL_OUTPUT_BUFFER_SIZE) {
+            fwrite(s, 1, n, stdout);
+            return;
+        }
+    }
+    memcpy(out.data + out.used, s, n);
+    out.used += n;
+}
+
+size_t rtl_format_int(char *buf, int d)
+{
+    char tmp[16];
+    char *p = tmp + sizeof(tmp);
+    unsigned u = d < 0 ? 0u - (unsigned)d : (unsigned)d;
+
+    do {
+        *--p = '0' + u % 10;
+        u /= 10;
+    } while (u);
+    if (d < 0)
+        *--p = '-';
+
+    size_t n = tmp + sizeof(tmp) - p;
+    memcpy(buf, p, n);
+    return n;
+}
+
+//
+// Same text as printf("%g", d). Values from 1e-4 up to 1e6 (exclusive)
+// are scaled by an exact power of ten to six significant digits; the
+// product is rounded once, so a fraction within 1e-9 of one half could
+// round differently from the exact decimal value and is left to snprintf().
+//
+size_t rtl_format_real(char *buf, double d)
+{
+    static const double pow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9};
+    double a = fabs(d);
+
+    if (!(a >= 1e-4 && a < 1e6))
+        return snprintf(buf, RTL_FORMAT_SIZE, "%g", d);
+
+    int x = 5; // decimal exponent of a
+    while (x > -4 && a < (x >= 0 ? pow10[x] : 1 / pow10[-x]))
+        --x;
+
+    double y = a * pow10[5 - x];
+    long m = (long)y;
+    double frac = y - m;
+    if (fabs(frac - 0.5) < 1e-9)
+        return snprintf(buf, RTL_FORMAT_SIZE, "%g", d);
+    if (frac > 0.5)
+        ++m;
+    if (m >= 1000000) {
+        m /= 10;
+        ++x;
+    }
+    if (x >= 6)
+        return snprintf(buf, RTL_FORMAT_SIZE, "%g", d);
+
+    char digits[6];
+    for (int i = 6; i--; m /= 10)
+        digits[i] = '0' + m % 10;
+    int ndigits = 6;
+    while (ndigits > 1 && digits[ndigits - 1] == '0')
+        --ndigits;
+
+    char *p = buf;
+    if (d < 0)
+        *p++ = '-';
+    if (x >= 0) {
+        for (int i = 0; i <= x; ++i)
+            *p++ = digits[i];
+        if (ndigits > x + 1) {
+            *p++ = '.';
+            for (int i = x + 1; i < ndigits; ++i)
+                *p++ = digits[i];
+        }
+    } else {
+        *p++ = '0';
+        *p++ = '.';
+        for (int i = -1; i > x; --i)
+            *p++ = '0';
+        for (int i = 0; i < ndigits; ++i)
+            *p++ = digits[i];
+    }
+    return p - buf;
+}
+
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// tab-width: 4
+// indent-tabs-mode: nil
+// End:
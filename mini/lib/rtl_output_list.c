@@ -0,0 +1,48 @@
+//
+//
+//
+
+#include <stdarg.h>
+
+#include "mini_system.h"
+
+//
+// All items of one output statement. types holds one letter per argument:
+// 'i' integer, 'r' real, 's' string (rtl_string_t), 'b' boolean (promoted
+// to int); 'n' takes no argument and ends the line.
+//
+int rtl_output_list(char const *types, ...)
+{
+    va_list ap;
+
+    va_start(ap, types);
+    for (; *types; ++types) {
+        switch (*types) {
+        case 'i':
+            rtl_output(va_arg(ap, int));
+            break;
+        case 'r':
+            rtl_output_real(va_arg(ap, double));
+            break;
+        case 's':
+            rtl_output_string(va_arg(ap, rtl_string_t const *));
+            break;
+        case 'b':
+            rtl_output_bool((char)va_arg(ap, int));
+            break;
+        case 'n':
+            rtl_output_nl(0);
+            break;
+        }
+    }
+    va_end(ap);
+
+    return 0;
+}
+
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// tab-width: 4
+// indent-tabs-mode: nil
+// End:
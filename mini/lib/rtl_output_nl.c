@@ -2,11 +2,11 @@
 //
 //
 
-#include <stdio.h>
+#include "mini_system.h"
 
 int rtl_output_nl(char *s)
 {
-    printf("\n");
+    rtl_output_write("\n", 1);
 
     return 0;
 }
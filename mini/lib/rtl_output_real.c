@@ -2,11 +2,14 @@
 //
 //
 
-#include <stdio.h>
+#include "mini_system.h"
 
 int rtl_output_real(double d)
 {
-    printf("%g ", d);
+    char buf[RTL_FORMAT_SIZE + 1];
+    size_t n = rtl_format_real(buf, d);
+    buf[n++] = ' ';
+    rtl_output_write(buf, n);
 
     return 0;
 }
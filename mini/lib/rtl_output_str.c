@@ -2,11 +2,14 @@
 //
 //
 
-#include <stdio.h>
+#include <string.h>
+
+#include "mini_system.h"
 
 int rtl_output_str(char *s)
 {
-    printf("%s ", s);
+    rtl_output_write(s, strlen(s));
+    rtl_output_write(" ", 1);
 
     return 0;
 }
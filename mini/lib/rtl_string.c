@@ -0,0 +1,249 @@
+//
+// rtl_string.c - EASY strings: length-prefixed, short strings held inline,
+// concatenation in place and substrings without copying
+//
+// A string value is a pointer to a header (rtl_string_t) that holds the
+// length and points to the characters, which are not NUL-terminated:
+//
+//   - a literal points to constant data emitted by the compiler
+//   - a result of up to RTL_STRING_SSO characters is kept in the header
+//   - a longer result lives in a buffer that the header points into
+//   - a substring points into the characters of its string
+//
+// Headers are never written once they are returned, so several variables
+// may share one. A concatenation whose first operand ends where the used
+// part of its buffer ends appends the other operands to that buffer, and
+// buffers grow geometrically: 'set s := s || x' in a loop copies each
+// character a constant number of times.
+//
+// Headers and buffers come from the arena of rtl_arena.c, so the scope
+// that made a string releases it, unless the compiler found that it may be
+// stored where it outlives the scope. rtl_string_keep() keeps the result of
+// a function over the release of its mark. A null string is taken as empty.
+//
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mini_system.h"
+
+#define RTL_STRING_MIN_BUFFER 64
+
+struct rtl_string_buffer {
+    size_t capacity;
+    size_t used;
+    char chars[];
+};
+
+static _Thread_local rtl_string_stats_t stats;
+
+static rtl_string_t const empty = {0, "", 0, {0}};
+
+// the one-character strings, for rtl_string_character()
+#define C1(c) {1, one_char[c].small, 0, {(char)(c)}}
+#define C4(c) C1(c), C1(c + 1), C1(c + 2), C1(c + 3)
+#define C16(c) C4(c), C4(c + 4), C4(c + 8), C4(c + 12)
+#define C64(c) C16(c), C16(c + 16), C16(c + 32), C16(c + 48)
+static rtl_string_t const one_char[256] = {C64(0), C64(64), C64(128), C64(192)};
+
+static void *allocate(size_t n)
+{
+    stats.bytes += n;
+    return rtl_arena_allocate_words(n);
+}
+
+static rtl_string_t *new_string(size_t length)
+{
+    if (length > INT32_MAX) {
+        fprintf(stderr, "rtl_string: string of %zu characters is too long\n", length);
+        abort();
+    }
+    rtl_string_t *s = (rtl_string_t *)allocate(sizeof(rtl_string_t));
+    s->length = (int32_t)length;
+    s->data = s->small;
+    s->buffer = 0;
+    ++stats.strings;
+    return s;
+}
+
+static rtl_string_buffer_t *new_buffer(size_t length)
+{
+    size_t capacity = 2 * length;
+    if (capacity < RTL_STRING_MIN_BUFFER)
+        capacity = RTL_STRING_MIN_BUFFER;
+    rtl_string_buffer_t *b = (rtl_string_buffer_t *)allocate(sizeof(rtl_string_buffer_t) + capacity);
+    b->capacity = capacity;
+    b->used = 0;
+    return b;
+}
+
+// s ends where the used part of its buffer ends, with room for n more
+static int can_append(rtl_string_t const *s, size_t n)
+{
+    rtl_string_buffer_t *b = s->buffer;
+    return b && s->data + s->length == b->chars + b->used && b->capacity - b->used >= n;
+}
+
+static rtl_string_t const *arg(va_list *ap)
+{
+    rtl_string_t const *s = va_arg(*ap, rtl_string_t const *);
+    return s ? s : &empty;
+}
+
+//
+// The concatenation of n strings, in one copy
+//
+rtl_string_t const *rtl_string_concat(int n, ...)
+{
+    va_list ap, parts;
+    size_t length = 0;
+
+    va_start(ap, n);
+    va_copy(parts, ap);
+    for (int i = 0; i != n; ++i)
+        length += arg(&ap)->length;
+    va_end(ap);
+
+    rtl_string_t const *first = n ? arg(&parts) : &empty;
+    if (length == (size_t)first->length) {
+        va_end(parts);
+        return first; // the others are empty
+    }
+
+    rtl_string_t *s = new_string(length);
+    char *out;
+    if (can_append(first, length - first->length)) {
+        s->data = first->data;
+        s->buffer = first->buffer;
+        out = s->buffer->chars + s->buffer->used;
+        s->buffer->used += length - first->length;
+        ++stats.appends;
+    } else {
+        if (length <= RTL_STRING_SSO) {
+            out = s->small;
+        } else {
+            s->buffer = new_buffer(length);
+            s->buffer->used = length;
+            s->data = out = s->buffer->chars;
+            ++stats.copies;
+        }
+        memcpy(out, first->data, first->length);
+        out += first->length;
+    }
+
+    for (int i = 1; i < n; ++i) {
+        rtl_string_t const *part = arg(&parts);
+        memcpy(out, part->data, part->length);
+        out += part->length;
+    }
+    va_end(parts);
+    return s;
+}
+
+//
+// The n characters of s from position start on (the first is 1), as far
+// as s has them
+//
+rtl_string_t const *rtl_string_substr(rtl_string_t const *s, int start, int n)
+{
+    if (!s)
+        s = &empty;
+    if (start < 1) {
+        long long rest = (long long)n - (1 - (long long)start);
+        n = rest < 0 ? 0 : (int)rest;
+        start = 1;
+    }
+    if (start > s->length || n <= 0)
+        return &empty;
+    if (n > s->length - start + 1)
+        n = s->length - start + 1;
+    if (start == 1 && n == s->length)
+        return s;
+
+    rtl_string_t *sub = new_string(n);
+    if (n <= RTL_STRING_SSO) {
+        memcpy(sub->small, s->data + start - 1, n); // no reference to s
+    } else {
+        sub->data = s->data + start - 1;
+        sub->buffer = s->buffer;
+        ++stats.views;
+    }
+    return sub;
+}
+
+//
+// A string of a copy of n characters
+//
+rtl_string_t const *rtl_string_make(char const *chars, size_t n)
+{
+    if (n == 0)
+        return &empty;
+
+    rtl_string_t *s = new_string(n);
+    if (n > RTL_STRING_SSO) {
+        s->buffer = new_buffer(n);
+        s->buffer->used = n;
+        s->data = s->buffer->chars;
+        ++stats.copies;
+    }
+    memcpy((char *)s->data, chars, n);
+    return s;
+}
+
+//
+// s, as the result of a function: the storage taken since mark is released
+// but the header and buffer of s, which move down to the mark
+//
+rtl_string_t const *rtl_string_keep(void *mark, rtl_string_t const *s)
+{
+    if (!s)
+        return s;
+
+    rtl_string_buffer_t *b = s->buffer;
+    int small = s->data == s->small;
+    size_t offset = b ? (size_t)(s->data - b->chars) : 0;
+
+    void *header = (void *)s, *buffer = b;
+    rtl_arena_keep_t keep[] = {{&header, sizeof(rtl_string_t)},
+                               {&buffer, b ? sizeof(rtl_string_buffer_t) + b->capacity : 0}};
+    rtl_arena_release_keep(mark, keep, 2);
+
+    rtl_string_t *kept = (rtl_string_t *)header;
+    if (kept != s) { // not a literal or older than the mark
+        if (small)
+            kept->data = kept->small;
+        else if (b) {
+            kept->buffer = (rtl_string_buffer_t *)buffer;
+            kept->data = kept->buffer->chars + offset;
+        }
+    }
+    return kept;
+}
+
+rtl_string_t const *rtl_string_character(int c)
+{
+    return &one_char[(unsigned char)c];
+}
+
+int rtl_output_string(rtl_string_t const *s)
+{
+    if (s)
+        rtl_output_write(s->data, s->length);
+    rtl_output_write(" ", 1);
+
+    return 0;
+}
+
+rtl_string_stats_t const *rtl_string_stats(void)
+{
+    return &stats;
+}
+
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// tab-width: 4
+// indent-tabs-mode: nil
+// End: